@@ -2,17 +2,122 @@
 #include "osapi.h"
 #include "driver/uart.h"
 
+#define UART_TX_RING_MASK	(UART_TX_RING_SIZE - 1)
+
+/**
+ * Characters waiting for room in the TX FIFO.  UARTTxd() only writes 'head'
+ * and the interrupt only writes 'tail'; both count up and wrap.
+ */
+static uint8 uart_tx_ring[UART_TX_RING_SIZE];
+static volatile uint16 uart_tx_head = 0;
+static volatile uint16 uart_tx_tail = 0;
+static uint32 uart_tx_dropped = 0;
+
+#define UART_TX_USED()		((uint16)(uart_tx_head - uart_tx_tail))
+#define UART_TX_FIFO_CNT()	\
+	((READ_PERI_REG(UART_STATUS(0)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT)
+
+/**
+ * Move as much of the ring into the FIFO as will fit and stop the interrupt
+ * once the ring is empty.  Only called from the interrupt or with it
+ * disabled.
+ */
+static void uart_tx_fill(void)
+{
+	uint16 tail = uart_tx_tail;
+
+	while ((tail != uart_tx_head) && (UART_TX_FIFO_CNT() < 126))
+	{
+		WRITE_PERI_REG(UART_FIFO(0), uart_tx_ring[tail & UART_TX_RING_MASK]);
+		tail++;
+	}
+	uart_tx_tail = tail;
+
+	if (tail == uart_tx_head)
+	{
+		CLEAR_PERI_REG_MASK(UART_INT_ENA(0), UART_TXFIFO_EMPTY_INT_ENA);
+	}
+}
+
+static void uart_isr(void *arg)
+{
+	uint32 status = READ_PERI_REG(UART_INT_ST(0));
+
+	if (status & UART_TXFIFO_EMPTY_INT_ST)
+	{
+		uart_tx_fill();
+	}
+	WRITE_PERI_REG(UART_INT_CLR(0), status);
+}
+
 static void ICACHE_FLASH_ATTR UARTTxd(char TxChar) {
-	// Wait until there is room in the FIFO
-	while (true)
+	if (UART_TX_USED() >= UART_TX_RING_SIZE)
 	{
-		uint32 fifo_cnt = READ_PERI_REG(UART_STATUS(0)) & (UART_TXFIFO_CNT<<UART_TXFIFO_CNT_S);
-		if ((fifo_cnt >> UART_TXFIFO_CNT_S & UART_TXFIFO_CNT) < 126) {
-			break;
+#ifdef UART_TX_BLOCK
+		// Wait until the FIFO has taken some of the ring
+		while (UART_TX_USED() >= UART_TX_RING_SIZE)
+		{
+			ETS_UART_INTR_DISABLE();
+			uart_tx_fill();
+			ETS_UART_INTR_ENABLE();
 		}
+#else
+		uart_tx_dropped++;
+		return;
+#endif
+	}
+
+	ETS_UART_INTR_DISABLE();
+	if ((UART_TX_USED() == 0) && (UART_TX_FIFO_CNT() < 126))
+	{
+		// Nothing waiting so straight into the FIFO
+		WRITE_PERI_REG(UART_FIFO(0), TxChar);
 	}
-	// Send the character
-	WRITE_PERI_REG(UART_FIFO(0), TxChar);
+	else
+	{
+		uart_tx_ring[uart_tx_head & UART_TX_RING_MASK] = TxChar;
+		uart_tx_head++;
+		SET_PERI_REG_MASK(UART_INT_ENA(0), UART_TXFIFO_EMPTY_INT_ENA);
+	}
+	ETS_UART_INTR_ENABLE();
+}
+
+/**
+ * Queue raw bytes, as they are without any \n conversion, either all of
+ * them or, if the ring has not got room, none of them.
+ */
+bool ICACHE_FLASH_ATTR UARTWrite(const uint8 *data, int length) {
+	int ii;
+
+	if (length > UART_TX_RING_SIZE)
+	{
+		return(FALSE);
+	}
+
+	while (UART_TX_RING_SIZE - UART_TX_USED() < length)
+	{
+#ifdef UART_TX_BLOCK
+		ETS_UART_INTR_DISABLE();
+		uart_tx_fill();
+		ETS_UART_INTR_ENABLE();
+#else
+		return(FALSE);
+#endif
+	}
+
+	ETS_UART_INTR_DISABLE();
+	for (ii = 0; ii < length; ii++)
+	{
+		uart_tx_ring[uart_tx_head & UART_TX_RING_MASK] = data[ii];
+		uart_tx_head++;
+	}
+	uart_tx_fill();
+	if (uart_tx_tail != uart_tx_head)
+	{
+		SET_PERI_REG_MASK(UART_INT_ENA(0), UART_TXFIFO_EMPTY_INT_ENA);
+	}
+	ETS_UART_INTR_ENABLE();
+	return(TRUE);
 }
 
 static void ICACHE_FLASH_ATTR UARTPutChar(char TxChar) {
@@ -42,6 +147,22 @@ void UARTInit(UartBautRate uart0_br) {
 	// Clear pending interrupts
 	WRITE_PERI_REG(UART_INT_CLR(0), 0xffff);
 
+	// Interrupt when the TX FIFO runs low, but only while the ring has data
+	WRITE_PERI_REG(UART_INT_ENA(0), 0);
+	CLEAR_PERI_REG_MASK(UART_CONF1(0),
+			UART_TXFIFO_EMPTY_THRHD << UART_TXFIFO_EMPTY_THRHD_S);
+	SET_PERI_REG_MASK(UART_CONF1(0),
+			UART_TX_EMPTY_THRESHOLD << UART_TXFIFO_EMPTY_THRHD_S);
+	ETS_UART_INTR_ATTACH(uart_isr, NULL);
+	ETS_UART_INTR_ENABLE();
+
 	// Install our own putchar handler
 	os_install_putc1((void *)UARTPutChar);
 }
+
+/**
+ * Characters that did not fit in the TX ring.
+ */
+uint32 ICACHE_FLASH_ATTR UARTTxDropped(void) {
+	return(uart_tx_dropped);
+}
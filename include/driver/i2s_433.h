@@ -4,7 +4,8 @@
 /**
  * The interface is that:
  *
- * 1. Call i2sInit() to initialize the system.
+ * 1. Call i2sInit() to initialize the system; it is FALSE if the buffers
+ *    could not be allocated, and calling it again only sets the callback.
  * 2. For each frame you want to send...
  *    2.1 Call i2sInitSignal()
  *    2.2 Call i2sWriteFrame()
@@ -12,7 +13,49 @@
  *    2.4 Call i2sTermSignal() to complete the data frame
  *    2.5 Call i2sSendSignal().
  * 3. Optionally wait for the 'completed' callback.
+ *
+ * Alternatively encode a data value once with i2sFrameData() and queue the
+ * frame with i2sSendFrame() as many times as needed, for example to repeat
+ * a reading or retry it later.  Frames are reference counted and go back
+ * to their pool once the caller and every queued send have released them;
+ * i2sSendSignal() is the same as queueing the frame just built to be sent
+ * I2S_FRAME_REPEATS times.
+ *
+ * Captured signals, of any length, are streamed with i2sStreamStart(); the
+ * buffers become a ring that is refilled from the source while it is sent.
+ * A stream uses all of the buffers so it can only be started when nothing
+ * else is being sent or queued (i2sSendIdle()); i2sStreamStart() is FALSE
+ * otherwise.  Frames queued meanwhile wait for it.
+ */
+
+/**
+ * Key counters that define the signal.  The HIGH is '1 unit' and the
+ * values below denote the length of the LOW that forms the value, in
+ * 'units'.  These are shared with the receive side decoder.
+ *
+ * ** YOU WILL WANT TO CHANGE THESE ***
+ */
+#define I2S_UNIT_US   400
+#define I2S_LOW_ZERO  4
+#define I2S_LOW_ONE   8
+#define I2S_LOW_VAL_MAX 8
+#define I2S_LOW_FRAME 19
+
+/**
+ * The I2S sends 32 bits for each 433MHz unit so each bit, the resolution of
+ * a streamed signal, lasts 12.5us.
  */
+#define I2S_TICK_NS   12500
+
+/**
+ * The most repeats of a data frame in one send.
+ */
+#define I2S_FRAME_REPEATS 7
+
+/**
+ * An encoded data frame; see i2sFrameData().
+ */
+typedef struct i2s_frame I2S_FRAME;
 
 /**
  * A definition for a callback that allows the user of this function to know
@@ -20,7 +63,16 @@
  */
 typedef void (*I2S_SEND_COMPLETE)(void);
 
-void ICACHE_FLASH_ATTR i2sInit(I2S_SEND_COMPLETE);
+/**
+ * The source of a streamed signal.  Write up to 'max' pulses, each a count
+ * of I2S bits, to 'ticks' and return the number written or 0 at the end of
+ * the signal.  Pulses alternate HIGH and LOW, starting with a HIGH.
+ * 'ticks' is word aligned and 'max' is even so the pulses can be read from
+ * flash directly into it.
+ */
+typedef int (*I2S_STREAM_SOURCE)(void *arg, uint16 *ticks, int max);
+
+bool ICACHE_FLASH_ATTR i2sInit(I2S_SEND_COMPLETE);
 void ICACHE_FLASH_ATTR i2sSendSignal(void);
 void ICACHE_FLASH_ATTR i2sInitSignal();
 void ICACHE_FLASH_ATTR i2sDataValue(uint32 data_433);
@@ -28,5 +80,12 @@ void ICACHE_FLASH_ATTR i2sTermSignal();
 void ICACHE_FLASH_ATTR i2sWriteFrame();
 void ICACHE_FLASH_ATTR i2sWriteZero();
 void ICACHE_FLASH_ATTR i2sWriteOne();
+I2S_FRAME * ICACHE_FLASH_ATTR i2sFrameData(uint32 data_433);
+I2S_FRAME * ICACHE_FLASH_ATTR i2sFrameRef(I2S_FRAME *frame);
+void ICACHE_FLASH_ATTR i2sFrameRelease(I2S_FRAME *frame);
+bool ICACHE_FLASH_ATTR i2sSendFrame(I2S_FRAME *frame, int repeats);
+bool ICACHE_FLASH_ATTR i2sSendIdle(void);
+bool ICACHE_FLASH_ATTR i2sStreamStart(I2S_STREAM_SOURCE source, void *arg);
+uint32 ICACHE_FLASH_ATTR i2sStreamUnderruns(void);
 
 #endif
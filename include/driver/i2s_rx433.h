@@ -0,0 +1,34 @@
+#ifndef _I2S_RX433_H_
+#define _I2S_RX433_H_
+
+#include "edge433.h"
+
+/**
+ * The I2S receiver oversamples the 433MHz receiver's data pin, which must
+ * be wired to GPIO12 (I2SI_DATA), into a circular chain of DMA blocks.  The
+ * CPU only sees one interrupt per completed block and the edges are found
+ * in a task, never in the interrupt.
+ *
+ * The sample clock is shared with the transmitter so each sample 'tick' is
+ * 12.5us and there are 32 ticks (one uint32) per 400us 433MHz unit.
+ *
+ * The interface is that:
+ *
+ * 1. Call i2sInit() first; it sets up the clocks and the SLC interrupt.
+ * 2. Call i2sRxInit() with the function that is to receive the edges.
+ * 3. Call i2sRxStart() and i2sRxStop() to control sampling.
+ */
+#define I2S_RX_TICKS_PER_UNIT   32
+#define I2S_RX_TICK_NS          12500
+
+bool ICACHE_FLASH_ATTR i2sRxInit(EDGE433_SINK sink, void *arg);
+void ICACHE_FLASH_ATTR i2sRxStart(void);
+void ICACHE_FLASH_ATTR i2sRxStop(void);
+uint32 ICACHE_FLASH_ATTR i2sRxOverruns(void);
+
+/**
+ * Called by the shared SLC interrupt handler; not for general use.
+ */
+void i2sRxIsr(uint32 slc_intr_status);
+
+#endif
@@ -6,6 +6,16 @@
 #define RX_BUFF_SIZE    0x100
 #define TX_BUFF_SIZE    100
 
+/**
+ * Console output is queued in a ring of UART_TX_RING_SIZE bytes (a power of
+ * two) that the TX FIFO empty interrupt drains whenever the FIFO is down to
+ * UART_TX_EMPTY_THRESHOLD.  When the ring is full characters are dropped
+ * and counted, or with UART_TX_BLOCK defined we wait for room as before.
+ */
+#define UART_TX_RING_SIZE       1024
+#define UART_TX_EMPTY_THRESHOLD 16
+// #define UART_TX_BLOCK
+
 typedef enum {
     FIVE_BITS = 0x0,
     SIX_BITS = 0x1,
@@ -92,6 +102,8 @@ typedef struct {
 } UartDevice;
 
 void UARTInit(UartBautRate uart0_br);
+uint32 UARTTxDropped(void);
+bool UARTWrite(const uint8 *data, int length);
 
 #endif
 
@@ -1,6 +1,76 @@
+/**
+ * Console logging with compile-time levels.
+ *
+ * Each module may define CONSOLE_LEVEL before including this file to set
+ * how much it prints; calls above that level compile to nothing, format
+ * string and arguments included, so they cost nothing in a build where
+ * they are turned off.  Arguments of a call that is compiled out are not
+ * evaluated.  CONSOLE_LEVEL_MAX, for example from the Makefile, caps the
+ * level of every module.
+ *
+ * Format strings are kept in flash, not RAM (see rodata.h), so console()
+ * copies the format out before using it.
+ *
+ *   #define CONSOLE_LEVEL CONSOLE_LEVEL_DEBUG
+ *   #include "logging.h"
+ *   ...
+ *   CONSOLE_WARN("Retry %d", count);
+ */
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#define CONSOLE_LEVEL_NONE	0
+#define CONSOLE_LEVEL_ERROR	1
+#define CONSOLE_LEVEL_WARN	2
+#define CONSOLE_LEVEL_INFO	3
+#define CONSOLE_LEVEL_DEBUG	4
+
+#ifndef CONSOLE_LEVEL
+#define CONSOLE_LEVEL CONSOLE_LEVEL_INFO
+#endif
+
+#ifdef CONSOLE_LEVEL_MAX
+#if CONSOLE_LEVEL > CONSOLE_LEVEL_MAX
+#undef CONSOLE_LEVEL
+#define CONSOLE_LEVEL CONSOLE_LEVEL_MAX
+#endif
+#endif
+
 /**
  * Logging function - apparently 'log' is a reserved name!
  */
-void console(char *fmt, ...);
+void console(int level, const char *fmt, ...);
+
+#define CONSOLE_FLASH(level, FMT, args...) \
+  do \
+  { \
+    static const char console_fmt[] \
+        ICACHE_RODATA_ATTR __attribute__((aligned(4))) = FMT; \
+    console((level), console_fmt, ##args); \
+  } while (0)
+
+#if CONSOLE_LEVEL >= CONSOLE_LEVEL_ERROR
+#define CONSOLE_ERROR(FMT, args...) CONSOLE_FLASH(CONSOLE_LEVEL_ERROR, FMT, ##args)
+#else
+#define CONSOLE_ERROR(FMT, args...) do {} while (0)
+#endif
+
+#if CONSOLE_LEVEL >= CONSOLE_LEVEL_WARN
+#define CONSOLE_WARN(FMT, args...) CONSOLE_FLASH(CONSOLE_LEVEL_WARN, FMT, ##args)
+#else
+#define CONSOLE_WARN(FMT, args...) do {} while (0)
+#endif
+
+#if CONSOLE_LEVEL >= CONSOLE_LEVEL_INFO
+#define CONSOLE_INFO(FMT, args...) CONSOLE_FLASH(CONSOLE_LEVEL_INFO, FMT, ##args)
+#else
+#define CONSOLE_INFO(FMT, args...) do {} while (0)
+#endif
+
+#if CONSOLE_LEVEL >= CONSOLE_LEVEL_DEBUG
+#define CONSOLE_DEBUG(FMT, args...) CONSOLE_FLASH(CONSOLE_LEVEL_DEBUG, FMT, ##args)
+#else
+#define CONSOLE_DEBUG(FMT, args...) do {} while (0)
+#endif
 
-#define CONSOLE(FMT, args...) ets_uart_printf(FMT,  ##args); ets_uart_printf("\n")
+#endif
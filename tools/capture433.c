@@ -0,0 +1,75 @@
+/*
+ *  Host tool that runs the firmware's 433MHz decoder over a recorded
+ *  capture and prints the payloads it finds.
+ *
+ *  The capture is text, one pulse per line, as "<level> <duration in us>",
+ *  for example:
+ *
+ *    1 400
+ *    0 7600
+ *
+ *  Lines starting with '#' are ignored.  Build with "make tools".
+ */
+
+#include <stdio.h>
+#include "decode433.h"
+#include "sensor433.h"
+
+static void capture433_result(void *arg,
+    const DECODE433_PROTOCOL *protocol, uint32 payload,
+    DECODE433_STATUS status, uint8 repeat)
+{
+	unsigned long *line = (unsigned long *)arg;
+	sint32 temp = sensor433_temp(payload);
+
+	printf("%6lu: %-8s 0x%08X %s repeat=%u temp=%d.%d\n",
+	    *line, protocol->name, (unsigned)payload,
+	    (status == DECODE433_OK) ? "ok " : "BAD",
+	    (unsigned)repeat, (int)(temp / 10),
+	    (int)((temp < 0) ? (-temp % 10) : (temp % 10)));
+}
+
+int main(int argc, char *argv[])
+{
+	DECODE433 decoder;
+	FILE *input = stdin;
+	char buffer[128];
+	unsigned long line = 0;
+	unsigned level;
+	unsigned long us;
+
+	if (argc > 1)
+	{
+		input = fopen(argv[1], "r");
+		if (input == NULL)
+		{
+			perror(argv[1]);
+			return(1);
+		}
+	}
+
+	decode433Init(&decoder, sensor433_protocols, sensor433_protocol_count,
+	    capture433_result, &line);
+
+	while (fgets(buffer, sizeof(buffer), input) != NULL)
+	{
+		line++;
+		if ((buffer[0] == '#') ||
+		    (sscanf(buffer, "%u %lu", &level, &us) != 2))
+		{
+			continue;
+		}
+		decode433Pulse(&decoder, level ? 1 : 0, (uint32)us);
+	}
+
+	/**
+	 * Finish with a long gap so the last payload is reported.
+	 */
+	decode433Pulse(&decoder, 0, DECODE433_IDLE_US);
+
+	if (input != stdin)
+	{
+		fclose(input);
+	}
+	return(0);
+}
@@ -0,0 +1,322 @@
+/*
+ *  Host tool that drives the transmitter over the control protocol (see
+ *  user/ctl.h).  For example:
+ *
+ *    ctl433 weather status
+ *    ctl433 weather send 0x5a0c8123 3
+ *    ctl433 weather schedule 30000 0x5a000000
+ *    ctl433 weather replay 1
+ *    ctl433 -n 100 weather send 0x5a0c8123
+ *
+ *  Each reply is printed with its round trip time; with -n the request is
+ *  made that many times, with up to -w of them (CTL_QUEUE by default)
+ *  waiting for a reply at once, and a summary of the round trip times and
+ *  the rate is printed at the end.  Replies not back within -t ms of the
+ *  last one are counted as lost.  Build with "make tools".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "portable.h"
+#include "config.h"
+#include "ctl.h"
+
+static const char *status_names[] =
+{
+	"ok", "queue full", "bad request", "bad command", "send failed"
+};
+
+static uint32 get32(const uint8 *p)
+{
+	return(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24));
+}
+
+static uint16 get16(const uint8 *p)
+{
+	return(p[0] | (p[1] << 8));
+}
+
+static void put32(uint8 *p, uint32 value)
+{
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+	p[2] = (value >> 16) & 0xFF;
+	p[3] = (value >> 24) & 0xFF;
+}
+
+static double now_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return(tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-p port] [-n count] [-w window] [-t ms] "
+	    "[-q] host\n"
+	    "    send <payload> [repeats]\n"
+	    "  | schedule <interval ms> [sender] [repeats]\n"
+	    "  | replay <capture id>\n"
+	    "  | status\n", name);
+	exit(1);
+}
+
+static void print_reply(const uint8 *reply, double rtt)
+{
+	uint64 when = get32(&reply[8]) | ((uint64)get32(&reply[12]) << 32);
+	uint8 status = reply[3];
+
+	printf("seq %u: %s, %.1f ms, ", get32(&reply[4]),
+	    (status < sizeof(status_names) / sizeof(status_names[0])) ?
+	    status_names[status] : "?", rtt);
+	if (reply[37])
+	{
+		time_t secs = (time_t)(when / 1000000);
+		char stamp[32];
+
+		strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S",
+		    gmtime(&secs));
+		printf("at %s.%06u UTC\n", stamp, (unsigned)(when % 1000000));
+	}
+	else
+	{
+		printf("at %llu us since boot\n", (unsigned long long)when);
+	}
+}
+
+static void print_status(const uint8 *reply)
+{
+	printf("Queued %u/%u, sent %u, rejected %u\n", get16(&reply[16]),
+	    get16(&reply[18]), get32(&reply[20]), get32(&reply[24]));
+	printf("Interval %u ms, sender 0x%08x, repeats %u\n", get32(&reply[28]),
+	    get32(&reply[32]), reply[36]);
+	printf("Free heap %u, least %u\n", get32(&reply[40]), get32(&reply[44]));
+}
+
+int main(int argc, char *argv[])
+{
+	struct addrinfo hints;
+	struct addrinfo *addr;
+	struct pollfd pfd;
+	uint8 request[CTL_SCHEDULE_LEN];
+	uint8 reply[CTL_REPLY_LEN + 1];
+	uint8 last[CTL_REPLY_LEN] = { 0 };
+	const char *port = NULL;
+	char port_str[8];
+	double *sent_at;
+	double start;
+	double rtt;
+	double rtt_min = 0;
+	double rtt_max = 0;
+	double rtt_total = 0;
+	unsigned long count = 1;
+	unsigned long window = CTL_QUEUE;
+	unsigned long next = 0;
+	unsigned long replies = 0;
+	unsigned long failed = 0;
+	unsigned long seq;
+	unsigned long value;
+	int timeout = 2000;
+	int quiet = 0;
+	int length;
+	int got;
+	int fd;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:n:w:t:q")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p':
+			port = optarg;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			timeout = atoi(optarg);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if ((argc - optind < 2) || (count == 0) || (window == 0))
+	{
+		usage(argv[0]);
+	}
+
+	memset(request, 0, sizeof(request));
+	request[0] = CTL_MAGIC & 0xFF;
+	request[1] = CTL_MAGIC >> 8;
+	if ((strcmp(argv[optind + 1], "send") == 0) && (argc - optind >= 3))
+	{
+		request[2] = CTL_CMD_SEND;
+		put32(&request[8], strtoul(argv[optind + 2], NULL, 0));
+		if (argc - optind >= 4)
+		{
+			request[12] = strtoul(argv[optind + 3], NULL, 0);
+		}
+		length = CTL_SEND_LEN;
+	}
+	else if ((strcmp(argv[optind + 1], "schedule") == 0) &&
+	    (argc - optind >= 3))
+	{
+		request[2] = CTL_CMD_SCHEDULE;
+		put32(&request[8], strtoul(argv[optind + 2], NULL, 0));
+		if (argc - optind >= 4)
+		{
+			put32(&request[12], strtoul(argv[optind + 3], NULL, 0));
+		}
+		if (argc - optind >= 5)
+		{
+			request[16] = strtoul(argv[optind + 4], NULL, 0);
+		}
+		length = CTL_SCHEDULE_LEN;
+	}
+	else if ((strcmp(argv[optind + 1], "replay") == 0) &&
+	    (argc - optind >= 3))
+	{
+		request[2] = CTL_CMD_REPLAY;
+		value = strtoul(argv[optind + 2], NULL, 0);
+		request[8] = value & 0xFF;
+		request[9] = (value >> 8) & 0xFF;
+		length = CTL_REPLAY_LEN;
+	}
+	else if (strcmp(argv[optind + 1], "status") == 0)
+	{
+		request[2] = CTL_CMD_STATUS;
+		length = CTL_REQUEST_LEN;
+	}
+	else
+	{
+		usage(argv[0]);
+	}
+
+	if (port == NULL)
+	{
+		snprintf(port_str, sizeof(port_str), "%d", CFG_CTL_PORT);
+		port = port_str;
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	got = getaddrinfo(argv[optind], port, &hints, &addr);
+	if (got != 0)
+	{
+		fprintf(stderr, "%s: %s\n", argv[optind], gai_strerror(got));
+		return(1);
+	}
+	fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if ((fd < 0) || (connect(fd, addr->ai_addr, addr->ai_addrlen) < 0))
+	{
+		perror("socket");
+		return(1);
+	}
+	freeaddrinfo(addr);
+
+	sent_at = calloc(count, sizeof(double));
+	if (sent_at == NULL)
+	{
+		perror("calloc");
+		return(1);
+	}
+
+	/**
+	 * Keep up to 'window' requests waiting; a lost reply only holds things
+	 * up for the timeout, after which whatever is still waiting is lost.
+	 */
+	start = now_ms();
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (1)
+	{
+		while ((next < count) && (next - replies < window))
+		{
+			put32(&request[4], next);
+			sent_at[next] = now_ms();
+			if (send(fd, request, length, 0) < 0)
+			{
+				perror("send");
+				return(1);
+			}
+			next++;
+		}
+		if ((replies == count) || (poll(&pfd, 1, timeout) <= 0))
+		{
+			break;
+		}
+
+		got = recv(fd, reply, sizeof(reply), 0);
+		if ((got != CTL_REPLY_LEN) || (get16(&reply[0]) != CTL_MAGIC))
+		{
+			// Not a reply, or an error such as the port being refused.
+			if (got < 0)
+			{
+				perror("recv");
+				return(1);
+			}
+			continue;
+		}
+		seq = get32(&reply[4]);
+		if ((seq >= next) || (sent_at[seq] == 0))
+		{
+			continue;
+		}
+		rtt = now_ms() - sent_at[seq];
+		sent_at[seq] = 0;
+
+		if ((replies == 0) || (rtt < rtt_min))
+		{
+			rtt_min = rtt;
+		}
+		if (rtt > rtt_max)
+		{
+			rtt_max = rtt;
+		}
+		rtt_total += rtt;
+		replies++;
+		if (reply[3] != CTL_OK)
+		{
+			failed++;
+		}
+		memcpy(last, reply, sizeof(last));
+		if (!quiet)
+		{
+			print_reply(reply, rtt);
+		}
+	}
+
+	if (replies > 0)
+	{
+		print_status(last);
+	}
+	if (count > 1)
+	{
+		printf("%lu requests, %lu replies (%lu refused), %lu lost\n",
+		    count, replies, failed, count - replies);
+		if (replies > 0)
+		{
+			printf("Round trip min/avg/max %.1f/%.1f/%.1f ms, "
+			    "%.1f replies/s\n", rtt_min, rtt_total / replies, rtt_max,
+			    replies * 1000.0 / (now_ms() - start));
+		}
+	}
+	free(sent_at);
+	return((replies == count) && (failed == 0) ? 0 : 2);
+}
@@ -0,0 +1,219 @@
+/*
+ *  Host test of the receiver's decoder (user/decode433.c) against what we
+ *  send ourselves.
+ *
+ *  Each transmission is built the way i2s_433.c builds it: a start frame
+ *  holding a frame marker, then the data frame I2S_FRAME_REPEATS times,
+ *  each the 32 bits, a closing frame marker and zero and LOW padding to
+ *  the frame's full length.  The 32 bit DMA words are turned into runs of
+ *  I2S samples and fed to decode433Sampled() as the receiver does, with
+ *  the line idle afterwards.  Every frame must be decoded, with the right
+ *  checksum status and counting up the repeats.
+ *
+ *  Prints each failure and exits non-zero if there are any; "make tools"
+ *  runs it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "portable.h"
+#include "decode433.h"
+#include "sensor433.h"
+#include "driver/i2s_433.h"
+
+/**
+ * As in i2s_433.c; the longest data frame, which is that for 0xFFFFFFFF,
+ * has no padding.
+ */
+#define I2SDMABUFLEN  \
+    (1 + I2S_LOW_FRAME + 32 * (1 + I2S_LOW_VAL_MAX) + 1 + I2S_LOW_ZERO)
+
+#define IDLE_WORDS	((DECODE433_IDLE_US + I2S_UNIT_US - 1) / I2S_UNIT_US)
+#define MAX_WORDS	((1 + I2S_LOW_FRAME) + \
+			    (I2S_FRAME_REPEATS * I2SDMABUFLEN) + IDLE_WORDS)
+#define MAX_RESULTS	(2 * I2S_FRAME_REPEATS)
+
+typedef struct result
+{
+	uint32 payload;
+	DECODE433_STATUS status;
+	uint8 repeat;
+} RESULT;
+
+static uint32 words[MAX_WORDS];
+static int nwords;
+static RESULT results[MAX_RESULTS];
+static int nresults;
+static int failed;
+
+/**
+ * The I2S writes, a word of 32 samples each.
+ */
+static void write_i2s(int value_one)
+{
+	if (nwords < MAX_WORDS)
+	{
+		words[nwords++] = value_one ? 0xFFFFFFFF : 0;
+	}
+}
+
+static void write_433(int low_count)
+{
+	write_i2s(TRUE);
+	while (low_count--)
+	{
+		write_i2s(FALSE);
+	}
+}
+
+/**
+ * i2sInitSignal(), i2sDataValue() and i2sTermSignal().
+ */
+static void write_frame(uint32 payload)
+{
+	int start = nwords;
+	int ii;
+
+	for (ii = 31; ii >= 0; ii--)
+	{
+		write_433(((payload >> ii) & 1) ? I2S_LOW_ONE : I2S_LOW_ZERO);
+	}
+	write_433(I2S_LOW_FRAME);
+	write_433(I2S_LOW_ZERO);
+	while (nwords - start < I2SDMABUFLEN)
+	{
+		write_i2s(FALSE);
+	}
+}
+
+static void transmit(uint32 payload)
+{
+	int ii;
+
+	write_433(I2S_LOW_FRAME);
+	for (ii = 0; ii < I2S_FRAME_REPEATS; ii++)
+	{
+		write_frame(payload);
+	}
+	for (ii = 0; ii < IDLE_WORDS; ii++)
+	{
+		write_i2s(FALSE);
+	}
+}
+
+static void result(void *arg, const DECODE433_PROTOCOL *protocol,
+    uint32 payload, DECODE433_STATUS status, uint8 repeat)
+{
+	if (nresults < MAX_RESULTS)
+	{
+		results[nresults].payload = payload;
+		results[nresults].status = status;
+		results[nresults].repeat = repeat;
+	}
+	nresults++;
+}
+
+/**
+ * Feed the words to the decoder as runs of samples.
+ */
+static void receive(DECODE433 *decoder)
+{
+	uint8 level;
+	uint32 ticks;
+	int ii;
+
+	for (ii = 0; ii < nwords; ii += ticks / 32)
+	{
+		level = (words[ii] != 0);
+		for (ticks = 0; (ii + ticks / 32 < nwords) &&
+		    ((words[ii + ticks / 32] != 0) == level); ticks += 32)
+		{
+		}
+		decode433Sampled(decoder, level, ticks);
+	}
+}
+
+/**
+ * Send 'payload' twice, with the line idle in between, and check that each
+ * frame decodes to it with 'status'; the repeats start again after the
+ * idle.
+ */
+static void test(const char *name, uint32 payload, DECODE433_STATUS status)
+{
+	DECODE433 decoder;
+	int ii;
+
+	decode433Init(&decoder, sensor433_protocols, sensor433_protocol_count,
+	    result, NULL);
+	nresults = 0;
+	nwords = 0;
+	transmit(payload);
+	receive(&decoder);
+	nwords = 0;
+	transmit(payload);
+	receive(&decoder);
+
+	if (nresults != 2 * I2S_FRAME_REPEATS)
+	{
+		printf("%s (0x%08x): %d payloads, expected %d\n", name,
+		    (unsigned)payload, nresults, 2 * I2S_FRAME_REPEATS);
+		failed++;
+		return;
+	}
+	for (ii = 0; ii < nresults; ii++)
+	{
+		if ((results[ii].payload != payload) ||
+		    (results[ii].status != status) ||
+		    (results[ii].repeat != ii % I2S_FRAME_REPEATS))
+		{
+			printf("%s (0x%08x): payload %d is 0x%08x, status %d, "
+			    "repeat %d\n", name, (unsigned)payload, ii,
+			    (unsigned)results[ii].payload, results[ii].status,
+			    results[ii].repeat);
+			failed++;
+			return;
+		}
+	}
+}
+
+/**
+ * A sensor reading with its checksum.
+ */
+static uint32 reading(sint32 temp)
+{
+	uint32 payload = CFG_433_SENDER | CFG_433_BATTERY_OK |
+	    (((uint32)temp << CFG_TEMP_SHIFT) & CFG_TEMP_MASK);
+
+	add_433_checksum(&payload);
+	return(payload);
+}
+
+/**
+ * The checksum status that an arbitrary payload should have.
+ */
+static DECODE433_STATUS status_of(uint32 payload)
+{
+	return(check_433_checksum(payload) ? DECODE433_OK : DECODE433_BAD_CHECK);
+}
+
+int main(int argc, char *argv[])
+{
+	test("21.5C", reading(215), DECODE433_OK);
+	test("-0.5C", reading(-5), DECODE433_OK);
+	test("0C", reading(0), DECODE433_OK);
+	test("bad checksum", reading(215) ^ 0x01, DECODE433_BAD_CHECK);
+
+	// The fewer the zeros the less padding; none has none at all.
+	test("no zeros", 0xFFFFFFFF, status_of(0xFFFFFFFF));
+	test("one zero", 0xFFFFFFFE, status_of(0xFFFFFFFE));
+	test("two zeros", 0x7FFFFFFE, status_of(0x7FFFFFFE));
+	test("three zeros", 0x7FFF7FFE, status_of(0x7FFF7FFE));
+	test("all zeros", 0x00000000, status_of(0x00000000));
+
+	if (failed != 0)
+	{
+		printf("decode433: %d failed\n", failed);
+		return(1);
+	}
+	return(0);
+}
@@ -0,0 +1,198 @@
+/*
+ *  Host test of the receiver's edge extraction (user/edge433.c).
+ *
+ *  Each case is a signal given as runs of a level, which is sampled into
+ *  32-bit words the way the I2S receiver does, most significant bit first,
+ *  and fed to the scanner in DMA blocks of several sizes so that runs span
+ *  blocks.  The runs reported must be the same whatever the block size and
+ *  match those expected, with glitches merged into the run before them and
+ *  an idle line reported once as a run of about idle_ticks.
+ *
+ *  Prints each failure and exits non-zero if there are any; "make tools"
+ *  runs it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "portable.h"
+#include "edge433.h"
+
+#define GLITCH_TICKS	8
+#define IDLE_TICKS	320
+#define MAX_WORDS	128
+#define MAX_RUNS	32
+
+typedef struct run
+{
+	uint8 level;
+	uint32 ticks;
+} RUN;
+
+typedef struct test_case
+{
+	const char *name;
+	RUN signal[MAX_RUNS];
+	RUN expected[MAX_RUNS];
+	int flush;
+} TEST_CASE;
+
+/**
+ * Idle runs are reported at the end of the first word in which they reach
+ * IDLE_TICKS, so their length depends on where they start.  Runs of 0
+ * ticks end each list.
+ */
+static const TEST_CASE cases[] =
+{
+	{
+		"clean",
+		{ {0, 100}, {1, 40}, {0, 70}, {1, 33}, {0, 1000}, {1, 50}, {0, 400},
+		    {0, 0} },
+		// Idle from 243 and 1293.
+		{ {1, 40}, {0, 70}, {1, 33}, {0, 333}, {1, 50}, {0, 339}, {0, 0} },
+		0
+	},
+	{
+		"glitches",
+		{ {0, 64}, {1, 40}, {0, 3}, {1, 40}, {0, 50}, {1, 2}, {0, 50},
+		    {1, 30}, {0, 7}, {1, 8}, {0, 600}, {0, 0} },
+		// Idle from 294.
+		{ {1, 83}, {0, 102}, {1, 45}, {0, 346}, {0, 0} },
+		0
+	},
+	{
+		"flush",
+		{ {0, 32}, {1, 100}, {0, 60}, {1, 20}, {0, 0} },
+		// The last run has not ended so is not reported.
+		{ {1, 100}, {0, 60}, {0, 0} },
+		1
+	},
+	{
+		"stuck high",
+		{ {0, 32}, {1, 500}, {0, 40}, {1, 40}, {0, 0} },
+		// Idle from 32.
+		{ {1, 320}, {0, 40}, {0, 0} },
+		1
+	},
+};
+
+#define CASE_COUNT	(sizeof(cases) / sizeof(cases[0]))
+
+static const int block_sizes[] = { 1, 3, 5, MAX_WORDS };
+
+#define BLOCK_SIZE_COUNT	(sizeof(block_sizes) / sizeof(block_sizes[0]))
+
+static RUN reported[MAX_RUNS];
+static int reported_count;
+
+static void sink(void *arg, uint8 level, uint32 ticks)
+{
+	if (reported_count < MAX_RUNS)
+	{
+		reported[reported_count].level = level;
+		reported[reported_count].ticks = ticks;
+	}
+	reported_count++;
+}
+
+/**
+ * Sample the runs into words, padding the last word with the last level.
+ */
+static int sample(const RUN *signal, uint32 *words)
+{
+	uint32 bit = 0;
+	uint8 level = 0;
+	uint32 ii;
+
+	memset(words, 0, MAX_WORDS * sizeof(uint32));
+	for (; signal->ticks != 0; signal++)
+	{
+		level = signal->level;
+		for (ii = 0; ii < signal->ticks; ii++, bit++)
+		{
+			if (level)
+			{
+				words[bit / 32] |= 0x80000000 >> (bit % 32);
+			}
+		}
+	}
+	for (; (bit % 32) != 0; bit++)
+	{
+		if (level)
+		{
+			words[bit / 32] |= 0x80000000 >> (bit % 32);
+		}
+	}
+	return(bit / 32);
+}
+
+static int run_case(const TEST_CASE *test, int block_size)
+{
+	EDGE433_SCANNER scanner;
+	uint32 words[MAX_WORDS];
+	int count;
+	int expected_count;
+	int done;
+	int ii;
+
+	count = sample(test->signal, words);
+	reported_count = 0;
+	edge433Init(&scanner, GLITCH_TICKS, IDLE_TICKS, sink, NULL);
+	for (done = 0; done < count; done += block_size)
+	{
+		edge433Scan(&scanner, &words[done],
+		    (count - done < block_size) ? count - done : block_size);
+	}
+	if (test->flush)
+	{
+		edge433Flush(&scanner);
+	}
+
+	for (expected_count = 0; test->expected[expected_count].ticks != 0;
+	    expected_count++)
+	{
+	}
+	for (ii = 0; (ii < expected_count) && (ii < reported_count); ii++)
+	{
+		if ((reported[ii].level != test->expected[ii].level) ||
+		    (reported[ii].ticks != test->expected[ii].ticks))
+		{
+			printf("%s, blocks of %d: run %d is %d for %u, expected %d "
+			    "for %u\n", test->name, block_size, ii, reported[ii].level,
+			    reported[ii].ticks, test->expected[ii].level,
+			    test->expected[ii].ticks);
+			return(0);
+		}
+	}
+	if (reported_count != expected_count)
+	{
+		printf("%s, blocks of %d: %d runs, expected %d\n", test->name,
+		    block_size, reported_count, expected_count);
+		return(0);
+	}
+	return(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int failed = 0;
+	int ii;
+	int jj;
+
+	for (ii = 0; ii < CASE_COUNT; ii++)
+	{
+		for (jj = 0; jj < BLOCK_SIZE_COUNT; jj++)
+		{
+			if (!run_case(&cases[ii], block_sizes[jj]))
+			{
+				failed++;
+			}
+		}
+	}
+	if (failed != 0)
+	{
+		printf("edge433: %d of %d failed\n", failed,
+		    (int)(CASE_COUNT * BLOCK_SIZE_COUNT));
+		return(1);
+	}
+	return(0);
+}
@@ -0,0 +1,13 @@
+/**
+ * Just enough of the SDK for the host tests to build firmware modules that
+ * touch the hardware; each test provides the functions itself, faking the
+ * hardware.  The types come from portable.h.
+ */
+#ifndef ETS_SYS_H
+#define ETS_SYS_H
+
+#include "portable.h"
+
+#define ICACHE_RODATA_ATTR
+
+#endif
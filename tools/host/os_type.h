@@ -0,0 +1,9 @@
+/**
+ * See ets_sys.h.
+ */
+#ifndef OS_TYPE_H
+#define OS_TYPE_H
+
+#include "ets_sys.h"
+
+#endif
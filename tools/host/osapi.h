@@ -0,0 +1,12 @@
+/**
+ * See ets_sys.h.
+ */
+#ifndef OSAPI_H
+#define OSAPI_H
+
+#include <stdio.h>
+#include "ets_sys.h"
+
+#define os_printf	printf
+
+#endif
@@ -0,0 +1,40 @@
+/**
+ * See ets_sys.h.  Only the RTC and reset functions.
+ */
+#ifndef USER_INTERFACE_H
+#define USER_INTERFACE_H
+
+#include "ets_sys.h"
+
+enum rst_reason
+{
+	REASON_DEFAULT_RST = 0,
+	REASON_WDT_RST,
+	REASON_EXCEPTION_RST,
+	REASON_SOFT_WDT_RST,
+	REASON_SOFT_RESTART,
+	REASON_DEEP_SLEEP_AWAKE,
+	REASON_EXT_SYS_RST
+};
+
+struct rst_info
+{
+	uint32 reason;
+	uint32 exccause;
+	uint32 epc1;
+	uint32 epc2;
+	uint32 epc3;
+	uint32 excvaddr;
+	uint32 depc;
+};
+
+struct rst_info *system_get_rst_info(void);
+uint32 system_get_rtc_time(void);
+uint32 system_rtc_clock_cali_proc(void);
+bool system_rtc_mem_read(uint8 src_addr, void *des_addr, uint16 load_size);
+bool system_rtc_mem_write(uint8 des_addr, const void *src_addr,
+    uint16 save_size);
+bool system_deep_sleep_set_option(uint8 option);
+void system_deep_sleep(uint32 time_in_us);
+
+#endif
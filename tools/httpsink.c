@@ -0,0 +1,248 @@
+/*
+ *  Host tool that stands in for the HTTP server that readings are uploaded
+ *  to (see user/http.h), for testing the upload without the real one.
+ *
+ *  It listens on a port, prints each request line and body with the number
+ *  of the connection and of the request on it, so that keep-alive and
+ *  pipelining can be seen, and answers every request with the given status.
+ *  For example, with CFG_HTTP_HOST set to this machine and CFG_HTTP_PORT
+ *  to 8080:
+ *
+ *    httpsink -p 8080
+ *
+ *  -s gives the status to answer with, -c closes the connection after each
+ *  response and -n leaves out the Content-Length, which also means closing
+ *  it, to try the firmware's handling of those.  Build with "make tools".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define HEADER_MAX		4096
+
+static int status = 200;
+static int close_each = 0;
+static int no_length = 0;
+
+/**
+ * Read up to the end of the headers, leaving anything after them in
+ * 'buffer' and its length in '*extra'.  The headers are NUL terminated.
+ */
+static int read_headers(int fd, char *buffer, int *have, int *extra)
+{
+	char *end;
+	int got;
+
+	while (1)
+	{
+		buffer[*have] = '\0';
+		end = strstr(buffer, "\r\n\r\n");
+		if (end != NULL)
+		{
+			end += 4;
+			*extra = *have - (int)(end - buffer);
+			return((int)(end - buffer));
+		}
+		if (*have >= HEADER_MAX)
+		{
+			fprintf(stderr, "headers too long\n");
+			return(-1);
+		}
+		got = read(fd, &buffer[*have], HEADER_MAX - *have);
+		if (got <= 0)
+		{
+			return(-1);
+		}
+		*have += got;
+	}
+}
+
+static long content_length(const char *headers)
+{
+	const char *line = headers;
+
+	while ((line = strstr(line, "\r\n")) != NULL)
+	{
+		line += 2;
+		if (strncasecmp(line, "Content-Length:", 15) == 0)
+		{
+			return(strtol(line + 15, NULL, 10));
+		}
+	}
+	return(0);
+}
+
+/**
+ * Serve requests on one connection until either end closes it.
+ */
+static void serve(int fd, unsigned long conn)
+{
+	char buffer[HEADER_MAX + 1];
+	char reply[256];
+	char stamp[32];
+	char first[512];
+	char *body;
+	unsigned long request = 0;
+	int have = 0;
+	int head;
+	int extra;
+	int got;
+	long length;
+	time_t now;
+
+	while ((head = read_headers(fd, buffer, &have, &extra)) > 0)
+	{
+		snprintf(first, sizeof(first), "%.*s",
+		    (int)strcspn(buffer, "\r\n"), buffer);
+		length = content_length(buffer);
+		body = malloc(length + 1);
+		if (body == NULL)
+		{
+			return;
+		}
+		if (extra > length)
+		{
+			extra = (int)length;
+		}
+		memcpy(body, &buffer[head], extra);
+		while (extra < length)
+		{
+			got = read(fd, &body[extra], length - extra);
+			if (got <= 0)
+			{
+				free(body);
+				return;
+			}
+			extra += got;
+		}
+		body[length] = '\0';
+
+		// Anything after the body is the start of the next request.
+		have -= head + (int)length;
+		if (have > 0)
+		{
+			memmove(buffer, &buffer[head + length], have);
+		}
+		else
+		{
+			have = 0;
+		}
+
+		now = time(NULL);
+		strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&now));
+		printf("%s conn %lu request %lu: %s, %ld bytes\n%s", stamp, conn,
+		    ++request, first, length, body);
+		if ((length > 0) && (body[length - 1] != '\n'))
+		{
+			printf("\n");
+		}
+		fflush(stdout);
+		free(body);
+
+		if (no_length)
+		{
+			snprintf(reply, sizeof(reply),
+			    "HTTP/1.1 %d Sink\r\nConnection: close\r\n\r\nsuccess\n",
+			    status);
+		}
+		else
+		{
+			snprintf(reply, sizeof(reply),
+			    "HTTP/1.1 %d Sink\r\nContent-Length: 8\r\n%s\r\nsuccess\n",
+			    status, close_each ? "Connection: close\r\n" : "");
+		}
+		if (write(fd, reply, strlen(reply)) < 0)
+		{
+			return;
+		}
+		if (close_each || no_length)
+		{
+			return;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in addr;
+	struct sockaddr_in peer;
+	socklen_t peer_len;
+	unsigned long conn = 0;
+	int port = 8080;
+	int listener;
+	int fd;
+	int opt;
+	int on = 1;
+
+	while ((opt = getopt(argc, argv, "p:s:cn")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 's':
+			status = atoi(optarg);
+			break;
+		case 'c':
+			close_each = 1;
+			break;
+		case 'n':
+			no_length = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p port] [-s status] [-c] [-n]\n",
+			    argv[0]);
+			return(1);
+		}
+	}
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		perror("socket");
+		return(1);
+	}
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if ((bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+	    (listen(listener, 4) < 0))
+	{
+		perror("bind");
+		return(1);
+	}
+	printf("Listening on port %d\n", port);
+	fflush(stdout);
+
+	/**
+	 * The firmware only ever has the one connection open.
+	 */
+	while (1)
+	{
+		peer_len = sizeof(peer);
+		fd = accept(listener, (struct sockaddr *)&peer, &peer_len);
+		if (fd < 0)
+		{
+			perror("accept");
+			continue;
+		}
+		printf("conn %lu from %s\n", ++conn, inet_ntoa(peer.sin_addr));
+		fflush(stdout);
+		serve(fd, conn);
+		close(fd);
+		printf("conn %lu closed\n", conn);
+		fflush(stdout);
+	}
+	return(0);
+}
@@ -0,0 +1,659 @@
+/*
+ *  Host tool that reports where the firmware's memory goes, from the
+ *  linker map and the symbol sizes of the linked ELF:
+ *
+ *  - the size of each output section and of the memory regions they are
+ *    loaded into; .data, .rodata and .bss all come out of the 80KB of DRAM
+ *    that is otherwise heap, .text is IRAM and .irom0.text is flash
+ *  - each object file's share of every section
+ *  - the biggest symbols in each region
+ *
+ *  With "-b <budget>" it fails if any budget is exceeded; with
+ *  "-d <baseline>" it lists what has changed since the baseline, which is
+ *  saved with "-w <baseline>".  Budget and baseline files have one
+ *  "<key> <bytes>" per line, '#' starts a comment, and the keys are
+ *  sections (".bss"), regions ("dram"), or an object's share of either
+ *  ("syslog.o:.bss", "syslog.o:dram").  "make memreport" runs it as:
+ *
+ *    xtensa-lx106-elf-nm -S --size-sort app.out > app.sym
+ *    memreport -b tools/memory.budget -d tools/memory.baseline \
+ *        app.map app.sym
+ *
+ *  Build with "make tools".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "portable.h"
+
+#define MAX_LINE	1024
+#define MAX_OBJECTS	1024
+#define MAX_SYMBOLS	4096
+#define MAX_KEYS	4096
+#define NAME_LEN	96
+#define TOP_SYMBOLS	15
+
+/**
+ * The output sections we account for and the regions they occupy.
+ */
+enum
+{
+	SEC_DATA,
+	SEC_RODATA,
+	SEC_BSS,
+	SEC_TEXT,
+	SEC_IROM,
+	SEC_COUNT
+};
+
+static const char *section_names[SEC_COUNT] =
+{
+	".data", ".rodata", ".bss", ".text", ".irom0.text"
+};
+
+enum
+{
+	REGION_DRAM,
+	REGION_IRAM,
+	REGION_FLASH,
+	REGION_COUNT
+};
+
+static const char *region_names[REGION_COUNT] =
+{
+	"dram", "iram", "flash"
+};
+
+static const int section_region[SEC_COUNT] =
+{
+	REGION_DRAM, REGION_DRAM, REGION_DRAM, REGION_IRAM, REGION_FLASH
+};
+
+typedef struct object
+{
+	char name[NAME_LEN];
+	unsigned long size[SEC_COUNT];
+} OBJECT;
+
+typedef struct symbol
+{
+	char name[NAME_LEN];
+	unsigned long size;
+	int region;
+} SYMBOL;
+
+typedef struct key
+{
+	char name[NAME_LEN * 2];
+	unsigned long value;
+	int seen;
+} KEY;
+
+static OBJECT objects[MAX_OBJECTS];
+static int object_count = 0;
+static unsigned long section_size[SEC_COUNT];
+static SYMBOL symbols[MAX_SYMBOLS];
+static int symbol_count = 0;
+static KEY keys[MAX_KEYS];
+static int key_count = 0;
+
+static unsigned long region_total(const unsigned long *size, int region)
+{
+	unsigned long total = 0;
+	int ii;
+
+	for (ii = 0; ii < SEC_COUNT; ii++)
+	{
+		if (section_region[ii] == region)
+		{
+			total += size[ii];
+		}
+	}
+	return(total);
+}
+
+/**
+ * "build/app_app.a(syslog.o)" is just "syslog.o"; objects from the SDK's
+ * libraries keep the library name, "libmain.a(app_main.o)".
+ */
+static void object_name(const char *file, char *name)
+{
+	const char *base;
+	const char *paren = strchr(file, '(');
+	const char *end;
+
+	end = (paren != NULL) ? paren : file + strlen(file);
+	for (base = end; (base > file) && (base[-1] != '/') && (base[-1] != '\\');
+	    base--)
+	{
+	}
+
+	if ((paren != NULL) && (strncmp(base, "lib", 3) != 0))
+	{
+		base = paren + 1;
+	}
+	snprintf(name, NAME_LEN, "%s", base);
+	if ((paren != NULL) && (base == paren + 1))
+	{
+		name[strcspn(name, ")")] = '\0';
+	}
+}
+
+static OBJECT *find_object(const char *file)
+{
+	char name[NAME_LEN];
+	int ii;
+
+	object_name(file, name);
+	for (ii = 0; ii < object_count; ii++)
+	{
+		if (strcmp(objects[ii].name, name) == 0)
+		{
+			return(&objects[ii]);
+		}
+	}
+	if (object_count >= MAX_OBJECTS)
+	{
+		return(NULL);
+	}
+	snprintf(objects[object_count].name, NAME_LEN, "%s", name);
+	return(&objects[object_count++]);
+}
+
+static int is_hex(const char *token)
+{
+	return(strncmp(token, "0x", 2) == 0);
+}
+
+/**
+ * Add up the input sections in the map.  Inside an output section each
+ * input section is " <name> <address> <size> <file>", with a long name on
+ * a line of its own; padding is "*fill*" with no file.
+ */
+static int read_map(const char *path)
+{
+	FILE *map = fopen(path, "r");
+	char line[MAX_LINE];
+	char pending[MAX_LINE] = "";
+	char *token[5];
+	int tokens;
+	int section = -1;
+	int started = 0;
+	OBJECT *object;
+	unsigned long size;
+	int ii;
+
+	if (map == NULL)
+	{
+		perror(path);
+		return(-1);
+	}
+
+	while (fgets(line, sizeof(line), map) != NULL)
+	{
+		if (!started)
+		{
+			started = (strncmp(line, "Linker script and memory map", 28) == 0);
+			continue;
+		}
+
+		if ((line[0] != ' ') && (line[0] != '\t') && (line[0] != '\n'))
+		{
+			// The start of an output section.
+			section = -1;
+			pending[0] = '\0';
+			for (ii = 0; ii < SEC_COUNT; ii++)
+			{
+				if ((strncmp(line, section_names[ii],
+				        strlen(section_names[ii])) == 0) &&
+				    (strchr(" \t\n", line[strlen(section_names[ii])]) != NULL))
+				{
+					section = ii;
+				}
+			}
+			continue;
+		}
+		if (section < 0)
+		{
+			continue;
+		}
+
+		tokens = 0;
+		token[tokens] = strtok(line, " \t\n");
+		while ((token[tokens] != NULL) && (tokens < 4))
+		{
+			token[++tokens] = strtok(NULL, " \t\n");
+		}
+
+		if ((tokens == 1) && (!is_hex(token[0])))
+		{
+			// A long input section name; the rest is on the next line.
+			snprintf(pending, sizeof(pending), "%s", token[0]);
+			continue;
+		}
+		if ((pending[0] != '\0') && (tokens >= 3) && is_hex(token[0]) &&
+		    is_hex(token[1]))
+		{
+			size = strtoul(token[1], NULL, 16);
+			object = find_object(token[2]);
+			pending[0] = '\0';
+		}
+		else if ((tokens >= 3) && (!is_hex(token[0])) && is_hex(token[1]) &&
+		    is_hex(token[2]))
+		{
+			size = strtoul(token[2], NULL, 16);
+			object = find_object(((tokens >= 4) &&
+			    (strcmp(token[0], "*fill*") != 0)) ? token[3] : "*fill*");
+			pending[0] = '\0';
+		}
+		else
+		{
+			// A symbol, an assignment or a line of the linker script.
+			pending[0] = '\0';
+			continue;
+		}
+
+		section_size[section] += size;
+		if (object != NULL)
+		{
+			object->size[section] += size;
+		}
+	}
+	fclose(map);
+
+	if (!started)
+	{
+		fprintf(stderr, "%s: not a linker map\n", path);
+		return(-1);
+	}
+	return(0);
+}
+
+/**
+ * Read "nm -S" output, "<address> <size> <type> <name>", placing each
+ * symbol in a region by its address.
+ */
+static int read_symbols(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	char line[MAX_LINE];
+	char name[NAME_LEN];
+	char type;
+	unsigned long address;
+	unsigned long size;
+	int region;
+
+	if (file == NULL)
+	{
+		perror(path);
+		return(-1);
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (sscanf(line, "%lx %lx %c %95s", &address, &size, &type, name) != 4)
+		{
+			continue;
+		}
+		if ((address >= 0x3FFE8000) && (address < 0x40000000))
+		{
+			region = REGION_DRAM;
+		}
+		else if ((address >= 0x40100000) && (address < 0x40110000))
+		{
+			region = REGION_IRAM;
+		}
+		else if ((address >= 0x40200000) && (address < 0x40600000))
+		{
+			region = REGION_FLASH;
+		}
+		else
+		{
+			continue;
+		}
+
+		if (symbol_count < MAX_SYMBOLS)
+		{
+			snprintf(symbols[symbol_count].name, NAME_LEN, "%s", name);
+			symbols[symbol_count].size = size;
+			symbols[symbol_count].region = region;
+			symbol_count++;
+		}
+	}
+	fclose(file);
+	return(0);
+}
+
+static int by_dram(const void *a, const void *b)
+{
+	unsigned long sa = region_total(((const OBJECT *)a)->size, REGION_DRAM);
+	unsigned long sb = region_total(((const OBJECT *)b)->size, REGION_DRAM);
+
+	if (sa != sb)
+	{
+		return((sa < sb) ? 1 : -1);
+	}
+	return(strcmp(((const OBJECT *)a)->name, ((const OBJECT *)b)->name));
+}
+
+static int by_size(const void *a, const void *b)
+{
+	unsigned long sa = ((const SYMBOL *)a)->size;
+	unsigned long sb = ((const SYMBOL *)b)->size;
+
+	return((sa < sb) ? 1 : (sa > sb) ? -1 : 0);
+}
+
+/**
+ * The value of every key that budgets and baselines can refer to.
+ */
+static void add_key(const char *name, unsigned long value)
+{
+	if (key_count < MAX_KEYS)
+	{
+		snprintf(keys[key_count].name, sizeof(keys[0].name), "%s", name);
+		keys[key_count].value = value;
+		keys[key_count].seen = 0;
+		key_count++;
+	}
+}
+
+static void make_keys(void)
+{
+	char name[NAME_LEN * 2];
+	int ii;
+	int jj;
+
+	for (ii = 0; ii < SEC_COUNT; ii++)
+	{
+		add_key(section_names[ii], section_size[ii]);
+	}
+	for (ii = 0; ii < REGION_COUNT; ii++)
+	{
+		add_key(region_names[ii], region_total(section_size, ii));
+	}
+	for (ii = 0; ii < object_count; ii++)
+	{
+		for (jj = 0; jj < SEC_COUNT; jj++)
+		{
+			if (objects[ii].size[jj] != 0)
+			{
+				snprintf(name, sizeof(name), "%.*s:%s", NAME_LEN,
+				    objects[ii].name, section_names[jj]);
+				add_key(name, objects[ii].size[jj]);
+			}
+		}
+		for (jj = 0; jj < REGION_COUNT; jj++)
+		{
+			if (region_total(objects[ii].size, jj) != 0)
+			{
+				snprintf(name, sizeof(name), "%.*s:%s", NAME_LEN,
+				    objects[ii].name, region_names[jj]);
+				add_key(name, region_total(objects[ii].size, jj));
+			}
+		}
+	}
+}
+
+static KEY *find_key(const char *name)
+{
+	int ii;
+
+	for (ii = 0; ii < key_count; ii++)
+	{
+		if (strcmp(keys[ii].name, name) == 0)
+		{
+			return(&keys[ii]);
+		}
+	}
+	return(NULL);
+}
+
+/**
+ * Read the next "<key> <bytes>" from a budget or baseline file.
+ */
+static int read_entry(FILE *file, char *name, unsigned long *value)
+{
+	char line[MAX_LINE];
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		line[strcspn(line, "#")] = '\0';
+		if (sscanf(line, "%191s %lu", name, value) == 2)
+		{
+			return(1);
+		}
+	}
+	return(0);
+}
+
+static void report(void)
+{
+	unsigned long total[REGION_COUNT];
+	int shown;
+	int ii;
+	int jj;
+
+	printf("%-12s %8s\n", "Section", "Bytes");
+	for (ii = 0; ii < SEC_COUNT; ii++)
+	{
+		printf("%-12s %8lu  (%s)\n", section_names[ii], section_size[ii],
+		    region_names[section_region[ii]]);
+	}
+	for (ii = 0; ii < REGION_COUNT; ii++)
+	{
+		total[ii] = region_total(section_size, ii);
+		printf("%-12s %8lu\n", region_names[ii], total[ii]);
+	}
+
+	qsort(objects, object_count, sizeof(objects[0]), by_dram);
+	printf("\n%-32s", "Object");
+	for (ii = 0; ii < SEC_COUNT; ii++)
+	{
+		printf(" %11s", section_names[ii]);
+	}
+	printf("\n");
+	for (ii = 0; ii < object_count; ii++)
+	{
+		printf("%-32s", objects[ii].name);
+		for (jj = 0; jj < SEC_COUNT; jj++)
+		{
+			printf(" %11lu", objects[ii].size[jj]);
+		}
+		printf("\n");
+	}
+
+	if (symbol_count == 0)
+	{
+		return;
+	}
+	qsort(symbols, symbol_count, sizeof(symbols[0]), by_size);
+	for (ii = 0; ii < REGION_COUNT; ii++)
+	{
+		printf("\nLargest %s symbols\n", region_names[ii]);
+		shown = 0;
+		for (jj = 0; (jj < symbol_count) && (shown < TOP_SYMBOLS); jj++)
+		{
+			if (symbols[jj].region == ii)
+			{
+				printf("  %-40s %8lu\n", symbols[jj].name, symbols[jj].size);
+				shown++;
+			}
+		}
+	}
+}
+
+/**
+ * Returns the number of budgets exceeded.
+ */
+static int check_budget(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	char name[NAME_LEN * 2];
+	unsigned long budget;
+	KEY *key;
+	int over = 0;
+
+	if (file == NULL)
+	{
+		perror(path);
+		return(1);
+	}
+
+	printf("\nBudgets (%s)\n", path);
+	while (read_entry(file, name, &budget))
+	{
+		key = find_key(name);
+		if (key == NULL)
+		{
+			// Sections and objects that are not linked in use nothing.
+			printf("  %-32s %8s of %8lu\n", name, "-", budget);
+			continue;
+		}
+		printf("  %-32s %8lu of %8lu%s\n", name, key->value, budget,
+		    (key->value > budget) ? "  ** OVER **" : "");
+		if (key->value > budget)
+		{
+			over++;
+		}
+	}
+	fclose(file);
+	return(over);
+}
+
+static void diff_baseline(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	char name[NAME_LEN * 2];
+	unsigned long old;
+	KEY *key;
+	int changes = 0;
+	int ii;
+
+	if (file == NULL)
+	{
+		printf("\nNo baseline (%s); save one with \"make memreport-baseline\"\n",
+		    path);
+		return;
+	}
+
+	printf("\nChanges since the baseline (%s)\n", path);
+	while (read_entry(file, name, &old))
+	{
+		key = find_key(name);
+		if (key == NULL)
+		{
+			printf("  %-32s %8lu -> %8s\n", name, old, "gone");
+			changes++;
+			continue;
+		}
+		key->seen = 1;
+		if (key->value != old)
+		{
+			printf("  %-32s %8lu -> %8lu  %+ld\n", name, old, key->value,
+			    (long)key->value - (long)old);
+			changes++;
+		}
+	}
+	fclose(file);
+
+	for (ii = 0; ii < key_count; ii++)
+	{
+		if (!keys[ii].seen)
+		{
+			printf("  %-32s %8s -> %8lu\n", keys[ii].name, "new",
+			    keys[ii].value);
+			changes++;
+		}
+	}
+	if (changes == 0)
+	{
+		printf("  none\n");
+	}
+}
+
+static int write_baseline(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	int ii;
+
+	if (file == NULL)
+	{
+		perror(path);
+		return(-1);
+	}
+	fprintf(file, "# Memory baseline written by memreport; see tools/memreport.c\n");
+	for (ii = 0; ii < key_count; ii++)
+	{
+		fprintf(file, "%s %lu\n", keys[ii].name, keys[ii].value);
+	}
+	fclose(file);
+	printf("Baseline written to %s\n", path);
+	return(0);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *budget = NULL;
+	const char *baseline = NULL;
+	const char *save = NULL;
+	int arg = 1;
+	int over = 0;
+
+	while ((arg + 1 < argc) && (argv[arg][0] == '-'))
+	{
+		if (strcmp(argv[arg], "-b") == 0)
+		{
+			budget = argv[arg + 1];
+		}
+		else if (strcmp(argv[arg], "-d") == 0)
+		{
+			baseline = argv[arg + 1];
+		}
+		else if (strcmp(argv[arg], "-w") == 0)
+		{
+			save = argv[arg + 1];
+		}
+		else
+		{
+			break;
+		}
+		arg += 2;
+	}
+
+	if ((arg >= argc) || (argv[arg][0] == '-'))
+	{
+		fprintf(stderr, "usage: %s [-b budget] [-d baseline] [-w baseline] "
+		    "<map> [nm -S output]\n", argv[0]);
+		return(2);
+	}
+
+	if ((read_map(argv[arg]) < 0) ||
+	    ((arg + 1 < argc) && (read_symbols(argv[arg + 1]) < 0)))
+	{
+		return(2);
+	}
+	make_keys();
+
+	if (save != NULL)
+	{
+		return((write_baseline(save) < 0) ? 2 : 0);
+	}
+
+	report();
+	if (baseline != NULL)
+	{
+		diff_baseline(baseline);
+	}
+	if (budget != NULL)
+	{
+		over = check_budget(budget);
+		if (over != 0)
+		{
+			fprintf(stderr, "memreport: %d budget%s exceeded\n", over,
+			    (over == 1) ? "" : "s");
+		}
+	}
+	return((over != 0) ? 1 : 0);
+}
@@ -0,0 +1,162 @@
+/*
+ *  Host tool that turns a text pulse sequence into a flash image that
+ *  replay433_send() can stream, for long scripted test patterns and
+ *  playlists of several sensors.
+ *
+ *  The input is the same as for capture433, one pulse per line as
+ *  "<level> <duration in us>".  Pulses of the same level are merged, any
+ *  leading LOW is dropped and pulses too long for the 16 bit count are
+ *  split.  It fails, writing nothing, if the image is larger than the
+ *  CFG_CAPTURE_FLASH_COUNT sectors of the CFG_CAPTURE_FLASH_SECTOR area.
+ *  Write the image to a sector of that area, for example with:
+ *
+ *    mkseq433 7 seq.bin patterns.txt
+ *    esptool.py write_flash 0x20000 seq.bin
+ *
+ *  Build with "make tools".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "portable.h"
+#include "config.h"
+
+#define I2S_TICK_NS		12500
+#define REPLAY433_MAGIC		0x52343333
+#define SECTOR_SIZE		4096
+
+static FILE *output;
+static unsigned long count = 0;
+
+static void put32(uint32 value)
+{
+	fputc(value & 0xFF, output);
+	fputc((value >> 8) & 0xFF, output);
+	fputc((value >> 16) & 0xFF, output);
+	fputc((value >> 24) & 0xFF, output);
+}
+
+static void put16(uint32 value)
+{
+	fputc(value & 0xFF, output);
+	fputc((value >> 8) & 0xFF, output);
+	count++;
+}
+
+/**
+ * Write a pulse, splitting it with empty pulses of the other level if it is
+ * too long to count.
+ */
+static void put_pulse(uint32 ticks)
+{
+	while (ticks > 0xFFFF)
+	{
+		put16(0xFFFF);
+		put16(0);
+		ticks -= 0xFFFF;
+	}
+	put16(ticks);
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *input = stdin;
+	char buffer[128];
+	unsigned level;
+	unsigned long us;
+	int have = 0;
+	unsigned current = 0;
+	uint32 ticks = 0;
+	long size;
+
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <id> <output> [input]\n", argv[0]);
+		return(1);
+	}
+
+	output = fopen(argv[2], "wb");
+	if (output == NULL)
+	{
+		perror(argv[2]);
+		return(1);
+	}
+
+	if (argc > 3)
+	{
+		input = fopen(argv[3], "r");
+		if (input == NULL)
+		{
+			perror(argv[3]);
+			return(1);
+		}
+	}
+
+	/**
+	 * The count is filled in once we know it.
+	 */
+	put32(REPLAY433_MAGIC);
+	fputc(atoi(argv[1]) & 0xFF, output);
+	fputc((atoi(argv[1]) >> 8) & 0xFF, output);
+	fputc(0, output);
+	fputc(0, output);
+	put32(0);
+	put32(I2S_TICK_NS);
+
+	while (fgets(buffer, sizeof(buffer), input) != NULL)
+	{
+		if ((buffer[0] == '#') ||
+		    (sscanf(buffer, "%u %lu", &level, &us) != 2))
+		{
+			continue;
+		}
+		level = level ? 1 : 0;
+
+		if ((!have) && (!level))
+		{
+			continue;
+		}
+		if ((have) && (level != current))
+		{
+			put_pulse(ticks);
+			ticks = 0;
+		}
+		have = 1;
+		current = level;
+		ticks += (uint32)((((uint64)us * 1000) + (I2S_TICK_NS / 2)) /
+		    I2S_TICK_NS);
+	}
+	if (have)
+	{
+		put_pulse(ticks);
+	}
+
+	// Flash writes are whole words.
+	if (count & 1)
+	{
+		put16(0);
+		count--;
+	}
+	size = ftell(output);
+
+	fseek(output, 8, SEEK_SET);
+	put32(count);
+	fclose(output);
+
+	if (input != stdin)
+	{
+		fclose(input);
+	}
+
+	if (size > (long)CFG_CAPTURE_FLASH_COUNT * SECTOR_SIZE)
+	{
+		fprintf(stderr, "%lu pulses, %ld bytes, is more than the %d sectors "
+		    "of the capture area\n", count, size, CFG_CAPTURE_FLASH_COUNT);
+		remove(argv[2]);
+		return(1);
+	}
+
+	printf("%lu pulses, %ld bytes, %ld sectors\n", count, size,
+	    (size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	return(0);
+}
@@ -0,0 +1,341 @@
+/*
+ *  Host check of the syslog message catalog (user/msg.def).
+ *
+ *  Every structured data format must use as many conversions as its entry
+ *  says, and only those that the deferred packer knows (see syslog.c).
+ *  Then each syslog() call in the sources given must pass that many
+ *  arguments, counting IP2STR() as the four that it becomes, and each
+ *  syslog_isr() message must take no more than the two numbers that it
+ *  always passes.  A mismatch would otherwise have the packer read the
+ *  wrong arguments.
+ *
+ *    msgcheck433 user/syslog.c user/wifi.c ...
+ *
+ *  Prints each problem and exits non-zero if there are any; "make tools"
+ *  runs it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "portable.h"
+
+// As in the SDK's ip_addr.h.
+#ifndef IPSTR
+#define IPSTR "%d.%d.%d.%d"
+#endif
+
+#define ISR_ARGS	2
+
+typedef struct msg_entry
+{
+	const char *name;
+	int nargs;
+	const char *parms;
+} MSG_ENTRY;
+
+#define SMSG_DEF(id, app, prival, nargs, parms, msg) { #id, nargs, parms },
+static const MSG_ENTRY catalog[] =
+{
+#include "msg.def"
+};
+#undef SMSG_DEF
+
+#define CATALOG_SIZE	(sizeof(catalog) / sizeof(catalog[0]))
+
+static int errors = 0;
+
+/**
+ * Count the conversions in a format, not counting "%%", as syslog.c finds
+ * them.  -1 if one cannot be packed.  'strings' is set if any is "%s".
+ */
+static int conversions(const char *format, int *strings)
+{
+	const char *conv;
+	int count = 0;
+
+	*strings = 0;
+	while ((format = strchr(format, '%')) != NULL)
+	{
+		conv = format + 1;
+		while ((*conv != '\0') && (strchr("-+ #0123456789.lh", *conv) != NULL))
+		{
+			if ((conv[0] == 'l') && (conv[1] == 'l'))
+			{
+				// Only four bytes are packed.
+				return(-1);
+			}
+			conv++;
+		}
+		if (*conv == '%')
+		{
+			format = conv + 1;
+			continue;
+		}
+		if ((*conv == '\0') || (strchr("diuxXcs", *conv) == NULL))
+		{
+			return(-1);
+		}
+		if (*conv == 's')
+		{
+			*strings = 1;
+		}
+		count++;
+		format = conv + 1;
+	}
+	return(count);
+}
+
+static void check_catalog(void)
+{
+	int strings;
+	unsigned ii;
+
+	for (ii = 0; ii < CATALOG_SIZE; ii++)
+	{
+		if (conversions(catalog[ii].parms, &strings) != catalog[ii].nargs)
+		{
+			fprintf(stderr, "msg.def: %s has %d arguments but \"%s\"\n",
+			    catalog[ii].name, catalog[ii].nargs, catalog[ii].parms);
+			errors++;
+		}
+	}
+}
+
+static const MSG_ENTRY *find(const char *name, int len)
+{
+	unsigned ii;
+
+	for (ii = 0; ii < CATALOG_SIZE; ii++)
+	{
+		if ((strncmp(catalog[ii].name, name, len) == 0) &&
+		    (catalog[ii].name[len] == '\0'))
+		{
+			return(&catalog[ii]);
+		}
+	}
+	return(NULL);
+}
+
+static int is_ident(char c)
+{
+	return(isalnum((unsigned char)c) || (c == '_'));
+}
+
+/**
+ * Skip a comment or a string or character literal at 'p', if there is
+ * one.
+ */
+static const char *skip(const char *p)
+{
+	char quote;
+
+	if ((p[0] == '/') && (p[1] == '/'))
+	{
+		while ((*p != '\0') && (*p != '\n'))
+		{
+			p++;
+		}
+		return(p);
+	}
+	if ((p[0] == '/') && (p[1] == '*'))
+	{
+		p = strstr(p + 2, "*/");
+		return((p == NULL) ? "" : p + 2);
+	}
+	if ((*p == '"') || (*p == '\''))
+	{
+		quote = *p++;
+		while ((*p != '\0') && (*p != quote))
+		{
+			if ((*p == '\\') && (p[1] != '\0'))
+			{
+				p++;
+			}
+			p++;
+		}
+		return((*p == '\0') ? p : p + 1);
+	}
+	return(p);
+}
+
+/**
+ * The arguments after the message ID of the call whose ID ends at 'p',
+ * or -1 if the call does not end.
+ */
+static int count_args(const char *p)
+{
+	const char *next;
+	int depth = 0;
+	int count = 0;
+
+	while (*p != '\0')
+	{
+		next = skip(p);
+		if (next != p)
+		{
+			p = next;
+			continue;
+		}
+		if (*p == '(')
+		{
+			depth++;
+		}
+		else if (*p == ')')
+		{
+			if (depth == 0)
+			{
+				return(count);
+			}
+			depth--;
+		}
+		else if ((*p == ',') && (depth == 0))
+		{
+			p++;
+			while (isspace((unsigned char)*p))
+			{
+				p++;
+			}
+			count += (strncmp(p, "IP2STR(", 7) == 0) ? 4 : 1;
+			continue;
+		}
+		p++;
+	}
+	return(-1);
+}
+
+static int line_of(const char *text, const char *p)
+{
+	int line = 1;
+
+	while (text < p)
+	{
+		if (*text++ == '\n')
+		{
+			line++;
+		}
+	}
+	return(line);
+}
+
+static void check_call(const char *path, const char *text, const char *call,
+    int isr)
+{
+	const MSG_ENTRY *entry;
+	const char *id = call;
+	int len = 0;
+	int strings;
+	int nargs;
+
+	while (isspace((unsigned char)*id))
+	{
+		id++;
+	}
+	while (is_ident(id[len]))
+	{
+		len++;
+	}
+	if (strncmp(id, "SMSG_", 5) != 0)
+	{
+		// The definition or a message ID that is passed in.
+		return;
+	}
+	entry = find(id, len);
+	if (entry == NULL)
+	{
+		fprintf(stderr, "%s:%d: %.*s is not in msg.def\n",
+		    path, line_of(text, call), len, id);
+		errors++;
+		return;
+	}
+
+	if (isr)
+	{
+		conversions(entry->parms, &strings);
+		if ((entry->nargs > ISR_ARGS) || strings)
+		{
+			fprintf(stderr, "%s:%d: %s takes %d arguments but syslog_isr() "
+			    "passes %d numbers\n", path, line_of(text, call),
+			    entry->name, entry->nargs, ISR_ARGS);
+			errors++;
+		}
+		return;
+	}
+
+	nargs = count_args(id + len);
+	if (nargs != entry->nargs)
+	{
+		fprintf(stderr, "%s:%d: %s takes %d arguments but is given %d\n",
+		    path, line_of(text, call), entry->name, entry->nargs, nargs);
+		errors++;
+	}
+}
+
+static void check_source(const char *path)
+{
+	FILE *file;
+	char *text;
+	const char *p;
+	const char *next;
+	long size;
+
+	file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		perror(path);
+		errors++;
+		return;
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+	text = malloc(size + 1);
+	if ((text == NULL) || (fread(text, 1, size, file) != (size_t)size))
+	{
+		fprintf(stderr, "%s: cannot read\n", path);
+		errors++;
+		free(text);
+		fclose(file);
+		return;
+	}
+	text[size] = '\0';
+	fclose(file);
+
+	p = text;
+	while (*p != '\0')
+	{
+		next = skip(p);
+		if (next != p)
+		{
+			p = next;
+			continue;
+		}
+		if (((p == text) || !is_ident(p[-1])) &&
+		    (strncmp(p, "syslog", 6) == 0))
+		{
+			if (p[6] == '(')
+			{
+				check_call(path, text, p + 7, 0);
+			}
+			else if (strncmp(p + 6, "_isr(", 5) == 0)
+			{
+				check_call(path, text, p + 11, 1);
+			}
+		}
+		p++;
+	}
+	free(text);
+}
+
+int main(int argc, char *argv[])
+{
+	int ii;
+
+	check_catalog();
+	for (ii = 1; ii < argc; ii++)
+	{
+		check_source(argv[ii]);
+	}
+	return((errors == 0) ? 0 : 1);
+}
@@ -0,0 +1,286 @@
+/*
+ *  Host test of the state kept across resets (user/sleep.c).
+ *
+ *  RTC memory, the RTC counter and the flash sector are faked here (see
+ *  tools/host) so that the state can be saved, the device "reset" in each
+ *  of the ways it can be and the state restored, checking that what comes
+ *  back is what was saved and that the next send is due when it should be.
+ *
+ *  Prints each failure and exits non-zero if there are any; "make tools"
+ *  runs it.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "ets_sys.h"
+#include "user_interface.h"
+#include "spi_flash.h"
+#include "config.h"
+#include "sleep.h"
+
+/**
+ * The RTC clock period, in microseconds with 12 fractional bits, and the
+ * RTC counter.
+ */
+#define RTC_CALI		(5 << 12)
+#define RTC_TICKS(ms)		((ms) * 1000 / 5)
+
+typedef struct app_state
+{
+	uint32 payload;
+	uint32 interval;
+} APP_STATE;
+
+static uint32 rtc_mem[192];
+static uint32 rtc_ticks;
+static uint8 flash[SPI_FLASH_SEC_SIZE];
+static struct rst_info reset;
+static uint32 slept_us;
+static int failed;
+
+struct rst_info *system_get_rst_info(void)
+{
+	return(&reset);
+}
+
+uint32 system_get_rtc_time(void)
+{
+	return(rtc_ticks);
+}
+
+uint32 system_rtc_clock_cali_proc(void)
+{
+	return(RTC_CALI);
+}
+
+bool system_rtc_mem_read(uint8 src_addr, void *des_addr, uint16 load_size)
+{
+	memcpy(des_addr, &rtc_mem[src_addr], load_size);
+	return(TRUE);
+}
+
+bool system_rtc_mem_write(uint8 des_addr, const void *src_addr,
+    uint16 save_size)
+{
+	memcpy(&rtc_mem[des_addr], src_addr, save_size);
+	return(TRUE);
+}
+
+bool system_deep_sleep_set_option(uint8 option)
+{
+	return(TRUE);
+}
+
+void system_deep_sleep(uint32 time_in_us)
+{
+	slept_us = time_in_us;
+}
+
+/**
+ * Only the sleep state's sector exists.  Writes can only clear bits.
+ */
+static uint8 *flash_at(uint32 addr, uint32 size)
+{
+	uint32 base = CFG_SLEEP_FLASH_SECTOR * SPI_FLASH_SEC_SIZE;
+
+	if ((addr < base) || (addr + size > base + SPI_FLASH_SEC_SIZE))
+	{
+		printf("flash access at 0x%x outside the sector\n", addr);
+		failed++;
+		return(NULL);
+	}
+	return(&flash[addr - base]);
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec)
+{
+	if (sec != CFG_SLEEP_FLASH_SECTOR)
+	{
+		return(SPI_FLASH_RESULT_ERR);
+	}
+	memset(flash, 0xFF, sizeof(flash));
+	return(SPI_FLASH_RESULT_OK);
+}
+
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr,
+    uint32 size)
+{
+	uint8 *to = flash_at(des_addr, size);
+	uint8 *from = (uint8 *)src_addr;
+	uint32 ii;
+
+	if (to == NULL)
+	{
+		return(SPI_FLASH_RESULT_ERR);
+	}
+	for (ii = 0; ii < size; ii++)
+	{
+		to[ii] &= from[ii];
+	}
+	return(SPI_FLASH_RESULT_OK);
+}
+
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr,
+    uint32 size)
+{
+	uint8 *from = flash_at(src_addr, size);
+
+	if (from == NULL)
+	{
+		return(SPI_FLASH_RESULT_ERR);
+	}
+	memcpy(des_addr, from, size);
+	return(SPI_FLASH_RESULT_OK);
+}
+
+void console(int level, const char *fmt, ...)
+{
+}
+
+void syslog_flush(void)
+{
+}
+
+int spill_backlog(void)
+{
+	return(0);
+}
+
+static void check(const char *name, int ok, const char *what)
+{
+	if (!ok)
+	{
+		printf("%s: %s\n", name, what);
+		failed++;
+	}
+}
+
+/**
+ * Is the next send due in about 'ms'?  The RTC clock is converted in whole
+ * ticks, so allow one.
+ */
+static bool due_near(uint32 ms)
+{
+	uint32 due = sleep_due_ms();
+
+	return((due + 1 >= ms) && (due <= ms + 1));
+}
+
+/**
+ * Reset for 'reason' and restore into 'app', which starts zeroed.  A power
+ * cycle loses RTC memory, leaving rubbish, and the RTC counter.
+ */
+static bool boot(uint32 reason, APP_STATE *app)
+{
+	if (reason == REASON_DEFAULT_RST)
+	{
+		memset(rtc_mem, 0xA5, sizeof(rtc_mem));
+		rtc_ticks = 0;
+	}
+	memset(&reset, 0, sizeof(reset));
+	reset.reason = reason;
+	memset(app, 0, sizeof(*app));
+	return(sleep_setup(app, sizeof(*app)));
+}
+
+int main(int argc, char *argv[])
+{
+	APP_STATE app;
+	APP_STATE saved;
+	int ii;
+
+	memset(flash, 0xFF, sizeof(flash));
+
+	check("first boot", !boot(REASON_DEFAULT_RST, &app), "state found");
+
+	// The first save also goes to flash.
+	app.payload = 0x5a0c8123;
+	app.interval = 30000;
+	saved = app;
+	sleep_save();
+	check("soft restart", boot(REASON_SOFT_RESTART, &app), "no state");
+	check("soft restart", memcmp(&app, &saved, sizeof(app)) == 0,
+	    "wrong state");
+	check("soft restart", !sleep_woken(), "woken");
+
+	app.payload = 0x5a0c8124;
+	saved = app;
+	sleep_save();
+	check("exception", boot(REASON_EXCEPTION_RST, &app), "no state");
+	check("exception", memcmp(&app, &saved, sizeof(app)) == 0,
+	    "wrong state");
+
+	// Only from RTC memory; the flash copy is older.
+	rtc_mem[CFG_RTC_SLEEP + 1] ^= 1;
+	check("corrupt RTC", boot(REASON_SOFT_RESTART, &app), "no state");
+	check("corrupt RTC", app.payload == 0x5a0c8123, "not from flash");
+
+	app.payload = 0x5a0c8125;
+	saved = app;
+	sleep_save();
+	check("power cycle", boot(REASON_DEFAULT_RST, &app), "no state");
+	check("power cycle", app.payload == 0x5a0c8123, "not from flash");
+
+	// Enough saves to reach flash again.
+	app = saved;
+	for (ii = 0; ii < 10; ii++)
+	{
+		sleep_save();
+	}
+	check("flash", boot(REASON_DEFAULT_RST, &app), "no state");
+	check("flash", memcmp(&app, &saved, sizeof(app)) == 0, "wrong state");
+
+	app.payload = 0x5a0c8126;
+	saved = app;
+	sleep_schedule(30000);
+	sleep_now();
+	rtc_ticks += RTC_TICKS(slept_us / 1000);
+	check("deep sleep", boot(REASON_DEEP_SLEEP_AWAKE, &app), "no state");
+	check("deep sleep", memcmp(&app, &saved, sizeof(app)) == 0,
+	    "wrong state");
+	check("deep sleep", sleep_woken(), "not woken");
+	check("deep sleep deadline", (sleep_due_ms() > 0) &&
+	    due_near(150), "deadline moved");
+
+	// A watchdog or exception reset keeps to the deadline.
+	boot(REASON_DEFAULT_RST, &app);
+	app.payload = 0x5a0c8127;
+	saved = app;
+	sleep_schedule(30000);
+	sleep_save();
+	rtc_ticks += RTC_TICKS(10000);
+	boot(REASON_WDT_RST, &app);
+	check("watchdog deadline", due_near(20000), "deadline moved");
+	rtc_ticks += RTC_TICKS(5000);
+	boot(REASON_EXCEPTION_RST, &app);
+	check("exception deadline", due_near(15000), "deadline moved");
+	sleep_save();
+
+	// The reset pin and a power cycle stop the RTC counter: send now.
+	rtc_ticks = 0;
+	check("reset pin", boot(REASON_EXT_SYS_RST, &app), "no state");
+	check("reset pin", memcmp(&app, &saved, sizeof(app)) == 0,
+	    "wrong state");
+	check("reset pin deadline", sleep_due_ms() == 0, "not due");
+	sleep_schedule(30000);
+	for (ii = 0; ii < 10; ii++)
+	{
+		sleep_save();
+	}
+	check("power cycle deadline", boot(REASON_DEFAULT_RST, &app),
+	    "no state");
+	check("power cycle deadline", memcmp(&app, &saved, sizeof(app)) == 0,
+	    "wrong state");
+	check("power cycle deadline", sleep_due_ms() == 0, "not due");
+
+	check("size changed", !sleep_setup(&app, sizeof(app) - 4),
+	    "state found");
+
+	if (failed != 0)
+	{
+		printf("sleep: %d failed\n", failed);
+		return(1);
+	}
+	return(0);
+}
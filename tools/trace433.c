@@ -0,0 +1,237 @@
+/*
+ *  Host tool that decodes the binary trace frames sent to the UART with
+ *  CFG_TRACE_BINARY (see user/trace.h) and prints them as text, passing
+ *  anything else, such as console output, through unchanged.  Gaps in the
+ *  sequence numbers are reported as lost frames.
+ *
+ *  Read from a capture or straight from the serial port, for example:
+ *
+ *    stty -F /dev/ttyUSB0 76800 raw
+ *    trace433 /dev/ttyUSB0
+ *
+ *  "trace433 -c" just checks that every format in the catalog uses as many
+ *  arguments as its entry says; "make tools" runs it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "portable.h"
+#include "trace.h"
+
+typedef struct trace_entry
+{
+	const char *name;
+	int nargs;
+	const char *format;
+} TRACE_ENTRY;
+
+#define TRACE_DEF(id, nargs, format) { #id, nargs, format },
+static const TRACE_ENTRY catalog[] =
+{
+#include "trace.def"
+};
+#undef TRACE_DEF
+
+#define CATALOG_SIZE	(sizeof(catalog) / sizeof(catalog[0]))
+
+static uint8 frame[TRACE_FRAME_MAX];
+static int have = 0;
+static int have_seq = 0;
+static uint8 next_seq;
+static unsigned long frames = 0;
+static unsigned long lost = 0;
+static unsigned long bad = 0;
+
+static uint32 get32(const uint8 *p)
+{
+	return(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24));
+}
+
+/**
+ * Count the conversions in a format, not counting "%%".
+ */
+static int conversions(const char *format)
+{
+	int count = 0;
+
+	while ((format = strchr(format, '%')) != NULL)
+	{
+		if (format[1] == '%')
+		{
+			format += 2;
+			continue;
+		}
+		count++;
+		format++;
+	}
+	return(count);
+}
+
+static int check_catalog(void)
+{
+	int errors = 0;
+	unsigned ii;
+
+	for (ii = 0; ii < CATALOG_SIZE; ii++)
+	{
+		if ((catalog[ii].nargs > TRACE_MAX_ARGS) ||
+		    (conversions(catalog[ii].format) != catalog[ii].nargs))
+		{
+			fprintf(stderr, "trace.def: %s has %d arguments but \"%s\"\n",
+			    catalog[ii].name, catalog[ii].nargs, catalog[ii].format);
+			errors++;
+		}
+	}
+	return(errors);
+}
+
+static void print_frame(void)
+{
+	uint32 args[TRACE_MAX_ARGS] = { 0 };
+	uint32 time = get32(&frame[4]);
+	uint8 seq = frame[2];
+	int nargs = (frame[1] - 7) / 4;
+	int ii;
+
+	if ((have_seq) && (seq != next_seq))
+	{
+		printf("*** %u frames lost\n", (unsigned)(uint8)(seq - next_seq));
+		lost += (uint8)(seq - next_seq);
+	}
+	have_seq = 1;
+	next_seq = seq + 1;
+	frames++;
+
+	for (ii = 0; ii < nargs; ii++)
+	{
+		args[ii] = get32(&frame[8 + (4 * ii)]);
+	}
+
+	printf("%6u.%06u %3u ", (unsigned)(time / 1000000),
+	    (unsigned)(time % 1000000), (unsigned)seq);
+	if ((frame[3] >= CATALOG_SIZE) || (catalog[frame[3]].nargs != nargs))
+	{
+		printf("unknown trace %u:", (unsigned)frame[3]);
+		for (ii = 0; ii < nargs; ii++)
+		{
+			printf(" %u", (unsigned)args[ii]);
+		}
+	}
+	else
+	{
+		printf("%s: ", catalog[frame[3]].name);
+		printf(catalog[frame[3]].format, args[0], args[1], args[2], args[3]);
+	}
+	printf("\n");
+}
+
+/**
+ * Has the frame got as far as it could be without being wrong?
+ */
+static int frame_valid(void)
+{
+	uint8 check = 0;
+	int ii;
+
+	if ((have >= 2) &&
+	    ((frame[1] < 7) || (frame[1] > TRACE_FRAME_MAX - 2) ||
+	     ((frame[1] - 7) % 4 != 0)))
+	{
+		return(0);
+	}
+	if ((have >= 2) && (have == frame[1] + 2))
+	{
+		for (ii = 1; ii < have - 1; ii++)
+		{
+			check += frame[ii];
+		}
+		return((uint8)~check == frame[have - 1]);
+	}
+	return(1);
+}
+
+/**
+ * Feed a byte in.  If what has been collected turns out not to be a frame
+ * the sync byte is passed through as text and the rest looked at again.
+ */
+static void feed(uint8 byte)
+{
+	uint8 retry[TRACE_FRAME_MAX];
+	int count;
+	int ii;
+
+	if (have == 0)
+	{
+		if (byte == TRACE_SYNC)
+		{
+			frame[have++] = byte;
+		}
+		else
+		{
+			putchar(byte);
+		}
+		return;
+	}
+
+	frame[have++] = byte;
+	if (!frame_valid())
+	{
+		bad++;
+		putchar(frame[0]);
+		count = have - 1;
+		memcpy(retry, &frame[1], count);
+		have = 0;
+		for (ii = 0; ii < count; ii++)
+		{
+			feed(retry[ii]);
+		}
+		return;
+	}
+
+	if ((have >= 2) && (have == frame[1] + 2))
+	{
+		print_frame();
+		have = 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *input = stdin;
+	int c;
+
+	if (check_catalog() != 0)
+	{
+		return(1);
+	}
+	if ((argc > 1) && (strcmp(argv[1], "-c") == 0))
+	{
+		return(0);
+	}
+
+	if (argc > 1)
+	{
+		input = fopen(argv[1], "rb");
+		if (input == NULL)
+		{
+			perror(argv[1]);
+			return(1);
+		}
+	}
+
+	while ((c = getc(input)) != EOF)
+	{
+		feed((uint8)c);
+		if (have == 0)
+		{
+			fflush(stdout);
+		}
+	}
+
+	printf("*** %lu frames, %lu lost, %lu bad\n", frames, lost, bad);
+	if (input != stdin)
+	{
+		fclose(input);
+	}
+	return(0);
+}
@@ -0,0 +1,410 @@
+/*
+ *  Monotonic microsecond wall clock.  See clock.h.
+ *
+ *  The SDK's SNTP client only keeps whole seconds, counted by a timer of
+ *  its own from when the reply was processed, so it cannot say where in
+ *  the second we are.  Instead, every CLOCK_SYNC_US we send an NTP request
+ *  of our own and take the time from the reply's transmit timestamp,
+ *  seconds and fraction, plus half of the network delay.  Successive
+ *  replies, being timed by the server and not by our crystal, also give
+ *  the crystal's drift.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "espconn.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "msg.h"
+#include "clock.h"
+
+/**
+ * The tick keeps the 64 bit counter up to date (system_get_time() wraps
+ * after 71 minutes) and starts the syncs.
+ */
+#define CLOCK_TICK_MS		10000
+#define CLOCK_SYNC_US		(600 * 1000000ULL)
+
+/**
+ * The NTP request and reply.  Timestamps are seconds since 1900, big
+ * endian, followed by a 32 bit binary fraction of a second.
+ */
+#define CLOCK_NTP_PORT		123
+#define CLOCK_NTP_LEN		48
+#define CLOCK_NTP_CLIENT	0x23	// Version 4, client.
+#define CLOCK_NTP_SERVER	4
+#define CLOCK_NTP_ORIGIN	24
+#define CLOCK_NTP_RECEIVE	32
+#define CLOCK_NTP_TRANSMIT	40
+#define CLOCK_NTP_UNIX		2208988800UL
+
+/**
+ * A reply not back within CLOCK_NTP_TIMEOUT_US is given up on, at the next
+ * tick, and the next server tried.  One that took longer than
+ * CLOCK_NTP_DELAY_MAX_US on the network is too uncertain to use.
+ */
+#define CLOCK_NTP_TIMEOUT_US	(5 * 1000000ULL)
+#define CLOCK_NTP_DELAY_MAX_US	500000
+
+/**
+ * Errors are slewed out at this rate; anything bigger than CLOCK_STEP_US
+ * is stepped instead (forwards only, see clock_wall_us()).
+ */
+#define CLOCK_SLEW_PPM		500
+#define CLOCK_STEP_US		1000000
+
+/**
+ * Drift is only measured over at least this long, so that the error in
+ * each reply's delay is small in comparison, and is limited to a sane
+ * value.
+ */
+#define CLOCK_DRIFT_MIN_US	(300 * 1000000ULL)
+#define CLOCK_DRIFT_MAX_PPB	500000
+
+static uint32 clock_last_low = 0;
+static uint32 clock_high = 0;
+
+/**
+ * The wall clock is anchor_wall at anchor_local, plus the local time since
+ * then corrected for drift, plus as much of slew_us as has been applied.
+ */
+static bool clock_synced = FALSE;
+static uint64 clock_anchor_local;
+static uint64 clock_anchor_wall;
+static sint64 clock_slew_us;
+static sint32 clock_drift = 0;
+static bool clock_have_drift = FALSE;
+static uint64 clock_last_wall = 0;
+static uint64 clock_last_sync;
+
+/**
+ * The sync that drift is measured from.
+ */
+static uint64 clock_ref_local;
+static uint64 clock_ref_wall;
+
+static os_timer_t clock_timer;
+
+/**
+ * The NTP query.  Our transmit timestamp is just the local time, which the
+ * reply must echo as its origin.
+ */
+static const char *clock_servers[] =
+{
+	CFG_NTP_SERVER_0, CFG_NTP_SERVER_1, CFG_NTP_SERVER_2
+};
+
+#define CLOCK_SERVER_COUNT	(sizeof(clock_servers) / sizeof(clock_servers[0]))
+
+static struct espconn clock_conn;
+static esp_udp clock_udp;
+static ip_addr_t clock_server_addr;
+static int clock_server = 0;
+static bool clock_querying = FALSE;
+static uint64 clock_query_local;
+
+/**
+ * Microseconds since boot.
+ */
+uint64 ICACHE_FLASH_ATTR clock_us64(void)
+{
+	uint32 now = system_get_time();
+
+	if (now < clock_last_low)
+	{
+		clock_high++;
+	}
+	clock_last_low = now;
+	return(((uint64)clock_high << 32) | now);
+}
+
+LOCAL uint64 ICACHE_FLASH_ATTR clock_wall_at(uint64 local)
+{
+	sint64 elapsed = (sint64)(local - clock_anchor_local);
+	sint64 slew;
+	uint64 wall;
+
+	wall = clock_anchor_wall + elapsed -
+	    ((elapsed * clock_drift) / 1000000000LL);
+
+	slew = (elapsed * CLOCK_SLEW_PPM) / 1000000;
+	if (clock_slew_us >= 0)
+	{
+		wall += (slew < clock_slew_us) ? slew : clock_slew_us;
+	}
+	else
+	{
+		wall -= (slew < -clock_slew_us) ? slew : -clock_slew_us;
+	}
+	return(wall);
+}
+
+/**
+ * The NTP time was 'wall' at local time 'local'.
+ */
+LOCAL void ICACHE_FLASH_ATTR clock_sync(uint64 local, uint64 wall)
+{
+	sint64 measured;
+	sint64 offset;
+	uint64 current;
+	uint64 elapsed;
+
+	clock_last_sync = local;
+
+	if (!clock_synced)
+	{
+		clock_anchor_local = local;
+		clock_anchor_wall = wall;
+		clock_slew_us = 0;
+		clock_ref_local = local;
+		clock_ref_wall = wall;
+		clock_synced = TRUE;
+		CONSOLE_INFO("Clock: synced");
+		return;
+	}
+
+	/**
+	 * How much faster (or slower) than NTP has our counter run?  Smoothed
+	 * because each reply is only placed to within its network delay.
+	 */
+	elapsed = wall - clock_ref_wall;
+	if (elapsed >= CLOCK_DRIFT_MIN_US)
+	{
+		measured = (((sint64)(local - clock_ref_local) - (sint64)elapsed) *
+		    1000000000LL) / (sint64)elapsed;
+		if (measured > CLOCK_DRIFT_MAX_PPB)
+		{
+			measured = CLOCK_DRIFT_MAX_PPB;
+		}
+		else if (measured < -CLOCK_DRIFT_MAX_PPB)
+		{
+			measured = -CLOCK_DRIFT_MAX_PPB;
+		}
+
+		if (clock_have_drift)
+		{
+			clock_drift += (sint32)((measured - clock_drift) / 4);
+		}
+		else
+		{
+			clock_drift = (sint32)measured;
+			clock_have_drift = TRUE;
+		}
+		clock_ref_local = local;
+		clock_ref_wall = wall;
+	}
+
+	/**
+	 * Carry on from where the clock is now and slew towards NTP.
+	 */
+	current = clock_wall_at(local);
+	offset = (sint64)(wall - current);
+	clock_anchor_local = local;
+	clock_anchor_wall = current;
+	clock_slew_us = offset;
+	if ((offset > CLOCK_STEP_US) || (offset < -CLOCK_STEP_US))
+	{
+		clock_anchor_wall = wall;
+		clock_slew_us = 0;
+	}
+
+	syslog(SMSG_CLOCK_SYNC, (int)offset, (int)clock_drift);
+}
+
+LOCAL void ICACHE_FLASH_ATTR clock_put64(uint8 *p, uint64 value)
+{
+	int ii;
+
+	for (ii = 7; ii >= 0; ii--)
+	{
+		p[ii] = value & 0xFF;
+		value >>= 8;
+	}
+}
+
+LOCAL uint32 ICACHE_FLASH_ATTR clock_get32(const uint8 *p)
+{
+	return(((uint32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+/**
+ * An NTP timestamp as microseconds since the Unix epoch, as SNTP's
+ * seconds are.
+ */
+LOCAL uint64 ICACHE_FLASH_ATTR clock_ntp_us(const uint8 *p)
+{
+	uint64 sec = clock_get32(p) - CLOCK_NTP_UNIX;
+	uint64 frac = clock_get32(p + 4);
+
+	return((sec * 1000000) + ((frac * 1000000) >> 32));
+}
+
+/**
+ * The reply to our query.  The server received the request at T2 and sent
+ * the reply at T3 by its clock; the rest of the round trip was the network,
+ * half of it taken to be on the way back.
+ */
+LOCAL void ICACHE_FLASH_ATTR clock_recv(void *arg, char *data,
+    unsigned short length)
+{
+	uint64 now = clock_us64();
+	uint8 *reply = (uint8 *)data;
+	uint8 origin[8];
+	uint64 received;
+	uint64 sent;
+	sint64 delay;
+
+	clock_put64(origin, clock_query_local);
+	if ((!clock_querying) || (length < CLOCK_NTP_LEN) ||
+	    ((reply[0] & 0x07) != CLOCK_NTP_SERVER) || (reply[1] == 0) ||
+	    (os_memcmp(&reply[CLOCK_NTP_ORIGIN], origin, sizeof(origin)) != 0))
+	{
+		return;
+	}
+	clock_querying = FALSE;
+
+	received = clock_ntp_us(&reply[CLOCK_NTP_RECEIVE]);
+	sent = clock_ntp_us(&reply[CLOCK_NTP_TRANSMIT]);
+	delay = (sint64)(now - clock_query_local) - (sint64)(sent - received);
+	if ((delay < 0) || (delay > CLOCK_NTP_DELAY_MAX_US))
+	{
+		CONSOLE_WARN("Clock: NTP delay %dus, ignored", (int)delay);
+		return;
+	}
+	clock_sync(now, sent + (delay / 2));
+}
+
+LOCAL void ICACHE_FLASH_ATTR clock_query(void)
+{
+	uint8 request[CLOCK_NTP_LEN];
+
+	os_memset(request, 0, sizeof(request));
+	request[0] = CLOCK_NTP_CLIENT;
+	clock_query_local = clock_us64();
+	clock_put64(&request[CLOCK_NTP_TRANSMIT], clock_query_local);
+
+	os_memcpy(clock_udp.remote_ip, &clock_server_addr, 4);
+	clock_udp.remote_port = CLOCK_NTP_PORT;
+	if (espconn_sendto(&clock_conn, request, sizeof(request)) != 0)
+	{
+		clock_querying = FALSE;
+	}
+}
+
+LOCAL void ICACHE_FLASH_ATTR clock_dns_callback(const char *name,
+    ip_addr_t *addr, void *arg)
+{
+	if (!clock_querying)
+	{
+		return;
+	}
+	if ((addr == NULL) || (addr->addr == 0))
+	{
+		CONSOLE_WARN("Clock: cannot resolve %s", name);
+		clock_querying = FALSE;
+		clock_server = (clock_server + 1) % CLOCK_SERVER_COUNT;
+		return;
+	}
+	clock_server_addr = *addr;
+	clock_query();
+}
+
+LOCAL void ICACHE_FLASH_ATTR clock_tick(void *arg)
+{
+	uint64 now = clock_us64();
+	err_t error;
+
+	if (clock_querying)
+	{
+		if (now - clock_query_local < CLOCK_NTP_TIMEOUT_US)
+		{
+			return;
+		}
+		CONSOLE_WARN("Clock: no reply from %s", clock_servers[clock_server]);
+		clock_querying = FALSE;
+		clock_server = (clock_server + 1) % CLOCK_SERVER_COUNT;
+	}
+	if (((clock_synced) && (now - clock_last_sync < CLOCK_SYNC_US)) ||
+	    (wifi_station_get_connect_status() != STATION_GOT_IP))
+	{
+		return;
+	}
+
+	/**
+	 * The name is looked up each time; pool servers come and go.
+	 */
+	clock_querying = TRUE;
+	clock_query_local = now;
+	error = espconn_gethostbyname(&clock_conn, clock_servers[clock_server],
+	    &clock_server_addr, clock_dns_callback);
+	if (error == ESPCONN_OK)
+	{
+		clock_query();
+	}
+	else if (error != ESPCONN_INPROGRESS)
+	{
+		clock_dns_callback(clock_servers[clock_server], NULL, NULL);
+	}
+}
+
+void ICACHE_FLASH_ATTR clock_setup(void)
+{
+	sint8 rc;
+
+	clock_us64();
+
+	clock_conn.type = ESPCONN_UDP;
+	clock_conn.state = ESPCONN_NONE;
+	clock_conn.proto.udp = &clock_udp;
+	clock_udp.local_port = espconn_port();
+	clock_udp.remote_port = CLOCK_NTP_PORT;
+	espconn_regist_recvcb(&clock_conn, clock_recv);
+	rc = espconn_create(&clock_conn);
+	if (rc != 0)
+	{
+		CONSOLE_ERROR("Clock: create UDP socket: %d", (int)rc);
+	}
+
+	os_timer_disarm(&clock_timer);
+	os_timer_setfn(&clock_timer, clock_tick, NULL);
+	os_timer_arm(&clock_timer, CLOCK_TICK_MS, TRUE);
+}
+
+bool ICACHE_FLASH_ATTR clock_valid(void)
+{
+	return(clock_synced);
+}
+
+/**
+ * Microseconds since the Unix epoch, or 0 if we do not know yet.  A step
+ * backwards is held off by repeating the last time until the clock has
+ * caught up.
+ */
+uint64 ICACHE_FLASH_ATTR clock_wall_us(void)
+{
+	uint64 wall;
+
+	if (!clock_synced)
+	{
+		return(0);
+	}
+
+	wall = clock_wall_at(clock_us64());
+	if (wall < clock_last_wall)
+	{
+		wall = clock_last_wall;
+	}
+	clock_last_wall = wall;
+	return(wall);
+}
+
+/**
+ * How fast our crystal runs compared to NTP, in parts per billion.
+ */
+sint32 ICACHE_FLASH_ATTR clock_drift_ppb(void)
+{
+	return(clock_drift);
+}
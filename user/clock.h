@@ -0,0 +1,26 @@
+/**
+ * A monotonic wall clock with microsecond resolution.
+ *
+ * system_get_time() is extended to 64 bits so it never wraps and is tied to
+ * UTC by NTP queries of its own, sent to the CFG_NTP_SERVER_* servers while
+ * WiFi is up, which give the time to well under a millisecond.  Successive
+ * syncs give the drift of our crystal against NTP which is corrected for
+ * between syncs, and any remaining error is slewed out gradually rather
+ * than stepped so the clock never goes backwards.
+ *
+ * 1. Call clock_setup() once at boot, with the network to be brought up.
+ * 2. clock_us64() is the time since boot; clock_wall_us() is Unix time in
+ *    microseconds once clock_valid() is TRUE.
+ *
+ * These must not be called from interrupts.
+ */
+#ifndef CLOCK_H
+#define CLOCK_H
+
+void clock_setup(void);
+uint64 clock_us64(void);
+bool clock_valid(void);
+uint64 clock_wall_us(void);
+sint32 clock_drift_ppb(void);
+
+#endif
@@ -10,6 +10,13 @@
 #define CFG_WIFI_SSID  		"5u93ca1i7r69"
 #define CFG_WIFI_PWD  		"5nipp094rr6M"
 
+/**
+ * Define to reuse the last DHCP address after a reset or deep sleep rather
+ * than asking for it again, which saves a few hundred milliseconds of each
+ * connection but relies on the DHCP server not giving it to anything else.
+ */
+// #define CFG_WIFI_REUSE_LEASE
+
 /**
  * Watchdog timer interval.
  */
@@ -42,6 +49,19 @@
 #define CFG_SYSLOG_PORT		34135
 #endif
 
+/**
+ * Define to send syslog messages over TCP, rather than UDP, to the same
+ * port.  Messages are then not lost in transit and bursts are sent several
+ * to a segment.
+ */
+// #define CFG_SYSLOG_TCP
+
+/**
+ * Send trace points (see trace.h) to the UART as binary frames rather than
+ * text.  Decode them with tools/trace433.
+ */
+// #define CFG_TRACE_BINARY
+
 /**
  * GPIO configuration.
  */
@@ -51,12 +71,89 @@
 #define CFG_GPIO_PIN        GPIO_ID_PIN(CFG_GPIO_NUM)
 
 /**
- * Maximum interval before we MUST send an HTTP request.
+ * Define to sample a 433MHz receiver wired to GPIO12 and log the sensor
+ * data that it hears.
+ */
+// #define CFG_433_RX
+
+/**
+ * With CFG_433_RX, define this to store the first signal heard in flash as
+ * a capture with this ID, for replay by replay433_send().
+ */
+// #define CFG_433_RECORD_ID	1
+
+/**
+ * Define to deep sleep between sends, for battery powered senders; GPIO16
+ * must be wired to RST for the RTC to wake us.  The radio stays off except
+ * every CFG_SLEEP_NET_WAKES wakes, when WiFi is brought up for at most
+ * CFG_SLEEP_NET_MS to flush the log and sync the clock.
  */
-#define CFG_HTTP_INTERVAL 	5*60*1000*1000
-#define CFG_HTTP_SITE       "http://weatherstation.wunderground.com"
-#define CFG_HTTP_PAGE		"weatherstation/updateweatherstation.php"
+// #define CFG_DEEP_SLEEP
+#define CFG_SEND_INTERVAL_MS		30000
+#define CFG_SLEEP_NET_WAKES		20
+#define CFG_SLEEP_NET_MS		10000
+
+/**
+ * Flash areas that we manage ourselves, in 4KB sectors.  With the 512KB
+ * layout, nothing uses the space between the end of 0x00000.bin and the
+ * master device key at 0x3E000.
+ */
+#define CFG_CAPTURE_FLASH_SECTOR	0x20
+#define CFG_CAPTURE_FLASH_COUNT		24
+#define CFG_SPILL_FLASH_SECTOR		0x38
+#define CFG_SPILL_FLASH_COUNT		4
+#define CFG_SLEEP_FLASH_SECTOR		0x3C
+
+/**
+ * RTC memory, in 4 byte blocks, that survives a reboot (but not a power
+ * cycle).  The SDK uses blocks 0 to 63 itself, leaving 64 to 191.  Each
+ * user starts where the one before ends and checks that it fits.
+ */
+#define CFG_RTC_SYSLOG_DNS		64
+#define CFG_RTC_SYSLOG_DNS_BLOCKS	3
+#define CFG_RTC_SLEEP			(CFG_RTC_SYSLOG_DNS + CFG_RTC_SYSLOG_DNS_BLOCKS)
+#define CFG_RTC_SLEEP_BLOCKS		14
+#define CFG_RTC_WIFI			(CFG_RTC_SLEEP + CFG_RTC_SLEEP_BLOCKS)
+#define CFG_RTC_WIFI_BLOCKS		7
+#define CFG_RTC_END			192
+
+/**
+ * HTTP server that the readings heard from 433MHz sensors are uploaded to
+ * (see http.h).  Point it at tools/httpsink to test.
+ */
+#if 0
+#define CFG_HTTP_HOST		"192.168.1.5"
+#define CFG_HTTP_PORT		8080
+#else
+#define CFG_HTTP_HOST		"weatherstation.wunderground.com"
+#define CFG_HTTP_PORT		80
+#endif
+
+/**
+ * Maximum interval, in us, before an unchanged reading is sent again.
+ */
+#define CFG_HTTP_INTERVAL 	(5*60*1000*1000)
+#define CFG_HTTP_PAGE		"/weatherstation/updateweatherstation.php"
 #define CFG_HTTP_ID		    "ID=IENFIELD17&PASSWORD=xanadu"
-#define CFG_HTTP_DATA		"action=updateraw&dateutc=now&tempf=%d.%d&humidity=%d"
-#define CFG_HTTP_URL_FMT	CFG_HTTP_SITE "/" CFG_HTTP_PAGE "?" CFG_HTTP_ID "&" CFG_HTTP_DATA
+#define CFG_HTTP_DATA		"action=updateraw&dateutc=%s&tempf=%s%d.%d"
 
+/**
+ * Readings go one per GET, which is what wunderground takes.  For a server
+ * that takes several at once, one per line in the body of a POST, define
+ * CFG_HTTP_BATCH.
+ */
+// #define CFG_HTTP_BATCH
+
+/**
+ * UDP port for the control protocol (see ctl.h), which tools/ctl433 talks.
+ */
+#define CFG_CTL_PORT		4330
+
+
+/**
+ * Task priorities.  The Non-OS SDK only has three user task priorities
+ * (USER_TASK_PRIO_0 to USER_TASK_PRIO_2) so they are allocated here.
+ */
+#define CFG_TASK_PRIO_SYSLOG	USER_TASK_PRIO_0
+#define CFG_TASK_PRIO_I2S_RX	USER_TASK_PRIO_1
+#define CFG_TASK_PRIO_I2S_STREAM	USER_TASK_PRIO_2
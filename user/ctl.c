@@ -0,0 +1,337 @@
+/*
+ *  UDP control protocol.  See ctl.h.
+ *
+ *  Each queued payload or replay keeps the address of the client that sent
+ *  it, as the reply only goes when it is sent.  One of our payloads is passed
+ *  to the transmitter only when it has nothing else to send, so it starts
+ *  at once; a regular send that comes along meanwhile waits in the
+ *  transmitter's own queue.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "espconn.h"
+#include "driver/i2s_433.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "msg.h"
+#include "clock.h"
+#include "heap.h"
+#include "sensor433.h"
+#include "replay433.h"
+#include "ctl.h"
+
+typedef struct ctl_request
+{
+	uint32 payload;		// Or the capture ID to replay.
+	uint32 sequence;
+	uint8 command;
+	uint8 repeats;		// Not used for a replay.
+	uint8 remote_ip[4];
+	uint16 remote_port;
+} CTL_REQUEST;
+
+static CTL_SCHEDULE *ctl_schedule;
+static CTL_REQUEST ctl_queue[CTL_QUEUE];
+static int ctl_head = 0;
+static int ctl_count = 0;
+static uint32 ctl_sent_count = 0;
+static uint32 ctl_rejected = 0;
+
+static struct espconn ctl_conn;
+static esp_udp ctl_udp;
+
+LOCAL uint32 ICACHE_FLASH_ATTR ctl_get32(const uint8 *data)
+{
+	return(data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32)data[3] << 24));
+}
+
+LOCAL void ICACHE_FLASH_ATTR ctl_put32(uint8 *data, uint32 value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+LOCAL void ICACHE_FLASH_ATTR ctl_put16(uint8 *data, uint16 value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+}
+
+/**
+ * Send a reply to the given client, with the time 'when' (from clock_us64()
+ * or clock_wall_us() as 'wall' says).
+ */
+LOCAL void ICACHE_FLASH_ATTR ctl_reply(const uint8 *remote_ip,
+    int remote_port, uint8 command, uint8 status, uint32 sequence,
+    uint64 when, bool wall)
+{
+	uint8 reply[CTL_REPLY_LEN];
+	HEAP_STATUS heap;
+
+	heap_status(&heap);
+	os_memset(reply, 0, sizeof(reply));
+	ctl_put16(&reply[0], CTL_MAGIC);
+	reply[2] = command;
+	reply[3] = status;
+	ctl_put32(&reply[4], sequence);
+	ctl_put32(&reply[8], (uint32)when);
+	ctl_put32(&reply[12], (uint32)(when >> 32));
+	ctl_put16(&reply[16], ctl_count);
+	ctl_put16(&reply[18], CTL_QUEUE);
+	ctl_put32(&reply[20], ctl_sent_count);
+	ctl_put32(&reply[24], ctl_rejected);
+	ctl_put32(&reply[28], ctl_schedule->interval_ms);
+	ctl_put32(&reply[32], ctl_schedule->sender);
+	reply[36] = ctl_schedule->repeats;
+	reply[37] = wall;
+	ctl_put32(&reply[40], heap.free);
+	ctl_put32(&reply[44], heap.min_free);
+
+	os_memcpy(ctl_udp.remote_ip, remote_ip, 4);
+	ctl_udp.remote_port = remote_port;
+	espconn_sendto(&ctl_conn, reply, sizeof(reply));
+}
+
+/**
+ * Reply now, with the current time.
+ */
+LOCAL void ICACHE_FLASH_ATTR ctl_reply_now(const uint8 *remote_ip,
+    int remote_port, uint8 command, uint8 status, uint32 sequence)
+{
+	bool wall = clock_valid();
+
+	ctl_reply(remote_ip, remote_port, command, status, sequence,
+	    wall ? clock_wall_us() : clock_us64(), wall);
+}
+
+/**
+ * Pass the next queued payload, or replay, to the transmitter if it is
+ * idle.
+ */
+LOCAL void ICACHE_FLASH_ATTR ctl_pump(void)
+{
+	CTL_REQUEST *request;
+	I2S_FRAME *frame;
+	uint64 when;
+	uint8 status = CTL_SEND_FAILED;
+	bool wall;
+
+	if ((ctl_count == 0) || (!i2sSendIdle()))
+	{
+		return;
+	}
+
+	request = &ctl_queue[ctl_head];
+	ctl_head = (ctl_head + 1) % CTL_QUEUE;
+	ctl_count--;
+
+	wall = clock_valid();
+	when = wall ? clock_wall_us() : clock_us64();
+	if (request->command == CTL_CMD_REPLAY)
+	{
+		if (replay433_send((uint16)request->payload))
+		{
+			status = CTL_OK;
+		}
+	}
+	else
+	{
+		frame = i2sFrameData(request->payload);
+		if (frame != NULL)
+		{
+			if (i2sSendFrame(frame, request->repeats))
+			{
+				status = CTL_OK;
+			}
+			i2sFrameRelease(frame);
+		}
+	}
+	if (status == CTL_OK)
+	{
+		ctl_sent_count++;
+	}
+	else
+	{
+		ctl_rejected++;
+	}
+	ctl_reply(request->remote_ip, request->remote_port, request->command,
+	    status, request->sequence, when, wall);
+}
+
+/**
+ * Queue a payload or replay, to be replied to once it is sent.
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR ctl_enqueue(uint8 command, uint32 payload,
+    uint8 repeats, uint32 sequence, const remot_info *remote)
+{
+	CTL_REQUEST *queued;
+
+	if (ctl_count == CTL_QUEUE)
+	{
+		return(CTL_QUEUE_FULL);
+	}
+	queued = &ctl_queue[(ctl_head + ctl_count) % CTL_QUEUE];
+	queued->payload = payload;
+	queued->command = command;
+	queued->sequence = sequence;
+	queued->repeats = repeats;
+	os_memcpy(queued->remote_ip, remote->remote_ip, 4);
+	queued->remote_port = remote->remote_port;
+	ctl_count++;
+	ctl_pump();
+	return(CTL_OK);
+}
+
+LOCAL void ICACHE_FLASH_ATTR ctl_recv(void *arg, char *data, unsigned short length)
+{
+	const uint8 *request = (const uint8 *)data;
+	remot_info *remote = NULL;
+	uint32 sequence;
+	uint32 interval;
+	uint32 sender;
+	uint8 command;
+	uint8 repeats;
+	uint8 status = CTL_OK;
+
+	if ((espconn_get_connection_info(&ctl_conn, &remote, 0) != 0) ||
+	    (remote == NULL))
+	{
+		return;
+	}
+	if ((length < CTL_REQUEST_LEN) ||
+	    (request[0] != (CTL_MAGIC & 0xFF)) || (request[1] != (CTL_MAGIC >> 8)))
+	{
+		// Not for us; no reply.
+		ctl_rejected++;
+		return;
+	}
+	command = request[2];
+	sequence = ctl_get32(&request[4]);
+
+	switch (command)
+	{
+	case CTL_CMD_SEND:
+		if (length < CTL_SEND_LEN)
+		{
+			status = CTL_BAD_REQUEST;
+			break;
+		}
+		repeats = request[12];
+		if (repeats == 0)
+		{
+			repeats = ctl_schedule->repeats;
+		}
+		if (repeats > I2S_FRAME_REPEATS)
+		{
+			status = CTL_BAD_REQUEST;
+			break;
+		}
+		status = ctl_enqueue(command, ctl_get32(&request[8]), repeats,
+		    sequence, remote);
+		if (status == CTL_OK)
+		{
+			return;
+		}
+		break;
+
+	case CTL_CMD_REPLAY:
+		if (length < CTL_REPLAY_LEN)
+		{
+			status = CTL_BAD_REQUEST;
+			break;
+		}
+		status = ctl_enqueue(command, request[8] | (request[9] << 8), 0,
+		    sequence, remote);
+		if (status == CTL_OK)
+		{
+			return;
+		}
+		break;
+
+	case CTL_CMD_SCHEDULE:
+		if (length < CTL_SCHEDULE_LEN)
+		{
+			status = CTL_BAD_REQUEST;
+			break;
+		}
+		interval = ctl_get32(&request[8]);
+		sender = ctl_get32(&request[12]);
+		repeats = request[16];
+		if (((interval != 0) && (interval < CTL_INTERVAL_MIN)) ||
+		    ((sender & ~CFG_433_SENDER_MASK) != 0) ||
+		    (repeats > I2S_FRAME_REPEATS))
+		{
+			status = CTL_BAD_REQUEST;
+			break;
+		}
+		if (interval != 0)
+		{
+			ctl_schedule->interval_ms = interval;
+		}
+		if (sender != 0)
+		{
+			ctl_schedule->sender = sender;
+		}
+		if (repeats != 0)
+		{
+			ctl_schedule->repeats = repeats;
+		}
+		syslog(SMSG_CTL_SCHEDULE, ctl_schedule->interval_ms,
+		    ctl_schedule->sender, ctl_schedule->repeats);
+		break;
+
+	case CTL_CMD_STATUS:
+		break;
+
+	default:
+		status = CTL_BAD_COMMAND;
+		break;
+	}
+
+	if (status != CTL_OK)
+	{
+		ctl_rejected++;
+	}
+	ctl_reply_now(remote->remote_ip, remote->remote_port,
+	    command, status, sequence);
+}
+
+/**
+ * How many payloads are waiting to be sent.
+ */
+int ICACHE_FLASH_ATTR ctl_queued(void)
+{
+	return(ctl_count);
+}
+
+/**
+ * The transmitter has finished a send; ours or a regular one.
+ */
+void ICACHE_FLASH_ATTR ctl_sent(void)
+{
+	ctl_pump();
+}
+
+void ICACHE_FLASH_ATTR ctl_setup(CTL_SCHEDULE *schedule)
+{
+	sint8 rc;
+
+	ctl_schedule = schedule;
+
+	ctl_conn.type = ESPCONN_UDP;
+	ctl_conn.state = ESPCONN_NONE;
+	ctl_conn.proto.udp = &ctl_udp;
+	ctl_udp.local_port = CFG_CTL_PORT;
+	espconn_regist_recvcb(&ctl_conn, ctl_recv);
+	rc = espconn_create(&ctl_conn);
+	if (rc != 0)
+	{
+		CONSOLE_ERROR("ctl: create UDP listener: %d", (int)rc);
+	}
+}
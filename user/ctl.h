@@ -0,0 +1,89 @@
+/**
+ * Control protocol, over UDP on CFG_CTL_PORT, for driving the transmitter
+ * from elsewhere; tools/ctl433 is a client for it.
+ *
+ * Each datagram is one request and gets one reply.  A request is
+ *
+ *   magic (2), command, 0, sequence (4), arguments
+ *
+ * and a reply is always CTL_REPLY_LEN bytes:
+ *
+ *   magic (2), command, status, sequence (4), time (8), queued (2),
+ *   queue size (2), sent (4), rejected (4), interval (4), sender (4),
+ *   repeats, clock, 0 (2), free heap (4), least free heap (4)
+ *
+ * where multi-byte values are little endian and the sequence is copied
+ * from the request.  The commands are
+ *
+ *   CTL_CMD_SEND      payload (4), repeats: queue a 32 bit payload to be
+ *                     sent as is, 'repeats' times or, if 0, as many as the
+ *                     schedule says.  The reply comes when it starts to be
+ *                     sent, with the time that it did.
+ *   CTL_CMD_SCHEDULE  interval ms (4), sender (4), repeats: change the
+ *                     regular send; 0 leaves a value as it is.  The new
+ *                     interval applies after the next send and must be at
+ *                     least CTL_INTERVAL_MIN.
+ *   CTL_CMD_STATUS    no arguments.
+ *   CTL_CMD_REPLAY    id (2): queue a capture stored in flash (see
+ *                     replay433.h) to be sent once, as it was captured.
+ *                     Replied to as CTL_CMD_SEND.
+ *
+ * The time is microseconds of SNTP time if 'clock' is 1, or since boot if
+ * it is 0 because SNTP has not been synced; other than for CTL_CMD_SEND it
+ * is when the reply was made.  'sent' and 'rejected' count the payloads
+ * sent and the requests refused since boot.
+ *
+ * Requests are dealt with as they arrive, taking the same time whatever is
+ * queued; payloads wait in a queue of CTL_QUEUE and are passed to the
+ * transmitter one at a time, when it is idle, so that the time sent is the
+ * time that it started.  Changes are not kept over a reset.
+ *
+ * 1. Call ctl_setup() once at boot with the schedule that it may change.
+ * 2. Call ctl_sent() each time that the transmitter finishes a send.
+ * 3. ctl_queued() says whether payloads are still waiting, for example
+ *    before sleeping.
+ */
+#ifndef CTL_H
+#define CTL_H
+
+#define CTL_MAGIC		0x4333
+#define CTL_QUEUE		16
+
+/**
+ * The shortest send interval; a send at the most repeats takes about 0.9s,
+ * and each send is a save of the sender's state (see sleep.h).
+ */
+#define CTL_INTERVAL_MIN	1000
+
+#define CTL_CMD_SEND		1
+#define CTL_CMD_SCHEDULE	2
+#define CTL_CMD_STATUS		3
+#define CTL_CMD_REPLAY		4
+
+#define CTL_OK			0
+#define CTL_QUEUE_FULL		1
+#define CTL_BAD_REQUEST		2
+#define CTL_BAD_COMMAND		3
+#define CTL_SEND_FAILED		4
+
+#define CTL_REQUEST_LEN		8
+#define CTL_SEND_LEN		(CTL_REQUEST_LEN + 5)
+#define CTL_SCHEDULE_LEN	(CTL_REQUEST_LEN + 9)
+#define CTL_REPLAY_LEN		(CTL_REQUEST_LEN + 2)
+#define CTL_REPLY_LEN		48
+
+/**
+ * The regular send, which belongs to the caller.
+ */
+typedef struct ctl_schedule
+{
+	uint32 interval_ms;
+	uint32 sender;
+	uint8 repeats;
+} CTL_SCHEDULE;
+
+void ctl_setup(CTL_SCHEDULE *schedule);
+void ctl_sent(void);
+int ctl_queued(void);
+
+#endif
@@ -0,0 +1,215 @@
+/******************************************************************************
+ * Streaming pulse-width decoder for 433MHz OOK signals.
+ *
+ * The decoder never looks backwards; each HIGH is remembered until the LOW
+ * that follows it arrives and the pair is then classified, for every
+ * protocol, as a sync marker, a zero, a one, a gap or rubbish.  That keeps
+ * the cost per pulse small and fixed however busy the band is.
+ *
+ * This file has no hardware dependencies and builds unchanged on a Linux
+ * host; see tools/capture433.c.
+ *
+ *****************************************************************************/
+
+#include "decode433.h"
+
+/**
+ * Is the measured duration within tolerance of the nominal one?
+ */
+LOCAL bool ICACHE_FLASH_ATTR decode433Within(
+    uint32 us, uint16 nominal, uint8 tolerance)
+{
+  if (us > 0x1FFFF)
+  {
+    return(FALSE);
+  }
+  return((us * 100 >= (uint32)nominal * (100 - tolerance)) &&
+         (us * 100 <= (uint32)nominal * (100 + tolerance)));
+}
+
+LOCAL bool ICACHE_FLASH_ATTR decode433Pair(
+    uint32 high, uint32 low, uint16 nominal_high, uint16 nominal_low,
+    uint8 tolerance)
+{
+  return(decode433Within(high, nominal_high, tolerance) &&
+         decode433Within(low, nominal_low, tolerance));
+}
+
+/**
+ * The longest LOW of a bit.
+ */
+LOCAL uint16 ICACHE_FLASH_ATTR decode433Longest(
+    const DECODE433_PROTOCOL *protocol)
+{
+  return((protocol->one_low > protocol->zero_low) ?
+      protocol->one_low : protocol->zero_low);
+}
+
+/**
+ * A sync marker or a gap has ended the bits collected so far; report them
+ * if there are the right number.
+ */
+LOCAL void ICACHE_FLASH_ATTR decode433End(DECODE433 *decoder,
+    const DECODE433_PROTOCOL *protocol, DECODE433_MATCH *match)
+{
+  DECODE433_STATUS status = DECODE433_OK;
+
+  if ((match->synced) && (match->nbits == protocol->bits))
+  {
+    if ((protocol->check != NULL) && (!protocol->check(match->bits)))
+    {
+      status = DECODE433_BAD_CHECK;
+    }
+
+    if ((match->have_last) && (match->last == match->bits))
+    {
+      if (match->repeat < 0xFF)
+      {
+        match->repeat++;
+      }
+    }
+    else
+    {
+      match->repeat = 0;
+    }
+    match->last = match->bits;
+    match->have_last = TRUE;
+
+    decoder->result(decoder->arg, protocol, match->bits, status,
+        match->repeat);
+  }
+
+  match->synced = TRUE;
+  match->nbits = 0;
+  match->bits = 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR decode433Low(DECODE433 *decoder,
+    const DECODE433_PROTOCOL *protocol, DECODE433_MATCH *match, uint32 low)
+{
+  uint32 high = match->have_high ? match->high : 0;
+  uint8 tol = protocol->tolerance;
+
+  match->have_high = FALSE;
+
+  if (decode433Pair(high, low, protocol->sync_high, protocol->sync_low, tol))
+  {
+    decode433End(decoder, protocol, match);
+  }
+  else if ((match->synced) &&
+      decode433Pair(high, low, protocol->zero_high, protocol->zero_low, tol))
+  {
+    match->bits <<= 1;
+    match->nbits++;
+  }
+  else if ((match->synced) &&
+      decode433Pair(high, low, protocol->one_high, protocol->one_low, tol))
+  {
+    match->bits = (match->bits << 1) | 1;
+    match->nbits++;
+  }
+  else if ((low > 0x1FFFF) ||
+      (low * 100 > (uint32)decode433Longest(protocol) * (100 + tol)))
+  {
+    /**
+     * A gap, which is any LOW too long for a bit, both ends a payload and
+     * may precede the next one.  That includes the LOW after our own
+     * frames' closing zero, which the padding lengthens to anything from
+     * a one to well past a sync marker.
+     */
+    decode433End(decoder, protocol, match);
+    if (low >= DECODE433_IDLE_US)
+    {
+      match->have_last = FALSE;
+      match->repeat = 0;
+    }
+  }
+  else
+  {
+    match->synced = FALSE;
+  }
+
+  /**
+   * Only the last bits before the sync marker are the payload; a frame
+   * with too little padding to end in a gap brings its closing zero along.
+   */
+  if (match->nbits > protocol->bits)
+  {
+    match->nbits = protocol->bits;
+    if (protocol->bits < 32)
+    {
+      match->bits &= (1UL << protocol->bits) - 1;
+    }
+  }
+}
+
+void ICACHE_FLASH_ATTR decode433Init(DECODE433 *decoder,
+    const DECODE433_PROTOCOL *protocols, int count,
+    DECODE433_RESULT result, void *arg)
+{
+  os_memset(decoder, 0, sizeof(*decoder));
+  decoder->protocols = protocols;
+  decoder->count =
+      (count > DECODE433_MAX_PROTOCOLS) ? DECODE433_MAX_PROTOCOLS : count;
+  decoder->result = result;
+  decoder->arg = arg;
+  decoder->tick_ns = DECODE433_DEFAULT_TICK_NS;
+}
+
+/**
+ * Forget any partly received payloads, for example after the input has been
+ * interrupted.
+ */
+void ICACHE_FLASH_ATTR decode433Reset(DECODE433 *decoder)
+{
+  os_memset(decoder->match, 0, sizeof(decoder->match));
+  decoder->have_edge = FALSE;
+}
+
+void ICACHE_FLASH_ATTR decode433Pulse(DECODE433 *decoder,
+    uint8 level, uint32 us)
+{
+  DECODE433_MATCH *match;
+  int ii;
+
+  for (ii = 0; ii < decoder->count; ii++)
+  {
+    match = &decoder->match[ii];
+    if (level)
+    {
+      match->high = (us > 0xFFFF) ? 0xFFFF : us;
+      match->have_high = TRUE;
+    }
+    else
+    {
+      decode433Low(decoder, &decoder->protocols[ii], match, us);
+    }
+  }
+}
+
+/**
+ * Runs from the I2S receiver, measured in sample ticks.
+ */
+void ICACHE_FLASH_ATTR decode433Sampled(void *arg, uint8 level, uint32 ticks)
+{
+  DECODE433 *decoder = (DECODE433 *)arg;
+
+  decode433Pulse(decoder, level,
+      (uint32)(((uint64)ticks * decoder->tick_ns) / 1000));
+}
+
+/**
+ * Edges timestamped by a GPIO interrupt; level is the level after the edge
+ * and time_us the (wrapping) system_get_time() value of the edge.
+ */
+void ICACHE_FLASH_ATTR decode433Timestamp(DECODE433 *decoder,
+    uint8 level, uint32 time_us)
+{
+  if (decoder->have_edge)
+  {
+    decode433Pulse(decoder, decoder->edge_level, time_us - decoder->edge_us);
+  }
+  decoder->edge_level = level;
+  decoder->edge_us = time_us;
+  decoder->have_edge = TRUE;
+}
@@ -0,0 +1,117 @@
+#ifndef DECODE433_H
+#define DECODE433_H
+
+#include "portable.h"
+
+/**
+ * Streaming pulse-width decoder for 433MHz OOK signals.
+ *
+ * Every bit of the signals we deal with is a HIGH followed by a LOW and the
+ * value of the bit is given by the lengths of the two.  A protocol is
+ * described by the HIGH/LOW pair for a sync marker, a zero and a one and the
+ * number of bits in the payload.  The payload is the bits between a sync
+ * marker (or a gap, any LOW too long for a bit) and the next sync marker
+ * (or gap); if there are more than the protocol's, the last of them.
+ *
+ * Each pulse is matched against every protocol as it arrives so there is no
+ * buffering of bursts; the state is a few bytes per protocol.
+ *
+ * The interface is that:
+ *
+ * 1. Call decode433Init() with the table of protocols to look for.
+ * 2. Feed the pulses in with one of:
+ *    - decode433Pulse() for (level, duration in us) pairs.
+ *    - decode433Sampled() for runs from the I2S receiver; this is an
+ *      EDGE433_SINK so it can be given directly to i2sRxInit().
+ *    - decode433Timestamp() for edges timestamped by a GPIO interrupt.
+ * 3. The result callback is called for each payload.
+ */
+#define DECODE433_MAX_PROTOCOLS   4
+
+/**
+ * Any LOW longer than this is the end of a transmission; payloads that
+ * repeat within a transmission are reported as repeats.
+ */
+#define DECODE433_IDLE_US         150000
+
+/**
+ * The I2S receiver's sample period.
+ */
+#define DECODE433_DEFAULT_TICK_NS 12500
+
+typedef enum
+{
+  DECODE433_OK,
+  DECODE433_BAD_CHECK
+} DECODE433_STATUS;
+
+typedef struct decode433_protocol
+{
+  const char *name;
+
+  // HIGH and LOW durations, in us, of the sync marker, zero and one.
+  uint16 sync_high;
+  uint16 sync_low;
+  uint16 zero_high;
+  uint16 zero_low;
+  uint16 one_high;
+  uint16 one_low;
+
+  // Allowed error on each duration, percent.
+  uint8 tolerance;
+
+  // Bits in the payload; at most 32.
+  uint8 bits;
+
+  // Optional payload check, such as a checksum.  NULL to accept anything.
+  bool (*check)(uint32 payload);
+} DECODE433_PROTOCOL;
+
+typedef void (*DECODE433_RESULT)(void *arg,
+    const DECODE433_PROTOCOL *protocol, uint32 payload,
+    DECODE433_STATUS status, uint8 repeat);
+
+/**
+ * Per-protocol matching state.
+ */
+typedef struct decode433_match
+{
+  bool synced;
+  bool have_high;
+  uint8 nbits;
+  uint8 repeat;
+  uint16 high;
+  uint32 bits;
+  uint32 last;
+  bool have_last;
+} DECODE433_MATCH;
+
+typedef struct decode433
+{
+  const DECODE433_PROTOCOL *protocols;
+  int count;
+  DECODE433_MATCH match[DECODE433_MAX_PROTOCOLS];
+  DECODE433_RESULT result;
+  void *arg;
+
+  // Sample period for decode433Sampled().
+  uint32 tick_ns;
+
+  // Previous edge for decode433Timestamp().
+  uint32 edge_us;
+  uint8 edge_level;
+  bool have_edge;
+} DECODE433;
+
+void ICACHE_FLASH_ATTR decode433Init(DECODE433 *decoder,
+    const DECODE433_PROTOCOL *protocols, int count,
+    DECODE433_RESULT result, void *arg);
+void ICACHE_FLASH_ATTR decode433Reset(DECODE433 *decoder);
+void ICACHE_FLASH_ATTR decode433Pulse(DECODE433 *decoder,
+    uint8 level, uint32 us);
+void ICACHE_FLASH_ATTR decode433Sampled(void *decoder,
+    uint8 level, uint32 ticks);
+void ICACHE_FLASH_ATTR decode433Timestamp(DECODE433 *decoder,
+    uint8 level, uint32 time_us);
+
+#endif
@@ -0,0 +1,131 @@
+/******************************************************************************
+ * Turn oversampled receiver words into (level, duration) runs.
+ *
+ * Almost every word the receiver captures is either all ones or all zeros
+ * because a 433MHz unit of 400us is exactly one 32-bit word at the I2S rate,
+ * so the common case is a single compare and an add.  Only words that hold
+ * an edge are walked bit by bit.
+ *
+ * Runs shorter than the glitch limit are absorbed into the preceding run
+ * which removes the spikes that cheap superregenerative receivers produce.
+ *
+ *****************************************************************************/
+
+#include "edge433.h"
+
+/**
+ * A run has ended; either merge it into the pending run or pass the pending
+ * run on and make this one pending instead.
+ */
+LOCAL void ICACHE_FLASH_ATTR edge433Run(EDGE433_SCANNER *scanner)
+{
+  if ((scanner->pending != 0) &&
+      ((scanner->run < scanner->glitch_ticks) ||
+       (scanner->level == scanner->pending_level)))
+  {
+    scanner->pending += scanner->run;
+  }
+  else
+  {
+    if (scanner->pending != 0)
+    {
+      scanner->sink(scanner->arg, scanner->pending_level, scanner->pending);
+    }
+    scanner->pending_level = scanner->level;
+    scanner->pending = scanner->run;
+  }
+  scanner->run = 0;
+}
+
+/**
+ * The line has not changed for a long time so report everything that we
+ * have, including the idle run itself so the receiver can see the gap.
+ */
+LOCAL void ICACHE_FLASH_ATTR edge433Idle(EDGE433_SCANNER *scanner)
+{
+  edge433Run(scanner);
+  edge433Flush(scanner);
+  scanner->idle = TRUE;
+}
+
+void ICACHE_FLASH_ATTR edge433Init(EDGE433_SCANNER *scanner,
+    uint32 glitch_ticks, uint32 idle_ticks, EDGE433_SINK sink, void *arg)
+{
+  os_memset(scanner, 0, sizeof(*scanner));
+  scanner->glitch_ticks = glitch_ticks;
+  scanner->idle_ticks = idle_ticks;
+  scanner->sink = sink;
+  scanner->arg = arg;
+
+  // Until we see the first edge the line is treated as an idle low.
+  scanner->idle = TRUE;
+}
+
+void ICACHE_FLASH_ATTR edge433Scan(EDGE433_SCANNER *scanner,
+    const uint32 *words, int count)
+{
+  uint32 steady;
+  uint32 word;
+  uint8 bit;
+  int ii;
+  int jj;
+
+  for (ii = 0; ii < count; ii++)
+  {
+    word = words[ii];
+    steady = scanner->level ? 0xFFFFFFFF : 0;
+
+    if (word == steady)
+    {
+      /**
+       * Fast path; no edge in this word.
+       */
+      if (!scanner->idle)
+      {
+        scanner->run += 32;
+      }
+    }
+    else
+    {
+      for (jj = 31; jj >= 0; jj--)
+      {
+        bit = (word >> jj) & 1;
+        if (bit == scanner->level)
+        {
+          if (!scanner->idle)
+          {
+            scanner->run++;
+          }
+        }
+        else
+        {
+          if (!scanner->idle)
+          {
+            edge433Run(scanner);
+          }
+          scanner->idle = FALSE;
+          scanner->level = bit;
+          scanner->run = 1;
+        }
+      }
+    }
+
+    if ((!scanner->idle) && (scanner->run >= scanner->idle_ticks))
+    {
+      edge433Idle(scanner);
+    }
+  }
+}
+
+/**
+ * Pass on the pending run, if any.  The run currently being measured is
+ * kept because it has not ended yet.
+ */
+void ICACHE_FLASH_ATTR edge433Flush(EDGE433_SCANNER *scanner)
+{
+  if (scanner->pending != 0)
+  {
+    scanner->sink(scanner->arg, scanner->pending_level, scanner->pending);
+    scanner->pending = 0;
+  }
+}
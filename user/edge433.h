@@ -0,0 +1,52 @@
+#ifndef EDGE433_H
+#define EDGE433_H
+
+#include "portable.h"
+
+/**
+ * Edge extraction from an oversampled 433MHz receiver signal.
+ *
+ * The I2S receiver samples the data pin into 32-bit words, most significant
+ * bit first, and this code turns those words into a stream of
+ * (level, duration) pairs where the duration is measured in sample 'ticks'.
+ * The code keeps no history beyond the run currently being measured so it
+ * can be fed one DMA block at a time.
+ *
+ * 1. Call edge433Init() to set the glitch and idle limits and the sink.
+ * 2. Call edge433Scan() with each block of sampled words.
+ * 3. Optionally call edge433Flush() to push out the last run.
+ */
+
+/**
+ * Called for each completed run; level is 0 or 1.
+ */
+typedef void (*EDGE433_SINK)(void *arg, uint8 level, uint32 ticks);
+
+typedef struct edge433_scanner
+{
+  // Run currently being measured.
+  uint8 level;
+  uint32 run;
+
+  // Run that has been measured but not yet passed to the sink because a
+  // following glitch might still extend it.
+  uint8 pending_level;
+  uint32 pending;
+
+  // TRUE once the line has been stable for idle_ticks; the run has already
+  // been reported so we simply wait for the next edge.
+  bool idle;
+
+  uint32 glitch_ticks;
+  uint32 idle_ticks;
+  EDGE433_SINK sink;
+  void *arg;
+} EDGE433_SCANNER;
+
+void ICACHE_FLASH_ATTR edge433Init(EDGE433_SCANNER *scanner,
+    uint32 glitch_ticks, uint32 idle_ticks, EDGE433_SINK sink, void *arg);
+void ICACHE_FLASH_ATTR edge433Scan(EDGE433_SCANNER *scanner,
+    const uint32 *words, int count);
+void ICACHE_FLASH_ATTR edge433Flush(EDGE433_SCANNER *scanner);
+
+#endif
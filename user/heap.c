@@ -0,0 +1,123 @@
+/*
+ *  Heap headroom.  See heap.h.
+ *
+ *  The SDK has no call for the largest free block so it is found by binary
+ *  search, allocating and freeing blocks of decreasing size.  That takes a
+ *  dozen or so allocations which is why it is only done every
+ *  HEAP_SAMPLE_MS.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "mem.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "msg.h"
+#include "pool.h"
+#include "heap.h"
+
+#define HEAP_SAMPLE_MS		60000
+#define HEAP_REPORT_SAMPLES	60
+
+/**
+ * The largest block is found to within this many bytes.
+ */
+#define HEAP_PROBE_STEP		64
+
+static HEAP_STATUS heap_latest;
+static int heap_samples = 0;
+static os_timer_t heap_timer;
+
+/**
+ * The largest block that can be allocated, out of 'free' bytes.
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR heap_largest(uint32 free)
+{
+	uint32 low = 0;
+	uint32 high = free + 1;
+	uint32 mid;
+	void *block;
+
+	while (high - low > HEAP_PROBE_STEP)
+	{
+		mid = low + ((high - low) / 2);
+		block = os_malloc(mid);
+		if (block != NULL)
+		{
+			os_free(block);
+			low = mid;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return(low);
+}
+
+void ICACHE_FLASH_ATTR heap_sample(void)
+{
+	HEAP_STATUS *status = &heap_latest;
+
+	status->free = system_get_free_heap_size();
+	status->largest = heap_largest(status->free);
+	if ((heap_samples == 0) || (status->free < status->min_free))
+	{
+		status->min_free = status->free;
+	}
+	if ((heap_samples == 0) || (status->largest < status->min_largest))
+	{
+		status->min_largest = status->largest;
+	}
+
+	/**
+	 * 0% when the free heap is one block, approaching 100% as it is broken
+	 * into pieces too small to use.
+	 */
+	status->fragmentation = (status->free == 0) ? 0 :
+	    100 - ((status->largest * 100) / status->free);
+	heap_samples++;
+}
+
+void ICACHE_FLASH_ATTR heap_status(HEAP_STATUS *status)
+{
+	if (heap_samples == 0)
+	{
+		heap_sample();
+	}
+	os_memcpy(status, &heap_latest, sizeof(*status));
+}
+
+/**
+ * Log the heap and the pools.
+ */
+void ICACHE_FLASH_ATTR heap_report(void)
+{
+	HEAP_STATUS status;
+
+	heap_status(&status);
+	pool_report();
+	syslog(SMSG_HEAP_STATUS, status.free, status.min_free,
+	    status.largest, status.min_largest, status.fragmentation);
+}
+
+LOCAL void ICACHE_FLASH_ATTR heap_tick(void *arg)
+{
+	heap_sample();
+	if (heap_samples % HEAP_REPORT_SAMPLES == 0)
+	{
+		heap_report();
+	}
+}
+
+void ICACHE_FLASH_ATTR heap_setup(void)
+{
+	heap_sample();
+
+	os_timer_disarm(&heap_timer);
+	os_timer_setfn(&heap_timer, heap_tick, NULL);
+	os_timer_arm(&heap_timer, HEAP_SAMPLE_MS, TRUE);
+}
@@ -0,0 +1,32 @@
+/**
+ * Heap headroom.
+ *
+ * Our own buffers come from static pools (see pool.h) but the SDK, lwIP and
+ * espconn allocate from the heap as they go, so what matters is how much is
+ * left for them and whether it is in pieces big enough to use.  The heap is
+ * sampled every HEAP_SAMPLE_MS for the free bytes and, by trial allocation,
+ * the largest free block; the worst of each is kept.
+ *
+ * 1. Call heap_setup() once at boot.
+ * 2. heap_status() gives the latest figures and heap_report() logs them
+ *    along with the pools.  The report is also made every
+ *    HEAP_REPORT_SAMPLES samples.
+ */
+#ifndef HEAP_H
+#define HEAP_H
+
+typedef struct heap_status
+{
+	uint32 free;
+	uint32 min_free;
+	uint32 largest;
+	uint32 min_largest;
+	uint8 fragmentation;
+} HEAP_STATUS;
+
+void heap_setup(void);
+void heap_sample(void);
+void heap_status(HEAP_STATUS *status);
+void heap_report(void);
+
+#endif
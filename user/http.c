@@ -0,0 +1,733 @@
+/*
+ *  HTTP upload of sensor readings.  See http.h.
+ *
+ *  As many queued readings as fit in a TCP segment are sent together, as
+ *  pipelined GETs or with CFG_HTTP_BATCH as one POST, and stay at the front
+ *  of the queue until their responses come back.  A 2xx response removes
+ *  its readings, and a 4xx one too as sending them again would not help;
+ *  anything else leaves them for a retry, with whatever has been queued
+ *  since, after a back-off.  The responses to any later GETs are then not
+ *  waited for; the connection is closed and those readings sent again.
+ *  Only the status line and Content-Length of a response are looked at.
+ *  Without a Content-Length we cannot tell where the response ends so the
+ *  connection is closed and opened again for the next request.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "espconn.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "msg.h"
+#include "clock.h"
+#include "pool.h"
+#include "rodata.h"
+#include "sensor433.h"
+#include "http.h"
+
+/**
+ * Readings held for sending, and sensors whose last reading is remembered
+ * to skip repeats.
+ */
+#define HTTP_QUEUE		32
+#define HTTP_SENSORS		4
+
+/**
+ * The requests sent together are at most one TCP segment.  A POST body is
+ * built at HTTP_HEAD_MAX into the buffer and the headers then put in front
+ * of it; GETs start at the beginning.
+ */
+#define HTTP_BUF_SIZE		1460
+#define HTTP_HEAD_MAX		256
+#define HTTP_READING_MAX	256
+#define HTTP_LINE_MAX		48
+
+#define HTTP_REOPEN_MS		100
+#define HTTP_RETRY_MIN		2000
+#define HTTP_RETRY_MAX		(5 * 60 * 1000)
+#define HTTP_RESPONSE_MS	15000
+
+#ifdef CFG_HTTP_BATCH
+#define HTTP_HEAD_FMT \
+	"POST " CFG_HTTP_PAGE " HTTP/1.1\r\n" \
+	"Host: " CFG_HTTP_HOST "\r\n" \
+	"Content-Type: text/plain\r\n" \
+	"Content-Length: %d\r\n" \
+	"Connection: keep-alive\r\n" \
+	"\r\n"
+#define HTTP_READING_FMT	CFG_HTTP_ID "&" CFG_HTTP_DATA "\n"
+#define HTTP_BODY_START		HTTP_HEAD_MAX
+
+RODATA_ASSERT(http_head_fits, sizeof(HTTP_HEAD_FMT) + 8 <= HTTP_HEAD_MAX);
+#else
+#define HTTP_READING_FMT \
+	"GET " CFG_HTTP_PAGE "?" CFG_HTTP_ID "&" CFG_HTTP_DATA " HTTP/1.1\r\n" \
+	"Host: " CFG_HTTP_HOST "\r\n" \
+	"Connection: keep-alive\r\n" \
+	"\r\n"
+#define HTTP_BODY_START		0
+#endif
+
+// Room for the date, sign and digits in place of their formats.
+RODATA_ASSERT(http_reading_fits, sizeof(HTTP_READING_FMT) + 40 <= HTTP_READING_MAX);
+
+typedef struct http_reading
+{
+	uint32 payload;
+	uint32 time;		// SNTP seconds, 0 if not known.
+} HTTP_READING;
+
+typedef struct http_sensor
+{
+	uint32 id;
+	uint32 payload;
+	uint64 sent_us;
+} HTTP_SENSOR;
+
+POOL(http_buf_pool, HTTP_BUF_SIZE, 1);
+static char *http_buf;
+
+static HTTP_READING http_queue[HTTP_QUEUE];
+static int http_head = 0;
+static int http_count = 0;
+static int http_batch = 0;
+static uint32 http_dropped = 0;
+static HTTP_SENSOR http_sensors[HTTP_SENSORS];
+
+static struct espconn http_conn;
+static esp_tcp http_tcp;
+static ip_addr_t http_addr;
+static bool http_have_addr = FALSE;
+static bool http_online = FALSE;
+static bool http_resolving = FALSE;
+static bool http_connecting = FALSE;
+static bool http_connected = FALSE;
+static bool http_waiting = FALSE;
+static uint32 http_retry_ms = HTTP_RETRY_MIN;
+static os_timer_t http_retry_timer;
+static os_timer_t http_response_timer;
+
+/**
+ * The response so far; the line being read, lower cased, the status, how
+ * much of the body is still to come (-1 if we were not told) and whether
+ * we have all of it.
+ */
+static char http_line[HTTP_LINE_MAX];
+static int http_line_len;
+static int http_status;
+static bool http_in_body;
+static sint32 http_body_left;
+static bool http_complete;
+
+static void ICACHE_FLASH_ATTR http_send(void);
+
+/**
+ * SNTP seconds as a URL encoded "YYYY-MM-DD HH:MM:SS".
+ */
+static void ICACHE_FLASH_ATTR http_date(char *buf, uint32 secs)
+{
+	uint32 days = secs / 86400;
+	uint32 rem = secs % 86400;
+	uint32 era;
+	uint32 doe;
+	uint32 yoe;
+	uint32 doy;
+	uint32 mp;
+	int year;
+	int month;
+	int day;
+
+	/**
+	 * Days since 1970 to a date in the proleptic Gregorian calendar, with
+	 * the years starting on the 1st of March so leap days come last.
+	 */
+	days += 719468;
+	era = days / 146097;
+	doe = days - (era * 146097);
+	yoe = (doe - (doe / 1460) + (doe / 36524) - (doe / 146096)) / 365;
+	doy = doe - ((365 * yoe) + (yoe / 4) - (yoe / 100));
+	mp = ((5 * doy) + 2) / 153;
+	day = doy - (((153 * mp) + 2) / 5) + 1;
+	month = (mp < 10) ? mp + 3 : mp - 9;
+	year = yoe + (era * 400) + ((month <= 2) ? 1 : 0);
+
+	os_sprintf(buf, "%04d-%02d-%02d+%02d%%3A%02d%%3A%02d",
+	    year, month, day, rem / 3600, (rem / 60) % 60, rem % 60);
+}
+
+/**
+ * One reading as a GET, or as a line of the POST body.
+ */
+static int ICACHE_FLASH_ATTR http_format(char *buf, HTTP_READING *reading)
+{
+	char date[32];
+	sint32 tempf;
+
+	if (reading->time == 0)
+	{
+		os_strcpy(date, "now");
+	}
+	else
+	{
+		http_date(date, reading->time);
+	}
+
+	/**
+	 * Tenths of a degree F, with the sign on its own as -0.5 would
+	 * otherwise lose it.
+	 */
+	tempf = ((sensor433_temp(reading->payload) * 9) / 5) + 320;
+	return(os_sprintf(buf, HTTP_READING_FMT,
+	    date, (tempf < 0) ? "-" : "", ((tempf < 0) ? -tempf : tempf) / 10,
+	    ((tempf < 0) ? -tempf : tempf) % 10));
+}
+
+/**
+ * Send again after 'ms'; until then nothing is sent.
+ */
+static void ICACHE_FLASH_ATTR http_later(uint32 ms)
+{
+	http_waiting = TRUE;
+	os_timer_disarm(&http_retry_timer);
+	os_timer_arm(&http_retry_timer, ms, FALSE);
+}
+
+/**
+ * Try again later, waiting twice as long each time.
+ */
+static void ICACHE_FLASH_ATTR http_retry(void)
+{
+	http_later(http_retry_ms);
+	http_retry_ms *= 2;
+	if (http_retry_ms > HTTP_RETRY_MAX)
+	{
+		http_retry_ms = HTTP_RETRY_MAX;
+	}
+}
+
+static void ICACHE_FLASH_ATTR http_retry_timeout(void *arg)
+{
+	http_waiting = FALSE;
+	http_send();
+}
+
+/**
+ * Get ready to read a response.
+ */
+static void ICACHE_FLASH_ATTR http_response_start(void)
+{
+	http_line_len = 0;
+	http_status = 0;
+	http_in_body = FALSE;
+	http_body_left = -1;
+	http_complete = FALSE;
+}
+
+/**
+ * A response has come, or the request is over some other way (status 0).
+ * A POST's response is for all the readings in flight and a GET's for the
+ * first of them.
+ */
+static void ICACHE_FLASH_ATTR http_done(int status)
+{
+	int done;
+
+	os_timer_disarm(&http_response_timer);
+	if (http_batch == 0)
+	{
+		return;
+	}
+#ifdef CFG_HTTP_BATCH
+	done = http_batch;
+#else
+	done = 1;
+#endif
+
+	if ((status >= 200) && (status < 500))
+	{
+		if (status < 300)
+		{
+			syslog(SMSG_HTTP_OK, status);
+		}
+		else
+		{
+			syslog(SMSG_HTTP_FAILED, status);
+		}
+		http_head = (http_head + done) % HTTP_QUEUE;
+		http_count -= done;
+		http_batch -= done;
+		http_retry_ms = HTTP_RETRY_MIN;
+		if (http_batch != 0)
+		{
+			// The response to the next GET.
+			http_response_start();
+			os_timer_arm(&http_response_timer, HTTP_RESPONSE_MS, FALSE);
+		}
+		else if (http_connected)
+		{
+			http_send();
+		}
+		return;
+	}
+
+	syslog(SMSG_HTTP_FAILED, status);
+	if ((http_batch > done) && http_connected)
+	{
+		/**
+		 * Responses to later GETs are still to come; close the connection
+		 * rather than read them, and send those readings again.
+		 */
+		os_timer_arm(&http_response_timer, 1, FALSE);
+	}
+	http_batch = 0;
+	http_retry();
+}
+
+/**
+ * The connection has gone; whatever was in flight has failed unless its
+ * response was complete.
+ */
+static void ICACHE_FLASH_ATTR http_closed(void)
+{
+	http_connected = FALSE;
+	http_connecting = FALSE;
+	http_done(http_complete ? http_status : 0);
+
+	// Any GETs after a complete response are sent again.
+	http_batch = 0;
+	os_timer_disarm(&http_response_timer);
+}
+
+static void ICACHE_FLASH_ATTR http_connected_cb(void *arg)
+{
+	CONSOLE_INFO("http: connected");
+	http_connected = TRUE;
+	http_connecting = FALSE;
+	espconn_set_opt(&http_conn, ESPCONN_NODELAY);
+	http_send();
+}
+
+/**
+ * Closed by either end; open it again if there is more to send.
+ */
+static void ICACHE_FLASH_ATTR http_disconnected_cb(void *arg)
+{
+	CONSOLE_INFO("http: disconnected");
+	http_closed();
+	if ((http_count > 0) && (!http_waiting))
+	{
+		http_later(HTTP_REOPEN_MS);
+	}
+}
+
+static void ICACHE_FLASH_ATTR http_error_cb(void *arg, sint8 err)
+{
+	CONSOLE_WARN("http: connection error: %d", err);
+
+	// The server may have moved.
+	http_have_addr = FALSE;
+	http_closed();
+	if (!http_waiting)
+	{
+		http_retry();
+	}
+}
+
+static void ICACHE_FLASH_ATTR http_sent_cb(void *arg)
+{
+	syslog(SMSG_HTTP_SENT);
+}
+
+/**
+ * The number at 'text', after any spaces; -1 if there is none.
+ */
+static sint32 ICACHE_FLASH_ATTR http_number(const char *text)
+{
+	sint32 value = -1;
+
+	while (*text == ' ')
+	{
+		text++;
+	}
+	while ((*text >= '0') && (*text <= '9'))
+	{
+		value = ((value < 0) ? 0 : value * 10) + (*text++ - '0');
+	}
+	return(value);
+}
+
+/**
+ * A header line, or the status line, has been read.
+ */
+static void ICACHE_FLASH_ATTR http_header(void)
+{
+	if (http_status == 0)
+	{
+		if ((http_line_len > 9) && (os_strncmp(http_line, "http/", 5) == 0))
+		{
+			http_status = http_number(&http_line[9]);
+		}
+		else
+		{
+			http_status = -1;
+		}
+	}
+	else if (http_line_len == 0)
+	{
+		if (http_body_left < 0)
+		{
+			/**
+			 * No length so no telling where the next response would start;
+			 * close the connection, which cannot be done from here.
+			 */
+			http_complete = TRUE;
+			os_timer_disarm(&http_response_timer);
+			os_timer_arm(&http_response_timer, 1, FALSE);
+		}
+		else if (http_body_left == 0)
+		{
+			http_complete = TRUE;
+			http_done(http_status);
+		}
+		else
+		{
+			http_in_body = TRUE;
+		}
+	}
+	else if (os_strncmp(http_line, "content-length:", 15) == 0)
+	{
+		http_body_left = http_number(&http_line[15]);
+	}
+}
+
+static void ICACHE_FLASH_ATTR http_recv_cb(void *arg, char *data, unsigned short length)
+{
+	int ii = 0;
+	int skip;
+	char c;
+
+	// Anything after a response that ends the connection is ignored.
+	while ((ii < length) && (!http_complete))
+	{
+		if (http_in_body)
+		{
+			skip = length - ii;
+			if (skip > http_body_left)
+			{
+				skip = http_body_left;
+			}
+			ii += skip;
+			http_body_left -= skip;
+			if (http_body_left == 0)
+			{
+				http_in_body = FALSE;
+				http_complete = TRUE;
+				http_done(http_status);
+			}
+			continue;
+		}
+
+		c = data[ii++];
+		if (c == '\n')
+		{
+			http_line[http_line_len] = '\0';
+			http_header();
+			http_line_len = 0;
+		}
+		else if ((c != '\r') && (http_line_len < HTTP_LINE_MAX - 1))
+		{
+			http_line[http_line_len++] =
+			    ((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c;
+		}
+	}
+}
+
+/**
+ * The server has not answered, or the response was not one that we can
+ * follow with another request; close the connection.
+ */
+static void ICACHE_FLASH_ATTR http_response_timeout(void *arg)
+{
+	if (!http_complete)
+	{
+		CONSOLE_WARN("http: no response");
+	}
+	espconn_disconnect(&http_conn);
+}
+
+static void ICACHE_FLASH_ATTR http_connect(void)
+{
+	sint8 rc;
+
+	os_memcpy(http_tcp.remote_ip, &http_addr, 4);
+	http_tcp.local_port = espconn_port();
+	http_connecting = TRUE;
+	rc = espconn_connect(&http_conn);
+	if (rc != 0)
+	{
+		http_connecting = FALSE;
+		http_error_cb(&http_conn, rc);
+	}
+}
+
+static void ICACHE_FLASH_ATTR http_dns_callback(const char *hostname, ip_addr_t *addr, void *arg)
+{
+	http_resolving = FALSE;
+	if (addr == NULL)
+	{
+		syslog(SMSG_HTTP_DNS_FAILED, CFG_HTTP_HOST, (int)arg);
+		http_error_cb(&http_conn, ESPCONN_ARG);
+		return;
+	}
+
+	os_memcpy(&http_addr, addr, sizeof(http_addr));
+	http_have_addr = TRUE;
+	if (http_online)
+	{
+		http_connect();
+	}
+}
+
+/**
+ * Look the server up, if need be, and connect to it.
+ */
+static void ICACHE_FLASH_ATTR http_open(void)
+{
+	err_t error;
+
+	if (http_connecting || http_resolving)
+	{
+		return;
+	}
+	if (http_have_addr)
+	{
+		http_connect();
+		return;
+	}
+
+	http_resolving = TRUE;
+	error = espconn_gethostbyname(&http_conn, CFG_HTTP_HOST, &http_addr,
+	    http_dns_callback);
+	if (error == ESPCONN_OK)
+	{
+		// An IP address, or already known.
+		http_dns_callback(CFG_HTTP_HOST, &http_addr, NULL);
+	}
+	else if (error != ESPCONN_INPROGRESS)
+	{
+		http_dns_callback(CFG_HTTP_HOST, NULL, (void *)(int)error);
+	}
+}
+
+/**
+ * Send as many of the queued readings as fit in a segment.
+ */
+static void ICACHE_FLASH_ATTR http_send(void)
+{
+	char reading[HTTP_READING_MAX];
+#ifdef CFG_HTTP_BATCH
+	char head[HTTP_HEAD_MAX];
+#endif
+	char *body = &http_buf[HTTP_BODY_START];
+	int head_len = 0;
+	int reading_len;
+	int total = 0;
+	int count;
+	sint8 rc;
+
+	if ((!http_online) || (http_count == 0) || (http_batch != 0) ||
+	    (http_waiting))
+	{
+		return;
+	}
+	if (!http_connected)
+	{
+		http_open();
+		return;
+	}
+
+	for (count = 0; count < http_count; count++)
+	{
+		reading_len = http_format(reading,
+		    &http_queue[(http_head + count) % HTTP_QUEUE]);
+		if (HTTP_BODY_START + total + reading_len > HTTP_BUF_SIZE)
+		{
+			break;
+		}
+		os_memcpy(&body[total], reading, reading_len);
+		total += reading_len;
+	}
+
+#ifdef CFG_HTTP_BATCH
+	head_len = os_sprintf(head, HTTP_HEAD_FMT, total);
+	os_memcpy(body - head_len, head, head_len);
+#endif
+	http_response_start();
+
+	rc = espconn_sent(&http_conn, (uint8 *)(body - head_len), head_len + total);
+	if (rc != 0)
+	{
+		// Left queued; tried again with the next reading.
+		CONSOLE_ERROR("http: sent failed: %d", rc);
+		return;
+	}
+	http_batch = count;
+	os_timer_disarm(&http_response_timer);
+	os_timer_arm(&http_response_timer, HTTP_RESPONSE_MS, FALSE);
+	CONSOLE_DEBUG("http: %d readings, %d bytes", count, head_len + total);
+}
+
+/**
+ * A queued reading has been dropped: if it is still the last one recorded
+ * for its sensor, forget the sensor so that the next copy of it is sent.
+ */
+static void ICACHE_FLASH_ATTR http_forget(uint32 payload)
+{
+	int ii;
+
+	for (ii = 0; ii < HTTP_SENSORS; ii++)
+	{
+		if (http_sensors[ii].payload == payload)
+		{
+			http_sensors[ii].payload = 0;
+			http_sensors[ii].sent_us = 0;
+			return;
+		}
+	}
+}
+
+/**
+ * Queue a reading unless it is a repeat that is not yet due.
+ */
+bool ICACHE_FLASH_ATTR http_reading(uint32 payload)
+{
+	uint64 now = clock_us64();
+	uint32 id = payload & ~(CFG_TEMP_MASK | CFG_CHECKSUM_MASK);
+	HTTP_SENSOR *sensor = NULL;
+	HTTP_SENSOR *oldest = &http_sensors[0];
+	HTTP_READING *reading;
+	int ii;
+
+	for (ii = 0; ii < HTTP_SENSORS; ii++)
+	{
+		if ((http_sensors[ii].payload != 0) && (http_sensors[ii].id == id))
+		{
+			sensor = &http_sensors[ii];
+			break;
+		}
+		if (http_sensors[ii].sent_us < oldest->sent_us)
+		{
+			oldest = &http_sensors[ii];
+		}
+	}
+
+	if ((sensor != NULL) && (sensor->payload == payload) &&
+	    (now - sensor->sent_us < CFG_HTTP_INTERVAL))
+	{
+		return(FALSE);
+	}
+
+	/**
+	 * When full, the oldest reading goes unless it is in the request
+	 * being sent, in which case this one does.  Either way the sensor
+	 * is left as it was, so that the next copy of what was dropped is
+	 * not taken for a repeat.
+	 */
+	if (http_count == HTTP_QUEUE)
+	{
+		http_dropped++;
+		CONSOLE_WARN("http: queue full, %d dropped", http_dropped);
+		if (http_batch != 0)
+		{
+			return(TRUE);
+		}
+		http_forget(http_queue[http_head].payload);
+		http_head = (http_head + 1) % HTTP_QUEUE;
+		http_count--;
+	}
+	reading = &http_queue[(http_head + http_count) % HTTP_QUEUE];
+	reading->payload = payload;
+	reading->time = (uint32)(clock_wall_us() / 1000000);
+	http_count++;
+
+	if (sensor == NULL)
+	{
+		sensor = oldest;
+		sensor->id = id;
+	}
+	sensor->payload = payload;
+	sensor->sent_us = now;
+
+	http_send();
+	return(TRUE);
+}
+
+/**
+ * How many readings are waiting to go.
+ */
+int ICACHE_FLASH_ATTR http_queued(void)
+{
+	return(http_count);
+}
+
+void ICACHE_FLASH_ATTR http_start(void)
+{
+	if (http_buf == NULL)
+	{
+		return;
+	}
+	http_online = TRUE;
+	http_waiting = FALSE;
+	http_retry_ms = HTTP_RETRY_MIN;
+	os_timer_disarm(&http_retry_timer);
+	http_send();
+}
+
+void ICACHE_FLASH_ATTR http_stop(void)
+{
+	http_online = FALSE;
+	if (http_connected || http_connecting)
+	{
+		espconn_disconnect(&http_conn);
+	}
+	http_closed();
+	http_waiting = FALSE;
+	os_timer_disarm(&http_retry_timer);
+}
+
+void ICACHE_FLASH_ATTR http_setup(void)
+{
+	/**
+	 * Only once.  Without the buffer http_start() does nothing so the
+	 * readings are never sent.
+	 */
+	if (http_buf != NULL)
+	{
+		return;
+	}
+	http_buf = (char *)pool_alloc(&http_buf_pool);
+	if (http_buf == NULL)
+	{
+		CONSOLE_ERROR("http: no buffer, not uploading");
+		return;
+	}
+
+	os_timer_disarm(&http_retry_timer);
+	os_timer_setfn(&http_retry_timer, (os_timer_func_t *)http_retry_timeout, NULL);
+	os_timer_disarm(&http_response_timer);
+	os_timer_setfn(&http_response_timer,
+	    (os_timer_func_t *)http_response_timeout, NULL);
+
+	http_conn.type = ESPCONN_TCP;
+	http_conn.state = ESPCONN_NONE;
+	http_conn.proto.tcp = &http_tcp;
+	http_tcp.remote_port = CFG_HTTP_PORT;
+	espconn_regist_connectcb(&http_conn, http_connected_cb);
+	espconn_regist_disconcb(&http_conn, http_disconnected_cb);
+	espconn_regist_reconcb(&http_conn, http_error_cb);
+	espconn_regist_recvcb(&http_conn, http_recv_cb);
+	espconn_regist_sentcb(&http_conn, http_sent_cb);
+}
@@ -0,0 +1,30 @@
+/**
+ * Uploads the readings heard from 433MHz sensors to an HTTP server.
+ *
+ * Each reading is sent to CFG_HTTP_HOST as the query of a GET, as
+ * wunderground takes them, or with CFG_HTTP_BATCH as a line of a POST body
+ * for a server that takes several at once.  Requests are pipelined over a
+ * connection that is kept open between them.  A reading that
+ * is the same as the last one sent for that sensor is skipped until
+ * CFG_HTTP_INTERVAL has passed.  Readings are queued until the server has
+ * accepted them, so those heard while it cannot be reached go together in
+ * the next request; if the queue fills, the oldest are dropped.
+ *
+ * 1. Call http_setup() once at boot.
+ * 2. Call http_start() when we have an IP address and http_stop() when we
+ *    lose it.
+ * 3. Pass each valid payload to http_reading(), which is FALSE if it is
+ *    unchanged and not due to be sent.
+ *
+ * These must not be called from interrupts.
+ */
+#ifndef HTTP_H
+#define HTTP_H
+
+void http_setup(void);
+void http_start(void);
+void http_stop(void);
+bool http_reading(uint32 payload);
+int http_queued(void);
+
+#endif
@@ -16,12 +16,11 @@
 
 #define DEBUG
 
-#ifdef DEBUG
-#define CONSOLE(FMT, args...) \
-        ets_uart_printf(FMT,  ##args); ets_uart_printf("\n")
-#else
-#define CONSOLE(FMT, args...)
-#endif
+/**
+ * The register dumps are CONSOLE_DEBUG; the progress of each send is
+ * traced (see trace.h).
+ */
+#define CONSOLE_LEVEL CONSOLE_LEVEL_INFO
 
 /**
  * The original code was written for the FreeRTOS operating system but this
@@ -40,11 +39,18 @@
 #include "ets_sys.h"
 #include "osapi.h"
 #include "os_type.h"
-#include "mem.h"
+#include "user_interface.h"
 #include "driver/i2s_reg.h"
 #include "driver/slc_register.h"
 #include "driver/sdio_slv.h"
 #include "driver/i2s_433.h"
+#include "driver/i2s_rx433.h"
+#include "config.h"
+#include "logging.h"
+#include "trace.h"
+#include "pool.h"
+#include "syslog.h"
+#include "msg.h"
 
 /**
  * We need some defines that aren't in some RTOS SDK versions. Define them
@@ -102,17 +108,7 @@
 /**
  * Each 433MHz transmission is the data sent 7 times plus a short start frame.
  */
-#define I2SDMABUFCNT 7
-
-/**
- * Key counters that define the signal.  The HIGH is '1 unit' and the
- * values below denote the length of the LOW that forms the value, in
- * 'units'.
- */
-#define I2S_LOW_ZERO  4
-#define I2S_LOW_ONE   8
-#define I2S_LOW_VAL_MAX 8
-#define I2S_LOW_FRAME 19
+#define I2SDMABUFCNT I2S_FRAME_REPEATS
 
 /**
  * The encoding of each data frame is that:
@@ -131,22 +127,94 @@
     (1 + I2S_LOW_FRAME + 32 * (1 + I2S_LOW_VAL_MAX) + 1 + I2S_LOW_ZERO)
 
 /**
- * Data buffers that will hold the representation of the data frames. We
- * allocate the actually data buffers but the final frame is two units,
- * a high which marks the end of the last data frame and then low so we
- * just put this on the stack.
+ * Data buffers for streamed signals, which need a buffer per block.
+ * The start frame is a single frame marker that goes before every data
+ * frame so it is static.
  */
+POOL(i2s_tx_pool, I2SDMABUFLEN * 4, I2SDMABUFCNT);
 static uint32 *i2sBuf[I2SDMABUFCNT];
 static uint32 i2sBuf0[1 + I2S_LOW_FRAME];
 static uint32 *i2s_write_ptr;
 static uint32 i2s_write_len;
-#ifdef DEBUG
+
 /**
- * Debug only field which checks that we have not written off the end of
- * the data buffer.
+ * Data frames are encoded once into a frame from the pool.  Every repeat
+ * of a send is a descriptor pointing at the same frame and a frame can be
+ * queued for sending any number of times, so 'refs' counts the holders: the
+ * caller, each queued send and the send in progress.  The last release
+ * puts it back in the pool.
  */
-static uint32 *i2s_dbg_write_end = NULL;
-#endif
+struct i2s_frame
+{
+  uint32 data[I2SDMABUFLEN];
+  uint16 length;
+  uint8 refs;
+};
+
+#define I2S_FRAME_COUNT 3
+POOL(i2s_frame_pool, sizeof(I2S_FRAME), I2S_FRAME_COUNT);
+
+/**
+ * The frame being built by i2sInitSignal() ... i2sTermSignal().
+ */
+static I2S_FRAME *i2s_build_frame = NULL;
+
+/**
+ * Frames waiting for the DMA and the one it is sending.
+ */
+#define I2S_SEND_QUEUE  4
+
+typedef struct i2s_send
+{
+  I2S_FRAME *frame;
+  uint8 repeats;
+} I2S_SEND;
+
+static I2S_SEND i2s_send_queue[I2S_SEND_QUEUE];
+static int i2s_send_head = 0;
+static int i2s_send_count = 0;
+static I2S_FRAME *i2s_send_frame = NULL;
+
+/**
+ * Where i2sPack() is writing a streamed signal, at the bit level, and the
+ * block that it must stop before.
+ */
+static int i2s_pack_buf;
+static int i2s_pack_word;
+static int i2s_pack_bits;
+static uint32 i2s_pack_acc;
+static int i2s_pack_end;
+
+/**
+ * A streamed signal (see i2sStreamStart()) uses the data buffers as a ring
+ * of blocks.  Each block has 'eof' set so the interrupt tells us as each one
+ * is sent and a task refills it from the source while the DMA sends the
+ * others.
+ *
+ * Pulses are pulled from the source I2S_STREAM_CHUNK at a time.  The ring
+ * must hold enough blocks to cover the time taken to refill one, which is
+ * measured, plus I2S_STREAM_LATENCY_US for the task to be run at all when
+ * the WiFi code is busy.
+ */
+#define I2S_STREAM_CHUNK        32
+#define I2S_STREAM_LATENCY_US   50000
+#define I2S_STREAM_BLOCK_US     ((I2SDMABUFLEN * 32 * I2S_TICK_NS) / 1000)
+
+static I2S_STREAM_SOURCE i2s_stream_source;
+static void *i2s_stream_arg;
+static uint32 i2s_stream_chunk[I2S_STREAM_CHUNK / 2];
+static int i2s_stream_next;
+static int i2s_stream_avail;
+static uint32 i2s_stream_rem;
+static bool i2s_stream_high;
+static bool i2s_stream_eos;
+static int i2s_stream_blocks;
+static uint32 i2s_stream_fill_max;
+static os_event_t i2s_stream_queue[I2SDMABUFCNT];
+static volatile bool i2s_stream_active = FALSE;
+static volatile int i2s_stream_last;
+static volatile bool i2s_stream_ready[I2SDMABUFCNT];
+static volatile uint32 i2s_stream_underruns = 0;
 
 /**
  * Various register settings etc that need to be stored and restored.
@@ -159,7 +227,8 @@ static volatile uint32 save_slc_int_clr;
  * chain of buffer descriptors.  In the MP3 example this is a continuous
  * loop but in our case we set up a chain with a start and an end.
  *
- * There is one descriptor for each frame buffer, so 8.
+ * There is one descriptor for the start frame and one for each repeat or
+ * block, so 8.
  */
 static struct sdio_queue i2sBufDesc[I2SDMABUFCNT + 1];
 
@@ -195,26 +264,30 @@ static os_timer_t i2s_poll_timer = { 0 };
 void ICACHE_FLASH_ATTR i2sSetRate();
 LOCAL void ICACHE_FLASH_ATTR i2sWrite433(int);
 LOCAL void ICACHE_FLASH_ATTR i2sWriteI2s(int valueOne);
+LOCAL void i2sStreamEof(void);
+LOCAL void ICACHE_FLASH_ATTR i2sStreamTask(os_event_t *event);
+LOCAL void ICACHE_FLASH_ATTR i2sStartSignal(void);
+LOCAL void ICACHE_FLASH_ATTR i2sSendNext(void);
 
 
 LOCAL void reg_dump()
 {
-	CONSOLE("SLC_CONF0:        %lu", READ_PERI_REG(SLC_CONF0));
-	CONSOLE("SLC_INT_CLR:      %lu", READ_PERI_REG(SLC_INT_CLR));
-	CONSOLE("SLC_RX_DSCR_CONF: %lu", READ_PERI_REG(SLC_RX_DSCR_CONF));
-	CONSOLE("I2SCONF:          %lu", READ_PERI_REG(I2SCONF));
-	CONSOLE("I2S_FIFO_CONF:    %lu", READ_PERI_REG(I2S_FIFO_CONF));
-	CONSOLE("I2S_FIFO_CONF:    %lu", READ_PERI_REG(I2S_FIFO_CONF));
-	CONSOLE("I2S_FIFO_CONF:    %lu", READ_PERI_REG(I2S_FIFO_CONF));
-	CONSOLE("I2S_FIFO_CONF:    %lu", READ_PERI_REG(I2S_FIFO_CONF));
-	CONSOLE("I2SINT_CLR:       %lu", READ_PERI_REG(I2SINT_CLR));
-	CONSOLE("I2SINT_ENA:       %lu", READ_PERI_REG(I2SINT_ENA));
-	CONSOLE("I2SINT_CLR:       %lu", READ_PERI_REG(I2SINT_CLR));
-	CONSOLE("SLC_TX_LINK:      %lu", READ_PERI_REG(SLC_TX_LINK));
-	CONSOLE("SLC_RX_LINK:      %lu", READ_PERI_REG(SLC_RX_LINK));
-	CONSOLE("SLC_INT_ENA:      %lu", READ_PERI_REG(SLC_INT_ENA));
-	CONSOLE("SLC_INT_CLR:      %lu", READ_PERI_REG(SLC_INT_CLR));
-	CONSOLE("SLC_INT_STATUS:   %lu", READ_PERI_REG(SLC_INT_STATUS));
+	CONSOLE_DEBUG("SLC_CONF0:        %lu", READ_PERI_REG(SLC_CONF0));
+	CONSOLE_DEBUG("SLC_INT_CLR:      %lu", READ_PERI_REG(SLC_INT_CLR));
+	CONSOLE_DEBUG("SLC_RX_DSCR_CONF: %lu", READ_PERI_REG(SLC_RX_DSCR_CONF));
+	CONSOLE_DEBUG("I2SCONF:          %lu", READ_PERI_REG(I2SCONF));
+	CONSOLE_DEBUG("I2S_FIFO_CONF:    %lu", READ_PERI_REG(I2S_FIFO_CONF));
+	CONSOLE_DEBUG("I2S_FIFO_CONF:    %lu", READ_PERI_REG(I2S_FIFO_CONF));
+	CONSOLE_DEBUG("I2S_FIFO_CONF:    %lu", READ_PERI_REG(I2S_FIFO_CONF));
+	CONSOLE_DEBUG("I2S_FIFO_CONF:    %lu", READ_PERI_REG(I2S_FIFO_CONF));
+	CONSOLE_DEBUG("I2SINT_CLR:       %lu", READ_PERI_REG(I2SINT_CLR));
+	CONSOLE_DEBUG("I2SINT_ENA:       %lu", READ_PERI_REG(I2SINT_ENA));
+	CONSOLE_DEBUG("I2SINT_CLR:       %lu", READ_PERI_REG(I2SINT_CLR));
+	CONSOLE_DEBUG("SLC_TX_LINK:      %lu", READ_PERI_REG(SLC_TX_LINK));
+	CONSOLE_DEBUG("SLC_RX_LINK:      %lu", READ_PERI_REG(SLC_RX_LINK));
+	CONSOLE_DEBUG("SLC_INT_ENA:      %lu", READ_PERI_REG(SLC_INT_ENA));
+	CONSOLE_DEBUG("SLC_INT_CLR:      %lu", READ_PERI_REG(SLC_INT_CLR));
+	CONSOLE_DEBUG("SLC_INT_STATUS:   %lu", READ_PERI_REG(SLC_INT_STATUS));
 }
 
 
@@ -235,11 +308,24 @@ LOCAL void slc_isr(void *arg) {
   WRITE_PERI_REG(SLC_INT_CLR, 0xffffffff); //slc_intr_status);
 
   if (slc_intr_status & SLC_RX_EOF_INT_ST) {
-    //The DMA subsystem is done.
+    if (i2s_stream_active) {
+      // One block of a streamed signal has gone.
+      i2sStreamEof();
+    } else {
+      //The DMA subsystem is done.
 #ifdef DEBUG
-    slc_dbg_send_end = system_get_time();
+      slc_dbg_send_end = system_get_time();
 #endif
-    slc_send_active = FALSE;
+      slc_send_active = FALSE;
+      syslog_isr(SMSG_I2S_DMA_DONE, slc_intr_status, 0);
+    }
+  }
+
+  /**
+   * The receiver shares the SLC interrupt so pass on anything for it.
+   */
+  if (slc_intr_status & (SLC_TX_EOF_INT_ST|SLC_TX_DSCR_ERR_INT_ST)) {
+    i2sRxIsr(slc_intr_status);
   }
 }
 
@@ -251,7 +337,7 @@ LOCAL void slc_isr(void *arg) {
  */
 uint32 slc_dbg_get_send_time(void)
 {
-  CONSOLE("Times: %d, %d", slc_dbg_send_start, slc_dbg_send_end);
+  CONSOLE_INFO("Times: %d, %d", slc_dbg_send_start, slc_dbg_send_end);
   return(slc_dbg_send_end - slc_dbg_send_start);
 }
 #endif
@@ -261,13 +347,15 @@ uint32 slc_dbg_get_send_time(void)
  * user callback function when sending is complete.
  */
 LOCAL void slc_isr_poll(void *arg) {
-  CONSOLE("DMA poll...");
+  TRACE1(TRACE_I2S_POLL, slc_send_active);
   if (slc_send_active) {
-    CONSOLE("DMA send still active");
     return;
   }
-  CONSOLE("DMA send has completed");
+  TRACE0(TRACE_I2S_DONE);
   os_timer_disarm(&i2s_poll_timer);
+  if (i2s_stream_underruns != 0) {
+    CONSOLE_WARN("Stream underruns: %d", i2s_stream_underruns);
+  }
 
   // Stop the DMA - probably not need 'belt-n-braces'.
   CLEAR_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_START);
@@ -282,11 +370,94 @@ LOCAL void slc_isr_poll(void *arg) {
   // it simply not transmitting correctly?  Is the ilnk from memory -> SLC etc
   // Somehow broken?
 
+  // The DMA has finished with the frame.
+  if (i2s_send_frame != NULL) {
+    i2sFrameRelease(i2s_send_frame);
+    i2s_send_frame = NULL;
+  }
+
   if (i2s_callback != NULL) {
-    CONSOLE("DMA all done");
+    CONSOLE_DEBUG("DMA all done");
     i2s_callback();
   }
-  ets_uart_printf("+");
+
+  i2sSendNext();
+}
+
+/**
+ * Initialize the DMA buffer descriptors so that they reference the buffers
+ * and also causes the DMA to stop and trigger the interrupt when sending
+ * the last buffer completed.
+ *
+ * Note that unlike the MP3 example, we are not creating a loop and we do
+ * not set 'eof = 1' for every buffer because we only care about sending
+ * all the data as a single logical block.
+ */
+LOCAL void ICACHE_FLASH_ATTR i2sLinkFrames(void)
+{
+  int ii;
+
+  for (ii = 1; ii <= I2SDMABUFCNT; ii++)
+  {
+    i2sBufDesc[ii].owner = 1;
+    i2sBufDesc[ii].eof = 0;
+    i2sBufDesc[ii].sub_sof = 0;
+    i2sBufDesc[ii].datalen = I2SDMABUFLEN * 4;
+    i2sBufDesc[ii].blocksize = I2SDMABUFLEN * 4;
+    i2sBufDesc[ii].buf_ptr = (uint32_t)&i2sBuf[ii-1][0];
+    i2sBufDesc[ii].unused = 0;
+    i2sBufDesc[ii].next_link_ptr = (uint32_t)&i2sBufDesc[ii + 1];
+  }
+
+  /**
+   * The first buffer descriptor is special; it references the start
+   * frame.
+   *
+   * The last buffer descriptor as present as it has no next_link_ptr
+   * and has the eof flag set.
+   */
+  i2sBufDesc[0].owner = 1;
+  i2sBufDesc[0].eof = 0;
+  i2sBufDesc[0].sub_sof = 0;
+  i2sBufDesc[0].datalen = (18 * 4);
+  i2sBufDesc[0].blocksize = (18 * 4);
+  i2sBufDesc[0].buf_ptr = (uint32_t)i2sBuf0;
+  i2sBufDesc[0].unused = 0;
+  i2sBufDesc[0].next_link_ptr = (uint32_t)&i2sBufDesc[1];
+
+  i2sBufDesc[I2SDMABUFCNT].eof = 1;
+  i2sBufDesc[I2SDMABUFCNT].next_link_ptr = 0;
+}
+
+/**
+ * Chain up a data frame to be sent 'repeats' times after the start frame.
+ * Every repeat's descriptor points at the same buffer.
+ */
+LOCAL void ICACHE_FLASH_ATTR i2sLinkFrame(I2S_FRAME *frame, int repeats)
+{
+  int ii;
+
+  for (ii = 1; ii <= repeats; ii++)
+  {
+    i2sBufDesc[ii].owner = 1;
+    i2sBufDesc[ii].eof = (ii == repeats) ? 1 : 0;
+    i2sBufDesc[ii].sub_sof = 0;
+    i2sBufDesc[ii].datalen = frame->length;
+    i2sBufDesc[ii].blocksize = I2SDMABUFLEN * 4;
+    i2sBufDesc[ii].buf_ptr = (uint32_t)&frame->data[0];
+    i2sBufDesc[ii].unused = 0;
+    i2sBufDesc[ii].next_link_ptr =
+        (ii == repeats) ? 0 : (uint32_t)&i2sBufDesc[ii + 1];
+  }
+
+  i2sBufDesc[0].owner = 1;
+  i2sBufDesc[0].eof = 0;
+  i2sBufDesc[0].sub_sof = 0;
+  i2sBufDesc[0].datalen = (18 * 4);
+  i2sBufDesc[0].blocksize = (18 * 4);
+  i2sBufDesc[0].buf_ptr = (uint32_t)i2sBuf0;
+  i2sBufDesc[0].unused = 0;
+  i2sBufDesc[0].next_link_ptr = (uint32_t)&i2sBufDesc[1];
 }
 
 /**
@@ -308,7 +479,7 @@ LOCAL void slc_isr_poll(void *arg) {
  *  can use the 'datalen' field to ensure that we only send precisely the
  *  frame out which means we do not have any unexpected delays between frames.
  */
-void ICACHE_FLASH_ATTR i2sInit(I2S_SEND_COMPLETE callback) {
+bool ICACHE_FLASH_ATTR i2sInit(I2S_SEND_COMPLETE callback) {
 
   int ii;
 
@@ -316,18 +487,36 @@ void ICACHE_FLASH_ATTR i2sInit(I2S_SEND_COMPLETE callback) {
   // completes.
   i2s_callback = callback;
 
+  // Only the callback changes on a second call; the buffers, the DMA and
+  // the clocks are already set up.
+  if (i2sBuf[0] != NULL)
+  {
+    return(TRUE);
+  }
+
   // Set the poll timer callback.
   os_timer_disarm(&i2s_poll_timer);
   os_timer_setfn(&i2s_poll_timer, slc_isr_poll, NULL);
 
+  // The task that refills the blocks of a streamed signal.
+  system_os_task(i2sStreamTask, CFG_TASK_PRIO_I2S_STREAM,
+      i2s_stream_queue, I2SDMABUFCNT);
+
   // Allocate the buffer used to hold the data to send.
   for (ii = 0; ii < I2SDMABUFCNT; ii++)
   {
-      i2sBuf[ii] = (uint32 *)os_zalloc(I2SDMABUFLEN * 4);
+      i2sBuf[ii] = (uint32 *)pool_alloc(&i2s_tx_pool);
+      if (i2sBuf[ii] == NULL)
+      {
+          CONSOLE_ERROR("I2S send buffers not allocated");
+          while (ii-- > 0)
+          {
+              pool_free(&i2s_tx_pool, i2sBuf[ii]);
+              i2sBuf[ii] = NULL;
+          }
+          return(FALSE);
+      }
   }
-#ifdef DEBUG
-  i2s_dbg_write_end = &i2sBuf[0][I2SDMABUFLEN];
-#endif
 
   /* 0001 */
   //Reset DMA
@@ -347,45 +536,7 @@ void ICACHE_FLASH_ATTR i2sInit(I2S_SEND_COMPLETE callback) {
   CLEAR_PERI_REG_MASK(SLC_RX_DSCR_CONF,
       SLC_RX_FILL_EN|SLC_RX_EOF_MODE | SLC_RX_FILL_MODE);
 
-  /**
-   * Initialize the DMA buffer descriptors so that they reference the buffers
-   * and also causes the DMA to stop and trigger the interrupt when sending
-   * the last buffer completed.
-   *
-   * Note that unlike the MP3 example, we are not creating a loop and we do
-   * not set 'eof = 1' for every buffer because we only care about sending
-   * all the data as a single logical block.
-   */
-  for (ii = 1; ii <= I2SDMABUFCNT; ii++)
-  {
-    i2sBufDesc[ii].owner = 1;
-    i2sBufDesc[ii].eof = 0;
-    i2sBufDesc[ii].sub_sof = 0;
-    i2sBufDesc[ii].datalen = I2SDMABUFLEN * 4;
-    i2sBufDesc[ii].blocksize = I2SDMABUFLEN * 4;
-    i2sBufDesc[ii].buf_ptr = (uint32_t)&i2sBuf[ii-1][0];
-    i2sBufDesc[ii].unused = 0;
-    i2sBufDesc[ii].next_link_ptr = (uint32_t)&i2sBufDesc[ii + 1];
-  }
-
-  /**
-   * The first buffer descriptor is special; it references the start
-   * frame.
-   *
-   * The last buffer descriptor as present as it has no next_link_ptr
-   * and has the eof flag set.
-   */
-  i2sBufDesc[0].owner = 1;
-  i2sBufDesc[0].eof = 0;
-  i2sBufDesc[0].sub_sof = 0;
-  i2sBufDesc[0].datalen = (18 * 4);
-  i2sBufDesc[0].blocksize = (18 * 4);
-  i2sBufDesc[0].buf_ptr = (uint32_t)i2sBuf0;
-  i2sBufDesc[0].unused = 0;
-  i2sBufDesc[0].next_link_ptr = (uint32_t)&i2sBufDesc[1];
-
-  i2sBufDesc[I2SDMABUFCNT].eof = 1;
-  i2sBufDesc[I2SDMABUFCNT].next_link_ptr = 0;
+  i2sLinkFrames();
 
   /**
    * The start frame is a simple frame marker.
@@ -440,13 +591,14 @@ void ICACHE_FLASH_ATTR i2sInit(I2S_SEND_COMPLETE callback) {
       I2S_I2S_RX_WFULL_INT_CLR|I2S_I2S_PUT_DATA_INT_CLR|
       I2S_I2S_TAKE_DATA_INT_CLR);
 
-  //trans master&rece slave,MSB shift,right_first,msb right
+  //trans master,MSB shift,right_first,msb right; the receiver's mode is left
+  //to i2s_rx433.c
   CLEAR_PERI_REG_MASK(I2SCONF,
       I2S_TRANS_SLAVE_MOD| (I2S_BITS_MOD<<I2S_BITS_MOD_S)|
                          (I2S_BCK_DIV_NUM <<I2S_BCK_DIV_NUM_S)|
                          (I2S_CLKM_DIV_NUM<<I2S_CLKM_DIV_NUM_S));
   SET_PERI_REG_MASK(I2SCONF,
-      I2S_RIGHT_FIRST|I2S_MSB_RIGHT|I2S_RECE_SLAVE_MOD|
+      I2S_RIGHT_FIRST|I2S_MSB_RIGHT|
       I2S_RECE_MSB_SHIFT|I2S_TRANS_MSB_SHIFT|
       ((16&I2S_BCK_DIV_NUM )<<I2S_BCK_DIV_NUM_S)|
       ((7&I2S_CLKM_DIV_NUM)<<I2S_CLKM_DIV_NUM_S));
@@ -501,23 +653,36 @@ void ICACHE_FLASH_ATTR i2sInit(I2S_SEND_COMPLETE callback) {
   /* 0006 */
   // Set the send rate.
   i2sSetRate();
+  return(TRUE);
 }
 
 /**
- * Send the DMA.
+ * Send the data frame that has just been built by i2sInitSignal() ...
+ * i2sTermSignal(); it is queued to be sent I2SDMABUFCNT times.
  */
 void ICACHE_FLASH_ATTR i2sSendSignal(void) {
+  if (i2s_build_frame != NULL)
+  {
+    i2sSendFrame(i2s_build_frame, I2SDMABUFCNT);
+    i2sFrameRelease(i2s_build_frame);
+    i2s_build_frame = NULL;
+  }
+}
+
+/**
+ * Start the DMA on whatever chain has been linked.
+ */
+LOCAL void ICACHE_FLASH_ATTR i2sStartSignal(void) {
   //Start transmission
   if (slc_send_active)
   {
-    CONSOLE("Already sending...");
+    CONSOLE_WARN("Already sending...");
   }
   else
   {
-    CONSOLE("Start poll timer...");
     os_timer_arm(&i2s_poll_timer, I2S_POLL_TIMER_INTERVAL, TRUE);
 
-    CONSOLE("Start the DMA...");
+    TRACE0(TRACE_I2S_START);
     slc_send_active = TRUE;
 
 	/* 0007 */
@@ -567,23 +732,31 @@ void ICACHE_FLASH_ATTR i2sSetRate() {
       (I2S_BCK_DIV_NUM <<I2S_BCK_DIV_NUM_S)|
       (I2S_CLKM_DIV_NUM<<I2S_CLKM_DIV_NUM_S));
   SET_PERI_REG_MASK(I2SCONF,
-          (I2S_RIGHT_FIRST| I2S_MSB_RIGHT| I2S_RECE_SLAVE_MOD|
+          (I2S_RIGHT_FIRST| I2S_MSB_RIGHT|
           I2S_RECE_MSB_SHIFT| I2S_TRANS_MSB_SHIFT|
           (50<<I2S_BCK_DIV_NUM_S)|
           (40<<I2S_CLKM_DIV_NUM_S)));
 }
 
 /**
- * Reset the write pointers.
+ * Start building a data frame in a new frame from the pool.  If the pool is
+ * empty the frame is not built and i2sSendSignal() does nothing.
  */
 void ICACHE_FLASH_ATTR i2sInitSignal() {
-  int ii;
-
-  // Reset the DMA ready for the next start...
-  SET_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_RESET);
-  CLEAR_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_RESET);
+  if (i2s_build_frame != NULL)
+  {
+    i2sFrameRelease(i2s_build_frame);
+  }
+  i2s_build_frame = (I2S_FRAME *)pool_alloc(&i2s_frame_pool);
+  if (i2s_build_frame == NULL)
+  {
+    // Writes are dropped until the next frame.
+    i2s_write_len = I2SDMABUFLEN * 4;
+    return;
+  }
+  i2s_build_frame->refs = 1;
 
-  i2s_write_ptr = &i2sBuf[0][0];
+  i2s_write_ptr = &i2s_build_frame->data[0];
   i2s_write_len = 0;
   // i2sWriteFrame();
 }
@@ -596,7 +769,7 @@ void ICACHE_FLASH_ATTR i2sDataValue(uint32 data_433)
   uint32 mask = 0x80000000;
   int jj;
 
-  CONSOLE("Data: %u", data_433);
+  TRACE1(TRACE_I2S_DATA, data_433);
 
   for (jj = 0; jj < 32; jj++)
   {
@@ -613,13 +786,11 @@ void ICACHE_FLASH_ATTR i2sDataValue(uint32 data_433)
 }
 
 /**
- * Copy the written signal to the other three buffers and
- * set the frame length for each buffer descriptor.
+ * Close out the data frame and pad it to full length.  The repeats are
+ * descriptors pointing at this one frame so nothing is copied.
  */
 void ICACHE_FLASH_ATTR i2sTermSignal()
 {
-  int ii;
-
   /**
    * First close out the frame with 'zero' and pad with low.
    */
@@ -630,28 +801,117 @@ void ICACHE_FLASH_ATTR i2sTermSignal()
     i2sWriteI2s(FALSE);
   }
 
-  // Copy the same data frame into the other 6 data frames.
-  for (ii = 1; ii < I2SDMABUFCNT; ii++)
+  if (i2s_build_frame != NULL)
   {
-    os_memcpy(&i2sBuf[ii][0], &i2sBuf[0][0], (I2SDMABUFLEN * 4));
+    i2s_build_frame->length = i2s_write_len;
   }
-#if 0
-  // Set the length of data to transmit in each frame.
-  for (ii = 0; ii < (I2SDMABUFCNT - 1); ii++)
+  TRACE1(TRACE_I2S_WRITE_LEN, i2s_write_len);
+}
+
+/**
+ * Encode a data value into a frame that can be sent, repeatedly and to
+ * several destinations, with i2sSendFrame().  The caller holds the one
+ * reference and must release it with i2sFrameRelease().  Returns NULL if
+ * the pool is empty.
+ */
+I2S_FRAME * ICACHE_FLASH_ATTR i2sFrameData(uint32 data_433)
+{
+  I2S_FRAME *frame;
+
+  i2sInitSignal();
+  i2sDataValue(data_433);
+  i2sTermSignal();
+
+  frame = i2s_build_frame;
+  i2s_build_frame = NULL;
+  return(frame);
+}
+
+/**
+ * Take another reference to a frame.
+ */
+I2S_FRAME * ICACHE_FLASH_ATTR i2sFrameRef(I2S_FRAME *frame)
+{
+  frame->refs++;
+  return(frame);
+}
+
+/**
+ * Drop a reference; the frame goes back to the pool with the last one.
+ */
+void ICACHE_FLASH_ATTR i2sFrameRelease(I2S_FRAME *frame)
+{
+  if (frame == NULL)
   {
-    i2sBufDesc[ii].datalen = i2s_write_len;
+    return;
   }
-#endif
-#ifdef DEBUG
-  CONSOLE("write_len: %d", i2s_write_len);
-  if (i2s_write_ptr > i2s_dbg_write_end)
+  if (--frame->refs == 0)
   {
-    /**
-     * Oh dear, we wrote off the end of the data buffer!
-     */
-    CONSOLE("ERROR: Wrote off end of data buffer.");
+    pool_free(&i2s_frame_pool, frame);
   }
-#endif
+}
+
+/**
+ * Queue a frame to be sent 'repeats' times, up to I2S_FRAME_REPEATS, after
+ * a start frame.  The queue takes its own reference so the caller may
+ * release theirs straight away or keep it to send the frame again later.
+ * Returns FALSE if the queue is full.
+ */
+bool ICACHE_FLASH_ATTR i2sSendFrame(I2S_FRAME *frame, int repeats)
+{
+  I2S_SEND *send;
+
+  if ((frame == NULL) || (repeats <= 0) || (repeats > I2S_FRAME_REPEATS))
+  {
+    return(FALSE);
+  }
+  if (i2s_send_count >= I2S_SEND_QUEUE)
+  {
+    CONSOLE_WARN("Send queue full");
+    return(FALSE);
+  }
+
+  send = &i2s_send_queue[(i2s_send_head + i2s_send_count) % I2S_SEND_QUEUE];
+  send->frame = i2sFrameRef(frame);
+  send->repeats = repeats;
+  i2s_send_count++;
+  TRACE2(TRACE_I2S_FRAME, repeats, i2s_send_count);
+
+  i2sSendNext();
+  return(TRUE);
+}
+
+/**
+ * Is nothing being sent or queued?  A frame queued now starts straight
+ * away.
+ */
+bool ICACHE_FLASH_ATTR i2sSendIdle(void)
+{
+  return((!slc_send_active) && (i2s_send_count == 0));
+}
+
+/**
+ * Start the next queued frame unless the DMA is busy, in which case
+ * slc_isr_poll() comes back here when it has finished.
+ */
+LOCAL void ICACHE_FLASH_ATTR i2sSendNext(void)
+{
+  I2S_SEND *send;
+
+  if ((slc_send_active) || (i2s_send_count == 0))
+  {
+    return;
+  }
+
+  send = &i2s_send_queue[i2s_send_head];
+  i2s_send_head = (i2s_send_head + 1) % I2S_SEND_QUEUE;
+  i2s_send_count--;
+  i2s_send_frame = send->frame;
+
+  SET_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_RESET);
+  CLEAR_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_RESET);
+  i2sLinkFrame(i2s_send_frame, send->repeats);
+  i2sStartSignal();
 }
 
 /**
@@ -693,6 +953,12 @@ LOCAL void ICACHE_FLASH_ATTR i2sWrite433(int lowCount) {
  */
 LOCAL void ICACHE_FLASH_ATTR i2sWriteI2s(int valueOne)
 {
+  // Never write off the end of the frame.
+  if (i2s_write_len >= (I2SDMABUFLEN * 4))
+  {
+    return;
+  }
+
   // Note how we are scaling each bit up by 32!
   if (valueOne)
   {
@@ -705,3 +971,262 @@ LOCAL void ICACHE_FLASH_ATTR i2sWriteI2s(int valueOne)
   i2s_write_len += 4;
 }
 
+/**
+ * Write as much as will fit, up to i2s_pack_end, of a HIGH or LOW lasting
+ * the given number of I2S bits and return the number of bits that did not
+ * fit.
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR i2sPack(int valueOne, uint32 ticks)
+{
+  uint32 count;
+  uint32 mask;
+
+  while (ticks > 0)
+  {
+    if (i2s_pack_buf >= i2s_pack_end)
+    {
+      break;
+    }
+
+    /**
+     * Fill as much of the current word as we can; bits go out MSB first.
+     */
+    count = 32 - i2s_pack_bits;
+    if (count > ticks)
+    {
+      count = ticks;
+    }
+    if (valueOne)
+    {
+      mask = (count == 32) ? 0xFFFFFFFF : ((1U << count) - 1);
+      i2s_pack_acc |= mask << (32 - i2s_pack_bits - count);
+    }
+    i2s_pack_bits += count;
+    ticks -= count;
+
+    if (i2s_pack_bits == 32)
+    {
+      i2sBuf[i2s_pack_buf][i2s_pack_word++] = i2s_pack_acc;
+      i2s_pack_acc = 0;
+      i2s_pack_bits = 0;
+      if (i2s_pack_word >= I2SDMABUFLEN)
+      {
+        i2s_pack_buf++;
+        i2s_pack_word = 0;
+      }
+    }
+  }
+  return(ticks);
+}
+
+/**
+ * Fill one block of a streamed signal from the source.  Returns TRUE if the
+ * signal ends in this block.
+ */
+LOCAL bool ICACHE_FLASH_ATTR i2sStreamFill(int block)
+{
+  uint32 start = system_get_time();
+  uint32 elapsed;
+  bool last = FALSE;
+
+  i2s_pack_buf = block;
+  i2s_pack_word = 0;
+  i2s_pack_end = block + 1;
+
+  while (i2s_pack_buf == block)
+  {
+    if (i2s_stream_rem == 0)
+    {
+      if ((!i2s_stream_eos) && (i2s_stream_next >= i2s_stream_avail))
+      {
+        i2s_stream_avail = i2s_stream_source(i2s_stream_arg,
+            (uint16 *)i2s_stream_chunk, I2S_STREAM_CHUNK);
+        i2s_stream_next = 0;
+        i2s_stream_eos = (i2s_stream_avail <= 0);
+      }
+
+      if (i2s_stream_eos)
+      {
+        /**
+         * Finish LOW; complete any part word plus one more.  If that will
+         * not fit then fill this block with LOW and finish in the next.
+         */
+        if (i2s_pack_word < I2SDMABUFLEN - 1)
+        {
+          i2sPack(FALSE, (32 - i2s_pack_bits) + 32);
+          last = TRUE;
+        }
+        else
+        {
+          i2sPack(FALSE, I2SDMABUFLEN * 32);
+        }
+        break;
+      }
+
+      // Pulses alternate, starting with a HIGH.
+      i2s_stream_high = !i2s_stream_high;
+      i2s_stream_rem = ((uint16 *)i2s_stream_chunk)[i2s_stream_next++];
+    }
+    i2s_stream_rem = i2sPack(i2s_stream_high, i2s_stream_rem);
+  }
+
+  elapsed = system_get_time() - start;
+  if (elapsed > i2s_stream_fill_max)
+  {
+    i2s_stream_fill_max = elapsed;
+  }
+  return(last);
+}
+
+/**
+ * Hand a filled block back to the DMA.  The last block ends the chain, the
+ * others point on round the ring.
+ */
+LOCAL void ICACHE_FLASH_ATTR i2sStreamLink(int block, bool last)
+{
+  i2sBufDesc[block].owner = 1;
+  i2sBufDesc[block].eof = 1;
+  i2sBufDesc[block].sub_sof = 0;
+  i2sBufDesc[block].datalen =
+      ((last && (i2s_pack_buf == block)) ? i2s_pack_word : I2SDMABUFLEN) * 4;
+  i2sBufDesc[block].blocksize = I2SDMABUFLEN * 4;
+  i2sBufDesc[block].buf_ptr = (uint32_t)&i2sBuf[block][0];
+  i2sBufDesc[block].unused = 0;
+  i2sBufDesc[block].next_link_ptr = last ? 0 :
+      (uint32_t)&i2sBufDesc[(block + 1) % i2s_stream_blocks];
+
+  if (last)
+  {
+    i2s_stream_last = block;
+  }
+  i2s_stream_ready[block] = TRUE;
+}
+
+/**
+ * Called from slc_isr() as each block of a streamed signal is sent.
+ */
+LOCAL void i2sStreamEof(void)
+{
+  struct sdio_queue *desc;
+  int block;
+
+  desc = (struct sdio_queue *)READ_PERI_REG(SLC_RX_EOF_DES_ADDR);
+  block = desc - &i2sBufDesc[0];
+  if ((block < 0) || (block >= i2s_stream_blocks))
+  {
+    return;
+  }
+  i2s_stream_ready[block] = FALSE;
+
+  if (block == i2s_stream_last)
+  {
+#ifdef DEBUG
+    slc_dbg_send_end = system_get_time();
+#endif
+    i2s_stream_active = FALSE;
+    slc_send_active = FALSE;
+    syslog_isr(SMSG_I2S_DMA_DONE, SLC_RX_EOF_INT_ST, i2s_stream_underruns);
+    return;
+  }
+
+  /**
+   * If the next block has not been refilled the DMA sends its old contents
+   * again; all we can do is count it and bring the signal to an end.
+   */
+  if (!i2s_stream_ready[(block + 1) % i2s_stream_blocks])
+  {
+    i2s_stream_underruns++;
+    syslog_isr(SMSG_I2S_UNDERRUN, block, i2s_stream_underruns);
+  }
+  system_os_post(CFG_TASK_PRIO_I2S_STREAM, 0, block);
+}
+
+/**
+ * Refill a block that the DMA has finished with.
+ */
+LOCAL void ICACHE_FLASH_ATTR i2sStreamTask(os_event_t *event)
+{
+  int block = (int)event->par;
+
+  if ((!i2s_stream_active) || (i2s_stream_last >= 0))
+  {
+    return;
+  }
+  if (i2s_stream_underruns != 0)
+  {
+    i2s_stream_eos = TRUE;
+  }
+  i2sStreamLink(block, i2sStreamFill(block));
+}
+
+/**
+ * Send a signal of any length, pulling the pulses from the source as it is
+ * sent.  See I2S_STREAM_SOURCE.  FALSE if anything else is being sent or
+ * queued, as the stream needs all of the descriptors.
+ *
+ * The first block is filled and timed before the DMA starts and the number
+ * of blocks in the ring is chosen from that time, so a slow source (such as
+ * flash) gets more read ahead than a fast one.
+ */
+bool ICACHE_FLASH_ATTR i2sStreamStart(I2S_STREAM_SOURCE source, void *arg)
+{
+  bool last;
+  int ii;
+
+  if (!i2sSendIdle())
+  {
+    CONSOLE_WARN("Already sending...");
+    return(FALSE);
+  }
+
+  SET_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_RESET);
+  CLEAR_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_RESET);
+
+  i2s_stream_source = source;
+  i2s_stream_arg = arg;
+  i2s_stream_next = 0;
+  i2s_stream_avail = 0;
+  i2s_stream_rem = 0;
+  i2s_stream_high = FALSE;
+  i2s_stream_eos = FALSE;
+  i2s_stream_last = -1;
+  i2s_stream_fill_max = 0;
+  i2s_stream_underruns = 0;
+  i2s_pack_bits = 0;
+  i2s_pack_acc = 0;
+  for (ii = 0; ii < I2SDMABUFCNT; ii++)
+  {
+    i2s_stream_ready[ii] = FALSE;
+  }
+
+  last = i2sStreamFill(0);
+
+  // One block being sent, one being refilled and enough to cover the wait.
+  i2s_stream_blocks = 2 + ((i2s_stream_fill_max + I2S_STREAM_LATENCY_US +
+      I2S_STREAM_BLOCK_US - 1) / I2S_STREAM_BLOCK_US);
+  if (i2s_stream_blocks > I2SDMABUFCNT)
+  {
+    i2s_stream_blocks = I2SDMABUFCNT;
+  }
+
+  i2sStreamLink(0, last);
+  for (ii = 1; (ii < i2s_stream_blocks) && (!last); ii++)
+  {
+    last = i2sStreamFill(ii);
+    i2sStreamLink(ii, last);
+  }
+  TRACE2(TRACE_I2S_STREAM, i2s_stream_blocks, i2s_stream_fill_max);
+
+  i2s_stream_active = TRUE;
+  i2sStartSignal();
+  return(TRUE);
+}
+
+/**
+ * The number of blocks the last streamed signal lost because the source
+ * could not keep up.
+ */
+uint32 ICACHE_FLASH_ATTR i2sStreamUnderruns(void)
+{
+  return(i2s_stream_underruns);
+}
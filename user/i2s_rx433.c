@@ -0,0 +1,235 @@
+/******************************************************************************
+ * Routines that use the I2S receiver and DMA hardware of the esp8266 board
+ * to sample the output of a 433MHz receiver.
+ *
+ * Receivers driven from GPIO interrupts lose pulses whenever the WiFi code
+ * holds on to the CPU.  Here the hardware samples the pin at a fixed rate
+ * into a ring of DMA buffers and the CPU only has to look at each buffer
+ * once it is full, which it can do late without losing anything.
+ *
+ * Note the SLC naming; SLC 'RX' moves data from memory to the I2S
+ * transmitter and SLC 'TX' moves data from the I2S receiver into memory so
+ * this code uses the SLC 'TX' link and interrupts.
+ *
+ *****************************************************************************/
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "driver/i2s_reg.h"
+#include "driver/slc_register.h"
+#include "driver/sdio_slv.h"
+#include "driver/i2s_rx433.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "msg.h"
+#include "pool.h"
+
+/**
+ * Pin function for the I2S receive data line on GPIO12 (MTDI).
+ */
+#define FUNC_I2SI_DATA                      1
+
+/**
+ * The ring of receive buffers.  Each block is 64 words which, at 400us per
+ * word, is 25.6ms of signal so the task has around 75ms to deal with a block
+ * before the DMA comes round to it again.
+ */
+#define I2S_RX_BLOCKCNT   4
+#define I2S_RX_BLOCKLEN   64
+
+/**
+ * Runs shorter than this are receiver noise and are ignored; a run this long
+ * without an edge means the transmission has ended.  The idle time must be
+ * longer than the decoder's DECODE433_IDLE_US.
+ */
+#define I2S_RX_GLITCH_TICKS   (I2S_RX_TICKS_PER_UNIT / 4)
+#define I2S_RX_IDLE_TICKS     (512 * I2S_RX_TICKS_PER_UNIT)
+
+POOL(i2s_rx_pool, I2S_RX_BLOCKLEN * 4, I2S_RX_BLOCKCNT);
+static uint32 *i2sRxBuf[I2S_RX_BLOCKCNT];
+static struct sdio_queue i2sRxDesc[I2S_RX_BLOCKCNT];
+static os_event_t i2sRxQueue[I2S_RX_BLOCKCNT];
+static EDGE433_SCANNER i2sRxScanner;
+
+/**
+ * Overruns count the blocks that the task did not get to before the DMA
+ * needed them again.  The DMA stalls if that happens so the task has to
+ * restart it once a block is available again.
+ */
+static volatile uint32 i2s_rx_overruns = 0;
+static volatile bool i2s_rx_stalled = FALSE;
+static bool i2s_rx_active = FALSE;
+
+/**
+ * Find the edges in a full block and hand it back to the DMA.
+ */
+LOCAL void ICACHE_FLASH_ATTR i2sRxTask(os_event_t *event)
+{
+  int block = (int)event->par;
+
+  edge433Scan(&i2sRxScanner, i2sRxBuf[block], I2S_RX_BLOCKLEN);
+  i2sRxDesc[block].owner = 1;
+
+  if (i2s_rx_stalled)
+  {
+    i2s_rx_stalled = FALSE;
+    SET_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_RESTART);
+  }
+}
+
+/**
+ * Called from slc_isr() in i2s_433.c; the SLC only has the one interrupt.
+ * Work out which block has completed and pass it to the task.
+ */
+void i2sRxIsr(uint32 slc_intr_status)
+{
+  struct sdio_queue *desc;
+  int block;
+
+  if (slc_intr_status & SLC_TX_EOF_INT_ST)
+  {
+    desc = (struct sdio_queue *)READ_PERI_REG(SLC_TX_EOF_DES_ADDR);
+    block = desc - &i2sRxDesc[0];
+    if ((block >= 0) && (block < I2S_RX_BLOCKCNT))
+    {
+      if (!system_os_post(CFG_TASK_PRIO_I2S_RX, 0, block))
+      {
+        /**
+         * The task is too far behind; drop this block.
+         */
+        i2s_rx_overruns++;
+        desc->owner = 1;
+        syslog_isr(SMSG_I2S_RX_ERROR, slc_intr_status, i2s_rx_overruns);
+      }
+    }
+  }
+
+  if (slc_intr_status & SLC_TX_DSCR_ERR_INT_ST)
+  {
+    i2s_rx_overruns++;
+    i2s_rx_stalled = TRUE;
+    syslog_isr(SMSG_I2S_RX_ERROR, slc_intr_status, i2s_rx_overruns);
+  }
+}
+
+/**
+ * Initialize the 433MHz receive system.  The transmitter must already have
+ * been initialized by i2sInit() because that configures the I2S clocks and
+ * attaches the SLC interrupt.  FALSE if the buffers could not be allocated,
+ * in which case i2sRxStart() does nothing.
+ */
+bool ICACHE_FLASH_ATTR i2sRxInit(EDGE433_SINK sink, void *arg)
+{
+  int ii;
+
+  // The ring is only built once; it may be sampling already.
+  if (i2sRxBuf[0] != NULL)
+  {
+    return(TRUE);
+  }
+
+  for (ii = 0; ii < I2S_RX_BLOCKCNT; ii++)
+  {
+    i2sRxBuf[ii] = (uint32 *)pool_alloc(&i2s_rx_pool);
+    if (i2sRxBuf[ii] == NULL)
+    {
+      CONSOLE_ERROR("I2S receive buffers not allocated");
+      while (ii-- > 0)
+      {
+        pool_free(&i2s_rx_pool, i2sRxBuf[ii]);
+        i2sRxBuf[ii] = NULL;
+      }
+      return(FALSE);
+    }
+  }
+
+  edge433Init(&i2sRxScanner,
+      I2S_RX_GLITCH_TICKS, I2S_RX_IDLE_TICKS, sink, arg);
+
+  system_os_task(i2sRxTask, CFG_TASK_PRIO_I2S_RX,
+      i2sRxQueue, I2S_RX_BLOCKCNT);
+
+  /**
+   * Unlike the transmitter, the receive descriptors form a loop and every
+   * block has 'eof' set so that we are told as each one fills.
+   */
+  for (ii = 0; ii < I2S_RX_BLOCKCNT; ii++)
+  {
+    i2sRxDesc[ii].owner = 1;
+    i2sRxDesc[ii].eof = 1;
+    i2sRxDesc[ii].sub_sof = 0;
+    i2sRxDesc[ii].datalen = I2S_RX_BLOCKLEN * 4;
+    i2sRxDesc[ii].blocksize = I2S_RX_BLOCKLEN * 4;
+    i2sRxDesc[ii].buf_ptr = (uint32_t)&i2sRxBuf[ii][0];
+    i2sRxDesc[ii].unused = 0;
+    i2sRxDesc[ii].next_link_ptr =
+        (uint32_t)&i2sRxDesc[(ii + 1) % I2S_RX_BLOCKCNT];
+  }
+
+  PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTDI_U, FUNC_I2SI_DATA);
+
+  /**
+   * The receiver generates its own clocks (it is not a slave) and signals
+   * the end of each block after I2S_RX_BLOCKLEN words.  Only this module
+   * touches the receive mode bits; i2sInit() and i2sSetRate() leave them.
+   */
+  CLEAR_PERI_REG_MASK(I2SCONF, I2S_RECE_SLAVE_MOD);
+  CLEAR_PERI_REG_MASK(I2S_FIFO_CONF,
+      (I2S_I2S_RX_FIFO_MOD<<I2S_I2S_RX_FIFO_MOD_S));
+  WRITE_PERI_REG(I2SRXEOF_NUM, I2S_RX_BLOCKLEN);
+  return(TRUE);
+}
+
+/**
+ * Point the SLC at our ring and start sampling.
+ */
+void ICACHE_FLASH_ATTR i2sRxStart(void)
+{
+  if (i2s_rx_active || (i2sRxBuf[0] == NULL))
+  {
+    return;
+  }
+  i2s_rx_active = TRUE;
+
+  SET_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_STOP);
+  CLEAR_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_DESCADDR_MASK);
+  SET_PERI_REG_MASK(SLC_TX_LINK,
+      ((uint32)&i2sRxDesc[0]) & SLC_TXLINK_DESCADDR_MASK);
+
+  WRITE_PERI_REG(SLC_INT_CLR, SLC_TX_EOF_INT_CLR|SLC_TX_DSCR_ERR_INT_CLR);
+  SET_PERI_REG_MASK(SLC_INT_ENA, SLC_TX_EOF_INT_ENA|SLC_TX_DSCR_ERR_INT_ENA);
+
+  CLEAR_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_STOP);
+  SET_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_START);
+
+  SET_PERI_REG_MASK(I2SCONF, I2S_I2S_RX_RESET);
+  CLEAR_PERI_REG_MASK(I2SCONF, I2S_I2S_RX_RESET);
+  SET_PERI_REG_MASK(I2SCONF, I2S_I2S_RX_START);
+  CONSOLE_INFO("I2S receive started");
+}
+
+/**
+ * Stop sampling and pass on whatever has been measured so far.
+ */
+void ICACHE_FLASH_ATTR i2sRxStop(void)
+{
+  if (!i2s_rx_active)
+  {
+    return;
+  }
+  i2s_rx_active = FALSE;
+
+  CLEAR_PERI_REG_MASK(I2SCONF, I2S_I2S_RX_START);
+  CLEAR_PERI_REG_MASK(SLC_INT_ENA, SLC_TX_EOF_INT_ENA|SLC_TX_DSCR_ERR_INT_ENA);
+  SET_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_STOP);
+  edge433Flush(&i2sRxScanner);
+  CONSOLE_INFO("I2S receive stopped, overruns: %d", i2s_rx_overruns);
+}
+
+uint32 ICACHE_FLASH_ATTR i2sRxOverruns(void)
+{
+  return(i2s_rx_overruns);
+}
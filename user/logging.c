@@ -0,0 +1,44 @@
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "stdarg.h"
+#include "logging.h"
+#include "rodata.h"
+
+/**
+ * Longest line that console() prints; anything more is truncated.
+ */
+#define CONSOLE_BUF_SIZE	128
+
+static char console_buf[CONSOLE_BUF_SIZE];
+static char console_fmt[CONSOLE_BUF_SIZE];
+
+static const char console_levels[] RODATA = "-EWID";
+
+/**
+ * Simple logging function.  Each line is prefixed with the time since boot
+ * in milliseconds and the level, and goes out through os_printf() so that
+ * it is queued by the UART driver rather than waited for.  'fmt' may be in
+ * flash.
+ *
+ * Not for use from interrupts.
+ */
+void ICACHE_FLASH_ATTR console(int level, const char *fmt, ...)
+{
+	uint32 ms = system_get_time() / 1000;
+	char letter;
+	va_list argp;
+
+	rodata_strncpy(console_fmt, fmt, sizeof(console_fmt));
+	va_start(argp, fmt);
+	ets_vsnprintf(console_buf, sizeof(console_buf), console_fmt, argp);
+	va_end(argp);
+
+	if ((level < CONSOLE_LEVEL_NONE) || (level > CONSOLE_LEVEL_DEBUG))
+	{
+		level = CONSOLE_LEVEL_NONE;
+	}
+	rodata_memcpy(&letter, &console_levels[level], 1);
+	os_printf("%u.%03u %c %s\n", ms / 1000, ms % 1000, letter, console_buf);
+}
@@ -0,0 +1,88 @@
+/*
+ *  Fixed-size block pools.  See pool.h.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "msg.h"
+#include "pool.h"
+
+/**
+ * The pools that have been used, for pool_report().
+ */
+static POOL *pool_list = NULL;
+
+/**
+ * A zeroed block, or NULL if they are all in use.
+ */
+void * ICACHE_FLASH_ATTR pool_alloc(POOL *pool)
+{
+	uint8 *block;
+	int ii;
+
+	if (!pool->listed)
+	{
+		pool->listed = TRUE;
+		pool->next = pool_list;
+		pool_list = pool;
+	}
+
+	for (ii = 0; ii < pool->count; ii++)
+	{
+		if ((pool->used & (1UL << ii)) == 0)
+		{
+			pool->used |= (1UL << ii);
+			pool->allocs++;
+			if (++pool->in_use > pool->high)
+			{
+				pool->high = pool->in_use;
+			}
+			block = pool->blocks + (ii * pool->size);
+			os_memset(block, 0, pool->size);
+			return(block);
+		}
+	}
+
+	if (pool->failed < 0xFF)
+	{
+		pool->failed++;
+	}
+	CONSOLE_ERROR("Pool %s exhausted", pool->name);
+	return(NULL);
+}
+
+void ICACHE_FLASH_ATTR pool_free(POOL *pool, void *block)
+{
+	int offset = (uint8 *)block - pool->blocks;
+	int ii = offset / pool->size;
+
+	if ((block == NULL) || (offset < 0) || (ii >= pool->count) ||
+	    (offset % pool->size != 0) || ((pool->used & (1UL << ii)) == 0))
+	{
+		CONSOLE_ERROR("Pool %s: bad free 0x%x", pool->name, (uint32)block);
+		return;
+	}
+	pool->used &= ~(1UL << ii);
+	pool->in_use--;
+}
+
+/**
+ * Log the use of each pool, in bytes, so that the counts can be trimmed to
+ * what is really needed.
+ */
+void ICACHE_FLASH_ATTR pool_report(void)
+{
+	POOL *pool;
+
+	for (pool = pool_list; pool != NULL; pool = pool->next)
+	{
+		syslog(SMSG_POOL_USAGE, pool->name, pool->size * pool->count,
+		    pool->size * pool->in_use, pool->size * pool->high,
+		    pool->allocs, pool->failed);
+	}
+}
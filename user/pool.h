@@ -0,0 +1,55 @@
+/**
+ * Fixed-size block pools.
+ *
+ * A pool is a static array of 'count' blocks of 'size' bytes, declared
+ * where it is used and sized from that module's configuration, so all of
+ * the memory is laid out by the linker, shows up in the map and cannot
+ * fragment.  Blocks are handed out zeroed by pool_alloc() and returned
+ * with pool_free().
+ *
+ *   POOL(my_pool, MY_BUF_SIZE, MY_BUF_COUNT);
+ *   ...
+ *   buf = pool_alloc(&my_pool);
+ *
+ * Each pool counts its allocations and failures and keeps its high-water
+ * mark; pool_report() logs every pool that has been used.  Not for use
+ * from interrupts.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+/**
+ * At most 32 blocks in a pool, one bit of 'used' each.
+ */
+#define POOL_MAX_BLOCKS		32
+
+typedef struct pool
+{
+	const char *name;
+	uint8 *blocks;
+	uint16 size;
+	uint8 count;
+	uint8 in_use;
+	uint8 high;
+	uint8 failed;
+	bool listed;
+	uint32 used;
+	uint32 allocs;
+	struct pool *next;
+} POOL;
+
+#define POOL_BLOCK_SIZE(size)	(((size) + 3) & ~3)
+
+#define POOL(name, size, count) \
+	static uint32 name##_blocks[(count) * POOL_BLOCK_SIZE(size) / 4]; \
+	static POOL name = \
+	{ \
+		#name, (uint8 *)name##_blocks, POOL_BLOCK_SIZE(size), (count) \
+	}; \
+	typedef char name##_count_check[((count) <= POOL_MAX_BLOCKS) ? 1 : -1]
+
+void *pool_alloc(POOL *pool);
+void pool_free(POOL *pool, void *block);
+void pool_report(void);
+
+#endif
@@ -0,0 +1,41 @@
+/**
+ * The signal processing code (edge extraction, decoding) does not touch any
+ * hardware so it is written to build both for the ESP8266 and for a normal
+ * Linux host, where it can be fed with recorded captures.
+ *
+ * On the ESP8266 (the Makefile defines __ets__) we simply use the SDK types.
+ * Anywhere else we provide just enough of the SDK definitions to compile.
+ */
+#ifndef PORTABLE_H
+#define PORTABLE_H
+
+#ifdef __ets__
+#include "c_types.h"
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t  uint8;
+typedef int8_t   sint8;
+typedef uint16_t uint16;
+typedef int16_t  sint16;
+typedef uint32_t uint32;
+typedef int32_t  sint32;
+typedef uint64_t uint64;
+typedef int64_t  sint64;
+
+#ifndef __cplusplus
+typedef unsigned char bool;
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define LOCAL static
+#define ICACHE_FLASH_ATTR
+
+#define os_memcpy  memcpy
+#define os_memset  memset
+#endif
+
+#endif
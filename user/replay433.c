@@ -0,0 +1,341 @@
+/*
+ *  Record-and-replay of captured 433MHz signals.  See replay433.h.
+ *
+ *  This lets us emulate sensors whose protocol we have not worked out; the
+ *  transmitter simply reproduces what the receiver heard, with the timing
+ *  preserved to 12.5us by the DMA.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "spi_flash.h"
+#include "driver/i2s_433.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "msg.h"
+#include "pool.h"
+#include "replay433.h"
+
+/**
+ * A capture ends after this much LOW, in I2S bits (100ms).
+ */
+#define REPLAY433_END_TICKS	(100000000 / I2S_TICK_NS)
+
+/**
+ * Captures shorter than this are noise and are not stored.
+ */
+#define REPLAY433_MIN_PULSES	16
+
+/**
+ * Pulses in a flash sector; the header takes the place of the first few.
+ */
+#define REPLAY433_SECTOR_PULSES	(SPI_FLASH_SEC_SIZE / sizeof(uint16))
+#define REPLAY433_HEADER_PULSES	(sizeof(REPLAY433_HEADER) / sizeof(uint16))
+
+/**
+ * The capture being recorded; the header and pulses are one allocation so
+ * that they can be written to flash in one go.
+ */
+static uint32 *replay433_buf = NULL;
+static uint16 *replay433_pulses;
+static uint16 replay433_count;
+static uint16 replay433_id;
+
+/**
+ * A completed capture is written to flash from a timer, not from the
+ * receive path, one sector erase at a time so that the receiver's task can
+ * catch up between them.  Nothing more is recorded until it is stored.
+ */
+static os_timer_t replay433_store_timer;
+static bool replay433_storing = FALSE;
+static int replay433_store_sector;
+static int replay433_store_erased;
+static int replay433_store_sectors;
+
+#define REPLAY433_BUF_SIZE \
+	(sizeof(REPLAY433_HEADER) + (REPLAY433_MAX_PULSES * sizeof(uint16)))
+
+POOL(replay433_pool, REPLAY433_BUF_SIZE, 1);
+
+/**
+ * The capture being replayed.
+ */
+static uint32 replay433_addr;
+static uint32 replay433_left;
+static uint32 replay433_tick_ns;
+
+/**
+ * The sectors taken up by a capture.
+ */
+static int ICACHE_FLASH_ATTR replay433_span(const REPLAY433_HEADER *header)
+{
+	return((header->count + REPLAY433_HEADER_PULSES +
+	    REPLAY433_SECTOR_PULSES - 1) / REPLAY433_SECTOR_PULSES);
+}
+
+/**
+ * Find the sector holding a capture, or the first unused one.  Returns -1
+ * if neither exist.  The sectors taken up by the rest of a long capture are
+ * skipped over rather than looked at.
+ */
+static int ICACHE_FLASH_ATTR replay433_find(uint16 id, bool allow_empty)
+{
+	REPLAY433_HEADER header;
+	int empty = -1;
+	int sectors;
+	int ii;
+
+	for (ii = 0; ii < CFG_CAPTURE_FLASH_COUNT; ii += sectors)
+	{
+		sectors = 1;
+		spi_flash_read((CFG_CAPTURE_FLASH_SECTOR + ii) * SPI_FLASH_SEC_SIZE,
+		    (uint32 *)&header, sizeof(header));
+		if (header.magic == REPLAY433_MAGIC)
+		{
+			if (header.id == id)
+			{
+				return(CFG_CAPTURE_FLASH_SECTOR + ii);
+			}
+			sectors = replay433_span(&header);
+		}
+		else if ((header.magic == 0xFFFFFFFF) && (empty < 0))
+		{
+			empty = CFG_CAPTURE_FLASH_SECTOR + ii;
+		}
+	}
+	return(allow_empty ? empty : -1);
+}
+
+static void ICACHE_FLASH_ATTR replay433_store_done(bool stored)
+{
+	if (stored)
+	{
+		syslog(SMSG_433_CAPTURE, replay433_id, replay433_count);
+	}
+	else
+	{
+		syslog(SMSG_433_CAPTURE_FAILED, replay433_id);
+	}
+	pool_free(&replay433_pool, replay433_buf);
+	replay433_buf = NULL;
+	replay433_storing = FALSE;
+}
+
+/**
+ * Erase the next sector of the old capture, or once they all are write the
+ * new one to the first of them and free the buffer.
+ */
+static void ICACHE_FLASH_ATTR replay433_store_step(void *arg)
+{
+	REPLAY433_HEADER *header = (REPLAY433_HEADER *)replay433_buf;
+	uint32 size;
+
+	if (replay433_store_erased < replay433_store_sectors)
+	{
+		if (spi_flash_erase_sector(replay433_store_sector +
+		    replay433_store_erased) != SPI_FLASH_RESULT_OK)
+		{
+			replay433_store_done(FALSE);
+			return;
+		}
+		replay433_store_erased++;
+		os_timer_arm(&replay433_store_timer, 1, FALSE);
+		return;
+	}
+
+	// Flash writes are whole words.
+	size = sizeof(REPLAY433_HEADER) + (header->count * sizeof(uint16));
+	size = (size + 3) & ~3;
+	replay433_store_done(spi_flash_write(
+	    replay433_store_sector * SPI_FLASH_SEC_SIZE, replay433_buf, size) ==
+	    SPI_FLASH_RESULT_OK);
+}
+
+/**
+ * Store the completed capture, over any old one with the same ID, which
+ * may span several sectors if it was written from a host, or in the first
+ * unused sector.
+ */
+static void ICACHE_FLASH_ATTR replay433_store(void)
+{
+	REPLAY433_HEADER *header = (REPLAY433_HEADER *)replay433_buf;
+	REPLAY433_HEADER old;
+	int sector;
+
+	header->magic = REPLAY433_MAGIC;
+	header->id = replay433_id;
+	header->count = replay433_count;
+	header->flags = 0;
+	header->tick_ns = I2S_TICK_NS;
+
+	replay433_store_sectors = 1;
+	sector = replay433_find(replay433_id, FALSE);
+	if (sector >= 0)
+	{
+		spi_flash_read(sector * SPI_FLASH_SEC_SIZE,
+		    (uint32 *)&old, sizeof(old));
+		replay433_store_sectors = replay433_span(&old);
+		if (sector + replay433_store_sectors >
+		    CFG_CAPTURE_FLASH_SECTOR + CFG_CAPTURE_FLASH_COUNT)
+		{
+			replay433_store_sectors =
+			    CFG_CAPTURE_FLASH_SECTOR + CFG_CAPTURE_FLASH_COUNT - sector;
+		}
+	}
+	else
+	{
+		sector = replay433_find(replay433_id, TRUE);
+	}
+
+	if (sector < 0)
+	{
+		replay433_store_done(FALSE);
+		return;
+	}
+	replay433_storing = TRUE;
+	replay433_store_sector = sector;
+	replay433_store_erased = 0;
+	os_timer_disarm(&replay433_store_timer);
+	os_timer_setfn(&replay433_store_timer,
+	    (os_timer_func_t *)replay433_store_step, NULL);
+	os_timer_arm(&replay433_store_timer, 1, FALSE);
+}
+
+/**
+ * Start recording; the next signal heard is stored under the given ID,
+ * replacing any existing capture with that ID.
+ */
+bool ICACHE_FLASH_ATTR replay433_record_start(uint16 id)
+{
+	if (replay433_storing)
+	{
+		return(FALSE);
+	}
+	if (replay433_buf == NULL)
+	{
+		replay433_buf = (uint32 *)pool_alloc(&replay433_pool);
+		if (replay433_buf == NULL)
+		{
+			return(FALSE);
+		}
+	}
+	replay433_pulses =
+	    (uint16 *)((uint8 *)replay433_buf + sizeof(REPLAY433_HEADER));
+	replay433_count = 0;
+	replay433_id = id;
+	return(TRUE);
+}
+
+/**
+ * Add a run, measured in I2S bits, to the capture.  Nothing is recorded
+ * until the first HIGH.
+ */
+void ICACHE_FLASH_ATTR replay433_record(void *arg, uint8 level, uint32 ticks)
+{
+	if ((replay433_buf == NULL) || (replay433_storing))
+	{
+		return;
+	}
+
+	if (replay433_count == 0)
+	{
+		if (!level)
+		{
+			return;
+		}
+	}
+	else if ((!level) && (ticks >= REPLAY433_END_TICKS))
+	{
+		/**
+		 * The signal has gone idle.  Keep it if it is long enough to be
+		 * real, otherwise wait for the next one.
+		 */
+		if (replay433_count >= REPLAY433_MIN_PULSES)
+		{
+			replay433_store();
+		}
+		else
+		{
+			replay433_count = 0;
+		}
+		return;
+	}
+
+	replay433_pulses[replay433_count++] = (ticks > 0xFFFF) ? 0xFFFF : ticks;
+	if (replay433_count >= REPLAY433_MAX_PULSES)
+	{
+		replay433_store();
+	}
+}
+
+/**
+ * Add a run measured in microseconds, for example from a GPIO interrupt,
+ * rounding it to the nearest I2S bit.
+ */
+void ICACHE_FLASH_ATTR replay433_record_us(uint8 level, uint32 us)
+{
+	replay433_record(NULL, level,
+	    (uint32)((((uint64)us * 1000) + (I2S_TICK_NS / 2)) / I2S_TICK_NS));
+}
+
+/**
+ * The I2S_STREAM_SOURCE for replay433_send(); reads the next pulses straight
+ * from flash into the transmitter's buffer.
+ */
+static int ICACHE_FLASH_ATTR replay433_source(void *arg, uint16 *ticks, int max)
+{
+	uint32 scaled;
+	int count;
+	int ii;
+
+	count = (replay433_left < (uint32)max) ? (int)replay433_left : max;
+	if (count == 0)
+	{
+		return(0);
+	}
+
+	// Flash reads are whole words; 'max' is even so there is room.
+	spi_flash_read(replay433_addr, (uint32 *)ticks, ((count + 1) / 2) * 4);
+	replay433_addr += count * sizeof(uint16);
+	replay433_left -= count;
+
+	if (replay433_tick_ns != I2S_TICK_NS)
+	{
+		for (ii = 0; ii < count; ii++)
+		{
+			scaled = (ticks[ii] * replay433_tick_ns) / I2S_TICK_NS;
+			ticks[ii] = (scaled > 0xFFFF) ? 0xFFFF : scaled;
+		}
+	}
+	return(count);
+}
+
+/**
+ * Send a stored capture.  The pulses are streamed from flash as the DMA
+ * sends them so a capture can be as long as the flash area allows.  FALSE
+ * if there is no such capture or the transmitter is busy.
+ */
+bool ICACHE_FLASH_ATTR replay433_send(uint16 id)
+{
+	REPLAY433_HEADER header;
+	int sector;
+
+	sector = replay433_find(id, FALSE);
+	if (sector < 0)
+	{
+		CONSOLE_WARN("No capture %d", id);
+		return(FALSE);
+	}
+
+	spi_flash_read(sector * SPI_FLASH_SEC_SIZE,
+	    (uint32 *)&header, sizeof(header));
+	replay433_addr = (sector * SPI_FLASH_SEC_SIZE) + sizeof(header);
+	replay433_left = header.count;
+	replay433_tick_ns = header.tick_ns;
+
+	CONSOLE_INFO("Replay %d: %d pulses", id, header.count);
+	return(i2sStreamStart(replay433_source, NULL));
+}
@@ -0,0 +1,41 @@
+/**
+ * Record-and-replay of captured 433MHz signals.
+ *
+ * A capture is a train of alternating HIGH and LOW durations, starting with
+ * a HIGH, quantized to the I2S bit (I2S_TICK_NS).  Captures are stored in
+ * the CFG_CAPTURE_FLASH_SECTOR area, each starting on a sector boundary, and
+ * identified by a number chosen by the caller.  Captures recorded here fit
+ * in one sector but sequences written to the area from a host (for example
+ * test patterns and playlists built by tools/mkseq433) can run on over
+ * as many sectors as they need.
+ *
+ * 1. Call replay433_record_start() with the ID to store the capture under.
+ * 2. Feed it the received signal with replay433_record() (which can be used
+ *    as an EDGE433_SINK) or replay433_record_us().  The capture is stored
+ *    when the signal goes idle or the buffer is full, shortly afterwards
+ *    from a timer, replacing every sector of any old capture with the ID.
+ *    replay433_record_start() is FALSE until it has been.
+ * 3. Call replay433_send() to send it through the DMA transmitter.  It is
+ *    streamed from flash so its length is not limited by RAM.
+ */
+#ifndef REPLAY433_H
+#define REPLAY433_H
+
+#define REPLAY433_MAGIC       0x52343333
+#define REPLAY433_MAX_PULSES  1000
+
+typedef struct replay433_header
+{
+	uint32 magic;
+	uint16 id;
+	uint16 flags;
+	uint32 count;
+	uint32 tick_ns;
+} REPLAY433_HEADER;
+
+bool replay433_record_start(uint16 id);
+void replay433_record(void *arg, uint8 level, uint32 ticks);
+void replay433_record_us(uint8 level, uint32 us);
+bool replay433_send(uint16 id);
+
+#endif
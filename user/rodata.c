@@ -0,0 +1,71 @@
+/*
+ *  Reading constant data from flash.  See rodata.h.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "rodata.h"
+
+/**
+ * Copy 'length' bytes, reading whole aligned words.
+ */
+void ICACHE_FLASH_ATTR rodata_memcpy(void *dst, const void *src, int length)
+{
+	const uint32 *word = (const uint32 *)((uint32)src & ~3);
+	int shift = ((uint32)src & 3) * 8;
+	uint8 *out = (uint8 *)dst;
+	uint32 value = 0;
+
+	if (length > 0)
+	{
+		value = *word++;
+	}
+	while (length-- > 0)
+	{
+		*out++ = (uint8)(value >> shift);
+		shift += 8;
+		if ((shift == 32) && (length > 0))
+		{
+			value = *word++;
+			shift = 0;
+		}
+	}
+}
+
+/**
+ * Copy a string of at most size - 1 characters, always terminating it, and
+ * return its length.
+ */
+int ICACHE_FLASH_ATTR rodata_strncpy(char *dst, const char *src, int size)
+{
+	const uint32 *word = (const uint32 *)((uint32)src & ~3);
+	int shift = ((uint32)src & 3) * 8;
+	uint32 value;
+	int length = 0;
+	char c;
+
+	if (size <= 0)
+	{
+		return(0);
+	}
+
+	value = *word++;
+	while (length < size - 1)
+	{
+		c = (char)(value >> shift);
+		if (c == '\0')
+		{
+			break;
+		}
+		dst[length++] = c;
+		shift += 8;
+		if (shift == 32)
+		{
+			value = *word++;
+			shift = 0;
+		}
+	}
+	dst[length] = '\0';
+	return(length);
+}
@@ -0,0 +1,29 @@
+/**
+ * Constant data kept in flash rather than RAM.
+ *
+ * On the ESP8266 '.rodata' is copied into RAM at boot, so every string
+ * literal costs RAM.  Data marked RODATA stays in flash instead, but flash
+ * can only be read 32 bits at a time from aligned addresses; anything else
+ * raises an exception.  So it must not be passed to the string functions
+ * or printf(), only read with the functions here, which work on data in
+ * RAM too.
+ */
+#ifndef RODATA_H
+#define RODATA_H
+
+#ifndef STORE_ATTR
+#define STORE_ATTR __attribute__((aligned(4)))
+#endif
+
+#define RODATA  ICACHE_RODATA_ATTR STORE_ATTR
+
+/**
+ * Fails to compile unless 'cond' is true.
+ */
+#define RODATA_ASSERT(name, cond) \
+  typedef char name##_assert[(cond) ? 1 : -1]
+
+void rodata_memcpy(void *dst, const void *src, int length);
+int rodata_strncpy(char *dst, const char *src, int size);
+
+#endif
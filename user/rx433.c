@@ -0,0 +1,80 @@
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "driver/i2s_rx433.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "msg.h"
+#include "decode433.h"
+#include "sensor433.h"
+#include "replay433.h"
+#include "rx433.h"
+#include "http.h"
+
+static DECODE433 rx433_decoder;
+
+/**
+ * Called by the decoder for each payload.  Sensors repeat each reading
+ * several times so only the first copy in each transmission is logged, and
+ * passed on for upload unless it has not changed.
+ */
+static void ICACHE_FLASH_ATTR rx433_result(void *arg,
+    const DECODE433_PROTOCOL *protocol, uint32 payload,
+    DECODE433_STATUS status, uint8 repeat)
+{
+	uint32 expected;
+	sint32 temp;
+
+	if (repeat != 0)
+	{
+		return;
+	}
+
+	if (status != DECODE433_OK)
+	{
+		expected = payload & ~CFG_CHECKSUM_MASK;
+		add_433_checksum(&expected);
+		syslog(SMSG_TEMP_CHECKSUM,
+		    payload & CFG_CHECKSUM_MASK, expected & CFG_CHECKSUM_MASK);
+		return;
+	}
+
+	if (!http_reading(payload))
+	{
+		syslog(SMSG_TEMP_UNCHANGED);
+		return;
+	}
+
+	/**
+	 * The sign on its own, as -0.5 would otherwise lose it.
+	 */
+	temp = sensor433_temp(payload);
+	syslog(SMSG_TEMP_DATA, payload, (temp < 0) ? "-" : "",
+	    ((temp < 0) ? -temp : temp) / 10, ((temp < 0) ? -temp : temp) % 10);
+}
+
+/**
+ * Runs from the receiver go both to the decoder and, if a capture is being
+ * recorded, to the recorder.
+ */
+static void ICACHE_FLASH_ATTR rx433_edge(void *arg, uint8 level, uint32 ticks)
+{
+	decode433Sampled(&rx433_decoder, level, ticks);
+	replay433_record(NULL, level, ticks);
+}
+
+void ICACHE_FLASH_ATTR rx433_setup(void)
+{
+	decode433Init(&rx433_decoder,
+	    sensor433_protocols, sensor433_protocol_count, rx433_result, NULL);
+	if (!i2sRxInit(rx433_edge, NULL))
+	{
+		return;
+	}
+#ifdef CFG_433_RECORD_ID
+	replay433_record_start(CFG_433_RECORD_ID);
+#endif
+	i2sRxStart();
+}
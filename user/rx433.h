@@ -0,0 +1,5 @@
+/**
+ * Start sampling the 433MHz receiver and logging the sensor data that it
+ * hears.  i2sInit() must have been called first.
+ */
+void rx433_setup(void);
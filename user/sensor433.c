@@ -0,0 +1,78 @@
+/*
+ *  The details of the weather sensor being emulated, shared by the sending
+ *  and receiving code.  This file has no hardware dependencies so it also
+ *  builds into the host tools.
+ */
+
+#include "sensor433.h"
+#include "driver/i2s_433.h"
+
+/**
+ * The signal that we send ourselves; see i2s_433.h.
+ */
+const DECODE433_PROTOCOL sensor433_protocols[] =
+{
+  {
+    "Weather",
+    I2S_UNIT_US, I2S_LOW_FRAME * I2S_UNIT_US,
+    I2S_UNIT_US, I2S_LOW_ZERO * I2S_UNIT_US,
+    I2S_UNIT_US, I2S_LOW_ONE * I2S_UNIT_US,
+    30,
+    32,
+    check_433_checksum
+  }
+};
+const int sensor433_protocol_count =
+    sizeof(sensor433_protocols) / sizeof(sensor433_protocols[0]);
+
+/**
+ * *** YOUR WEATHER STATION WILL HAVE ITS OWN CHECKSUM ALGORITHM ***
+ *
+ * Generate the 8-bit checksum that forms the end of the 32-bit
+ * data to send to the weather station receiver.
+ */
+void ICACHE_FLASH_ATTR add_433_checksum(uint32 *data_433)
+{
+	uint32 check_sum = 0;
+	uint32 data = (*data_433);
+	int ii;
+
+	for (ii = 0; ii < 40; ii++)
+	{
+		if (check_sum & 0x80)
+		{
+			check_sum ^= 0x18;
+		}
+		check_sum = ((check_sum & 0x80) >> 7) | (check_sum << 1);
+		check_sum ^= ((data & 0x80000000) >> 31);
+		data <<= 1;
+	}
+	(*data_433) |= (check_sum & 0x000000FF);
+	return;
+}
+
+/**
+ * Does received data carry the right checksum?
+ */
+bool ICACHE_FLASH_ATTR check_433_checksum(uint32 data_433)
+{
+	uint32 expected = data_433 & ~CFG_CHECKSUM_MASK;
+
+	add_433_checksum(&expected);
+	return(expected == data_433);
+}
+
+/**
+ * Extract the temperature, in tenths of a degree, from the 12-bit signed
+ * field.
+ */
+sint32 ICACHE_FLASH_ATTR sensor433_temp(uint32 data_433)
+{
+	sint32 temp = (data_433 & CFG_TEMP_MASK) >> CFG_TEMP_SHIFT;
+
+	if (temp & 0x800)
+	{
+		temp -= 0x1000;
+	}
+	return(temp);
+}
@@ -0,0 +1,39 @@
+#ifndef SENSOR433_H
+#define SENSOR433_H
+
+#include "portable.h"
+#include "decode433.h"
+
+/**
+ * *** YOU WILL WANT TO CHANGE THIS ***
+ *
+ * This defines the format of the 32-bit data that is sent to the
+ * weather sensor. The format you choose will be specific to your
+ * sensor.
+ */
+#define CFG_433_1_VALUE		400
+#define CFG_433_4_VALUE		(4 * CFG_433_1_VALUE)
+#define CFG_433_17_VALUE	(17 * CFG_433_1_VALUE)
+
+#define CFG_433_SENDER		0x94000000
+#define CFG_433_SENDER_MASK	0xFF000000
+#define CFG_433_BATTERY_OK  0x00800000
+#define CFG_433_BEEP        0x00400000
+#define CFG_433_00200000    0x00200000
+#define CFG_433_00100000    0x00100000
+
+#define CFG_TEMP_SHIFT      8
+#define CFG_TEMP_MASK       0x000FFF00
+#define CFG_CHECKSUM_MASK   0x000000FF
+
+/**
+ * The protocols that the receiver looks for.
+ */
+extern const DECODE433_PROTOCOL sensor433_protocols[];
+extern const int sensor433_protocol_count;
+
+void ICACHE_FLASH_ATTR add_433_checksum(uint32 *data_433);
+bool ICACHE_FLASH_ATTR check_433_checksum(uint32 data_433);
+sint32 ICACHE_FLASH_ATTR sensor433_temp(uint32 data_433);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ *  RTC state and deep sleep.  See sleep.h.
+ *
+ *  The RTC counter keeps running through deep sleep but ticks at the slow
+ *  RTC clock, whose period system_rtc_clock_cali_proc() measures in
+ *  microseconds with 12 fractional bits.  Each update converts the ticks
+ *  since the last one at the current calibration and adds them to a 64 bit
+ *  microsecond clock, which is kept in RTC memory with everything else.
+ *
+ *  RTC memory is lost on a power cycle and may not survive a brownout, so
+ *  every SLEEP_FLASH_SAVES saves the state is also appended to a flash
+ *  sector, which is only erased once it is full.  The newest valid copy
+ *  there is used when RTC memory has nothing; the RTC clock is not carried
+ *  over so the next send is then due straight away.  After a watchdog or
+ *  exception reset the RTC counter and memory carry on, so the sends keep
+ *  to their deadlines.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "spi_flash.h"
+#include "config.h"
+#include "logging.h"
+#include "syslog.h"
+#include "spill.h"
+#include "rodata.h"
+#include "sleep.h"
+
+#define SLEEP_MAGIC		0x31504C53
+
+/**
+ * The time from the RTC waking us to the send, which each sleep is
+ * shortened by, and the shortest sleep worth having.
+ */
+#define SLEEP_WAKE_US		150000
+#define SLEEP_MIN_US		20000
+
+/**
+ * Deep sleep options; the radio is calibrated as the init data says, or
+ * left off altogether.
+ */
+#define SLEEP_RF_DEFAULT	1
+#define SLEEP_RF_OFF		4
+
+/**
+ * At one save per 30s send, a sector of 73 copies, one every 10 saves, is
+ * erased about every six hours.
+ */
+#define SLEEP_FLASH_SAVES	10
+#define SLEEP_FLASH_ADDR(slot)	\
+	((CFG_SLEEP_FLASH_SECTOR * SPI_FLASH_SEC_SIZE) + \
+	    ((slot) * sizeof(SLEEP_STATE)))
+#define SLEEP_FLASH_SLOTS	(SPI_FLASH_SEC_SIZE / sizeof(SLEEP_STATE))
+
+typedef struct sleep_state
+{
+	uint32 magic;
+	uint32 rtc_last;
+	uint64 rtc_us;
+	uint64 deadline_us;
+	uint16 wakes;
+	uint8 network;
+	uint8 app_size;
+	uint32 saves;
+	uint32 app[SLEEP_APP_MAX / 4];
+	uint32 check;		// Covers everything before it.
+} SLEEP_STATE;
+
+RODATA_ASSERT(sleep_rtc_size, sizeof(SLEEP_STATE) <= 4 * CFG_RTC_SLEEP_BLOCKS);
+
+static SLEEP_STATE sleep_state;
+static void *sleep_app;
+static bool sleep_woke = FALSE;
+static int sleep_flash_slot = 0;
+
+/**
+ * The words before 'check'; the uint64s pad the end of the state, so it is
+ * not simply the last word.
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR sleep_check(void)
+{
+	uint32 *word = (uint32 *)&sleep_state;
+	uint32 check = 0;
+	int ii;
+
+	for (ii = 0; ii < offsetof(SLEEP_STATE, check) / 4; ii++)
+	{
+		check = ((check << 5) | (check >> 27)) ^ word[ii];
+	}
+	return(check);
+}
+
+/**
+ * The RTC clock in microseconds.
+ */
+LOCAL uint64 ICACHE_FLASH_ATTR sleep_clock(void)
+{
+	uint32 now = system_get_rtc_time();
+	uint32 cali = system_rtc_clock_cali_proc();
+
+	sleep_state.rtc_us +=
+	    ((uint64)(now - sleep_state.rtc_last) * cali) >> 12;
+	sleep_state.rtc_last = now;
+	return(sleep_state.rtc_us);
+}
+
+LOCAL bool ICACHE_FLASH_ATTR sleep_valid(int size)
+{
+	return((sleep_state.magic == SLEEP_MAGIC) &&
+	    (sleep_state.check == sleep_check()) && (sleep_state.app_size == size));
+}
+
+/**
+ * Find the newest valid copy in flash, and where the next goes.  Copies are
+ * written in order into an erased sector so the first blank slot ends them.
+ */
+LOCAL bool ICACHE_FLASH_ATTR sleep_flash_restore(int size)
+{
+	SLEEP_STATE newest;
+	bool found = FALSE;
+	int slot;
+
+	for (slot = 0; slot < SLEEP_FLASH_SLOTS; slot++)
+	{
+		spi_flash_read(SLEEP_FLASH_ADDR(slot),
+		    (uint32 *)&sleep_state, sizeof(sleep_state));
+		if (sleep_state.magic == 0xFFFFFFFF)
+		{
+			break;
+		}
+		if (sleep_valid(size))
+		{
+			os_memcpy(&newest, &sleep_state, sizeof(newest));
+			found = TRUE;
+		}
+	}
+	sleep_flash_slot = slot;
+
+	if (found)
+	{
+		os_memcpy(&sleep_state, &newest, sizeof(sleep_state));
+	}
+	return(found);
+}
+
+LOCAL void ICACHE_FLASH_ATTR sleep_flash_save(void)
+{
+	if (sleep_flash_slot >= SLEEP_FLASH_SLOTS)
+	{
+		if (spi_flash_erase_sector(CFG_SLEEP_FLASH_SECTOR) !=
+		    SPI_FLASH_RESULT_OK)
+		{
+			return;
+		}
+		sleep_flash_slot = 0;
+	}
+	if (spi_flash_write(SLEEP_FLASH_ADDR(sleep_flash_slot),
+	    (uint32 *)&sleep_state, sizeof(sleep_state)) == SPI_FLASH_RESULT_OK)
+	{
+		sleep_flash_slot++;
+	}
+	else
+	{
+		// Never write over a part written slot.
+		sleep_flash_slot = SLEEP_FLASH_SLOTS;
+	}
+}
+
+/**
+ * Does the RTC counter keep running through a reset for this reason?  Only
+ * power on and the reset pin start it again.
+ */
+LOCAL bool ICACHE_FLASH_ATTR sleep_rtc_kept(uint32 reason)
+{
+	switch (reason)
+	{
+	case REASON_WDT_RST:
+	case REASON_EXCEPTION_RST:
+	case REASON_SOFT_WDT_RST:
+	case REASON_SOFT_RESTART:
+	case REASON_DEEP_SLEEP_AWAKE:
+		return(TRUE);
+	default:
+		return(FALSE);
+	}
+}
+
+/**
+ * Restore the state from RTC memory, or failing that flash, into 'app';
+ * FALSE, leaving 'app' as it is, if there was none.
+ */
+bool ICACHE_FLASH_ATTR sleep_setup(void *app, int size)
+{
+	struct rst_info *reset = system_get_rst_info();
+	SLEEP_STATE rtc;
+	bool in_rtc;
+	bool valid;
+
+	sleep_app = app;
+	system_rtc_mem_read(CFG_RTC_SLEEP, &rtc, sizeof(rtc));
+	os_memcpy(&sleep_state, &rtc, sizeof(sleep_state));
+	in_rtc = sleep_valid(size);
+
+	// Flash is always scanned, to know where the next copy goes.
+	valid = sleep_flash_restore(size) || in_rtc;
+	if (in_rtc)
+	{
+		os_memcpy(&sleep_state, &rtc, sizeof(sleep_state));
+	}
+
+	if (!valid)
+	{
+		os_memset(&sleep_state, 0, sizeof(sleep_state));
+		sleep_state.magic = SLEEP_MAGIC;
+		sleep_state.app_size = (size > SLEEP_APP_MAX) ? SLEEP_APP_MAX : size;
+		os_memcpy(sleep_state.app, app, sleep_state.app_size);
+	}
+	else
+	{
+		os_memcpy(app, sleep_state.app, size);
+	}
+
+	sleep_woke = in_rtc && (reset->reason == REASON_DEEP_SLEEP_AWAKE);
+	if (sleep_woke)
+	{
+		sleep_state.wakes++;
+	}
+	else
+	{
+		/**
+		 * Anything but our own wake is a chance to get online.
+		 */
+		sleep_state.network = TRUE;
+		if ((!in_rtc) || (!sleep_rtc_kept(reset->reason)))
+		{
+			/**
+			 * The RTC counter was reset along with everything else, or
+			 * the clock came from flash, so pick it up from here and send
+			 * straight away.
+			 */
+			sleep_state.rtc_last = system_get_rtc_time();
+			sleep_state.deadline_us = sleep_state.rtc_us;
+		}
+	}
+	if (sleep_state.network)
+	{
+		sleep_state.wakes = 0;
+	}
+	CONSOLE_INFO("Sleep: %s, reset %d, wakes %d, network %d",
+	    in_rtc ? "restored" : (valid ? "from flash" : "new"), reset->reason,
+	    sleep_state.wakes, sleep_state.network);
+	return(valid);
+}
+
+/**
+ * Did we wake from our own deep sleep?
+ */
+bool ICACHE_FLASH_ATTR sleep_woken(void)
+{
+	return(sleep_woke);
+}
+
+/**
+ * Is WiFi to be brought up this time?
+ */
+bool ICACHE_FLASH_ATTR sleep_network(void)
+{
+#ifdef CFG_DEEP_SLEEP
+	return(sleep_state.network);
+#else
+	return(TRUE);
+#endif
+}
+
+/**
+ * The next send is due 'interval_ms' after the last.  If we have fallen
+ * behind, for example after a long reset, it is due an interval from now.
+ */
+void ICACHE_FLASH_ATTR sleep_schedule(uint32 interval_ms)
+{
+	uint64 now = sleep_clock();
+
+	sleep_state.deadline_us += (uint64)interval_ms * 1000;
+	if (sleep_state.deadline_us < now)
+	{
+		sleep_state.deadline_us = now + ((uint64)interval_ms * 1000);
+	}
+}
+
+/**
+ * Milliseconds until the next send is due, 0 if it is now.
+ */
+uint32 ICACHE_FLASH_ATTR sleep_due_ms(void)
+{
+	uint64 now = sleep_clock();
+
+	if (sleep_state.deadline_us <= now)
+	{
+		return(0);
+	}
+	return((uint32)((sleep_state.deadline_us - now) / 1000));
+}
+
+/**
+ * Save the caller's state, as it is now, to RTC memory and now and then to
+ * flash.
+ */
+void ICACHE_FLASH_ATTR sleep_save(void)
+{
+	sleep_clock();
+	os_memcpy(sleep_state.app, sleep_app, sleep_state.app_size);
+	sleep_state.saves++;
+	sleep_state.check = sleep_check();
+	system_rtc_mem_write(CFG_RTC_SLEEP, &sleep_state, sizeof(sleep_state));
+	if ((sleep_state.saves % SLEEP_FLASH_SAVES) == 1)
+	{
+		sleep_flash_save();
+	}
+}
+
+/**
+ * Save everything and deep sleep until the next deadline.  The log goes to
+ * flash first as memory is lost; the next wake brings up WiFi if it is time
+ * to, or if the backlog in flash is getting large.  Does not return.
+ */
+void ICACHE_FLASH_ATTR sleep_now(void)
+{
+	uint64 now;
+	uint64 sleep_us = SLEEP_MIN_US;
+
+	syslog_flush();
+	sleep_state.network =
+	    (sleep_state.wakes + 1 >= CFG_SLEEP_NET_WAKES) ||
+	    (spill_backlog() > CFG_SPILL_FLASH_COUNT / 2);
+
+	now = sleep_clock();
+	if (sleep_state.deadline_us > now + SLEEP_WAKE_US + SLEEP_MIN_US)
+	{
+		sleep_us = sleep_state.deadline_us - now - SLEEP_WAKE_US;
+	}
+	sleep_save();
+
+	CONSOLE_INFO("Sleep: %dms, network next %d", (uint32)(sleep_us / 1000),
+	    sleep_state.network);
+	system_deep_sleep_set_option(
+	    sleep_state.network ? SLEEP_RF_DEFAULT : SLEEP_RF_OFF);
+	system_deep_sleep((uint32)sleep_us);
+}
@@ -0,0 +1,38 @@
+/**
+ * State kept across resets in RTC memory, and deep sleep between sends.
+ *
+ * The caller's state (for the sender, what it is to send next) is saved to
+ * RTC memory with a check so that it carries on where it left off after a
+ * watchdog or exception reset or a deep sleep.  A copy is also kept in flash
+ * now and then, for after a power cycle or brownout.
+ *
+ * With CFG_DEEP_SLEEP the device sleeps between sends, waking when the next
+ * is due.  The radio is left off for most wakes; only every
+ * CFG_SLEEP_NET_WAKES, or when the log backlog in flash builds up, is the
+ * next wake one with WiFi to flush the log and sync the clock.  Deadlines
+ * are kept on the RTC clock, which runs through deep sleep, so the sends
+ * do not drift by the time spent awake.
+ *
+ * 1. Call sleep_setup() first thing at boot with the state to keep.
+ * 2. sleep_network() says whether to bring up WiFi this time and
+ *    sleep_due_ms() how long until the next send.
+ * 3. After each send call sleep_schedule() to set the next deadline, then
+ *    sleep_save(), or with CFG_DEEP_SLEEP sleep_now() which saves too.
+ */
+#ifndef SLEEP_H
+#define SLEEP_H
+
+/**
+ * The most caller state that is kept.
+ */
+#define SLEEP_APP_MAX		16
+
+bool sleep_setup(void *app, int size);
+bool sleep_woken(void);
+bool sleep_network(void);
+void sleep_schedule(uint32 interval_ms);
+uint32 sleep_due_ms(void);
+void sleep_save(void);
+void sleep_now(void);
+
+#endif
@@ -5,6 +5,7 @@
 #include "sntp.h"
 #include "msg.h"
 #include "syslog.h"
+#include "clock.h"
 
 /**
  * Set the NTP time servers to be used and the timezone then
@@ -42,20 +43,80 @@ extern struct tm res_buf;
 char no_time_yet[] = "-";
 char sntp_syslog_time[32];
 
+/**
+ * The calendar part of the timestamp only changes once a second so it is
+ * formatted once and kept; each call just patches in the milliseconds,
+ * which start at SNTP_MS_OFFSET in "YYYY-MM-DDTHH:MM:SS.mmmZ", or leaves
+ * them out if they are not known.
+ */
+#define SNTP_MS_OFFSET	20
+static uint32 sntp_cached_time = 0;
+static bool sntp_cached = FALSE;
+
+
 /**
  * Note that we cannot access the reult buffer as ESP8266 SDK seems to have
  * make changes to the standard LWIP buffer handling.
  */
-char * ICACHE_FLASH_ATTR sntp_get_syslog_time(void)
+char * ICACHE_FLASH_ATTR sntp_format_syslog_time(uint32 t, uint16 ms)
 {
-	uint32 t;
+	if ((!sntp_cached) || (t != sntp_cached_time))
+	{
+		sntp_cached_time = t;
+		sntp_cached = TRUE;
+		sntp_localtime(&t);
 
-	t = sntp_get_current_timestamp();
-	sntp_localtime(&t);
+		os_sprintf(sntp_syslog_time, "%04d-%02d-%02dT%02d:%02d:%02d.000Z",
+				(1900+res_buf.tm_year), (1+res_buf.tm_mon), res_buf.tm_mday,
+				res_buf.tm_hour, res_buf.tm_min, res_buf.tm_sec);
+	}
 
-	os_sprintf(sntp_syslog_time, "%04d-%02d-%02dT%02d:%02d:%02dZ",
-			(1900+res_buf.tm_year), (1+res_buf.tm_mon), res_buf.tm_mday,
-			res_buf.tm_hour, res_buf.tm_min, res_buf.tm_sec);
+	if (ms == SNTP_MS_UNKNOWN)
+	{
+		sntp_syslog_time[SNTP_MS_OFFSET - 1] = 'Z';
+		sntp_syslog_time[SNTP_MS_OFFSET] = '\0';
+		return(sntp_syslog_time);
+	}
+	if (ms > 999)
+	{
+		ms = 999;
+	}
+	sntp_syslog_time[SNTP_MS_OFFSET - 1] = '.';
+	sntp_syslog_time[SNTP_MS_OFFSET] = '0' + (ms / 100);
+	sntp_syslog_time[SNTP_MS_OFFSET + 1] = '0' + ((ms / 10) % 10);
+	sntp_syslog_time[SNTP_MS_OFFSET + 2] = '0' + (ms % 10);
+	sntp_syslog_time[SNTP_MS_OFFSET + 3] = 'Z';
+	sntp_syslog_time[SNTP_MS_OFFSET + 4] = '\0';
 
 	return(sntp_syslog_time);
 }
+
+/**
+ * The current time as seconds, as sntp_get_current_timestamp(), and
+ * milliseconds; cheap enough to call for every log message.  SNTP only
+ * gives whole seconds, with no telling where in the second we are, so
+ * until the clock module has synced the milliseconds are SNTP_MS_UNKNOWN.
+ */
+uint32 ICACHE_FLASH_ATTR sntp_get_syslog_timestamp(uint16 *ms)
+{
+	uint64 wall_ms;
+
+	if (clock_valid())
+	{
+		wall_ms = clock_wall_us() / 1000;
+		*ms = wall_ms % 1000;
+		return((uint32)(wall_ms / 1000));
+	}
+
+	*ms = SNTP_MS_UNKNOWN;
+	return(sntp_get_current_timestamp());
+}
+
+char * ICACHE_FLASH_ATTR sntp_get_syslog_time(void)
+{
+	uint32 t;
+	uint16 ms;
+
+	t = sntp_get_syslog_timestamp(&ms);
+	return(sntp_format_syslog_time(t, ms));
+}
@@ -4,3 +4,13 @@
  */
 void sntp_setup(char *server0, char *server1, char *server2, uint32_t timezone);
 char * ICACHE_FLASH_ATTR sntp_get_syslog_time(void);
+
+/**
+ * As sntp_get_syslog_time() but for a time from sntp_get_syslog_timestamp()
+ * saved earlier.  The milliseconds are SNTP_MS_UNKNOWN, and left out of the
+ * time, until the clock module has synced.
+ */
+#define SNTP_MS_UNKNOWN	0xFFFF
+
+uint32 ICACHE_FLASH_ATTR sntp_get_syslog_timestamp(uint16 *ms);
+char * ICACHE_FLASH_ATTR sntp_format_syslog_time(uint32 t, uint16 ms);
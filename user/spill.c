@@ -0,0 +1,293 @@
+/*
+ *  Flash-backed overflow for the syslog queue.  See spill.h.
+ *
+ *  Each sector starts with a SPILL_SECTOR header and then holds records
+ *  back to back, each a SPILL_RECORD header followed by the data padded to
+ *  a whole number of words, as flash is written in words.  Erased flash
+ *  reads as all ones so a record header of 0xFFFFFFFF is the end of the
+ *  sector's records.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "spi_flash.h"
+#include "config.h"
+#include "logging.h"
+#include "spill.h"
+
+#define SPILL_MAGIC		0x4C495053
+#define SPILL_FREE		0xFFFF
+#define SPILL_SENT		0x0000
+
+typedef struct spill_sector
+{
+	uint32 magic;
+	uint32 seq;
+} SPILL_SECTOR;
+
+typedef struct spill_record
+{
+	uint16 length;
+	uint16 state;
+} SPILL_RECORD;
+
+#define SPILL_PADDED(len)	(((len) + 3) & ~3)
+#define SPILL_ADDR(sector, offset) \
+	(((CFG_SPILL_FLASH_SECTOR + (sector)) * SPI_FLASH_SEC_SIZE) + (offset))
+
+/**
+ * Where the next record is written and where the oldest unsent one may be.
+ * spill_write_sector is -1 until the first sector is used.
+ */
+static int spill_write_sector = -1;
+static uint32 spill_write_offset;
+static uint32 spill_write_seq = 0;
+static int spill_read_sector;
+static uint32 spill_read_offset;
+static int spill_last_sector = -1;
+static uint32 spill_last_offset;
+static uint16 spill_last_length;
+static uint32 spill_lost_count = 0;
+
+/**
+ * One record, header and data, as it is written.
+ */
+static uint32 spill_buf[(sizeof(SPILL_RECORD) + SPILL_MAX_RECORD + 3) / 4];
+
+LOCAL bool ICACHE_FLASH_ATTR spill_sector_valid(int sector, uint32 *seq)
+{
+	SPILL_SECTOR header;
+
+	spi_flash_read(SPILL_ADDR(sector, 0), (uint32 *)&header, sizeof(header));
+	if (seq != NULL)
+	{
+		*seq = header.seq;
+	}
+	return(header.magic == SPILL_MAGIC);
+}
+
+/**
+ * Find the newest sector and the end of its records, and start reading at
+ * the oldest.
+ */
+void ICACHE_FLASH_ATTR spill_setup(void)
+{
+	SPILL_RECORD record;
+	uint32 seq;
+	int ii;
+
+	spill_write_sector = -1;
+	for (ii = 0; ii < CFG_SPILL_FLASH_COUNT; ii++)
+	{
+		if (spill_sector_valid(ii, &seq) &&
+		    ((spill_write_sector < 0) || (seq > spill_write_seq)))
+		{
+			spill_write_sector = ii;
+			spill_write_seq = seq;
+		}
+	}
+
+	if (spill_write_sector < 0)
+	{
+		spill_read_sector = 0;
+		spill_read_offset = sizeof(SPILL_SECTOR);
+		return;
+	}
+
+	spill_write_offset = sizeof(SPILL_SECTOR);
+	while (spill_write_offset + sizeof(record) <= SPI_FLASH_SEC_SIZE)
+	{
+		spi_flash_read(SPILL_ADDR(spill_write_sector, spill_write_offset),
+		    (uint32 *)&record, sizeof(record));
+		if (record.length == SPILL_FREE)
+		{
+			break;
+		}
+		spill_write_offset += sizeof(record) + SPILL_PADDED(record.length);
+	}
+
+	// The sector after the newest is the oldest, if it is in use.
+	spill_read_sector = (spill_write_sector + 1) % CFG_SPILL_FLASH_COUNT;
+	spill_read_offset = sizeof(SPILL_SECTOR);
+	if (!spill_sector_valid(spill_read_sector, NULL))
+	{
+		spill_read_offset = SPI_FLASH_SEC_SIZE;
+	}
+	CONSOLE_INFO("Spill: sector %d, seq %d, offset %d",
+	    spill_write_sector, spill_write_seq, spill_write_offset);
+}
+
+/**
+ * Append a record, moving on to (and erasing) the next sector if this one
+ * is full.
+ */
+bool ICACHE_FLASH_ATTR spill_write(const uint8 *data, uint16 length)
+{
+	SPILL_SECTOR header;
+	SPILL_RECORD *record = (SPILL_RECORD *)spill_buf;
+	uint32 size = sizeof(SPILL_RECORD) + SPILL_PADDED(length);
+	int next;
+
+	if ((length > SPILL_MAX_RECORD) || (length == SPILL_FREE))
+	{
+		return(FALSE);
+	}
+
+	if ((spill_write_sector < 0) ||
+	    (spill_write_offset + size > SPI_FLASH_SEC_SIZE))
+	{
+		next = (spill_write_sector + 1) % CFG_SPILL_FLASH_COUNT;
+
+		/**
+		 * Reusing the sector we are reading from loses what is left in it.
+		 */
+		if ((spill_write_sector >= 0) && (next == spill_read_sector))
+		{
+			spill_lost_count++;
+			spill_read_sector = (next + 1) % CFG_SPILL_FLASH_COUNT;
+			spill_read_offset = sizeof(SPILL_SECTOR);
+		}
+
+		header.magic = SPILL_MAGIC;
+		header.seq = ++spill_write_seq;
+		if ((spi_flash_erase_sector(CFG_SPILL_FLASH_SECTOR + next) !=
+		        SPI_FLASH_RESULT_OK) ||
+		    (spi_flash_write(SPILL_ADDR(next, 0),
+		        (uint32 *)&header, sizeof(header)) != SPI_FLASH_RESULT_OK))
+		{
+			return(FALSE);
+		}
+		spill_write_sector = next;
+		spill_write_offset = sizeof(SPILL_SECTOR);
+	}
+
+	record->length = length;
+	record->state = SPILL_FREE;
+	os_memset((uint8 *)spill_buf + size - 4, 0xFF, 4);
+	os_memcpy(record + 1, data, length);
+	if (spi_flash_write(SPILL_ADDR(spill_write_sector, spill_write_offset),
+	        spill_buf, size) != SPI_FLASH_RESULT_OK)
+	{
+		return(FALSE);
+	}
+	spill_write_offset += size;
+	return(TRUE);
+}
+
+/**
+ * Move the read position on to the oldest unsent record and read its
+ * header; FALSE if there are none.
+ */
+LOCAL bool ICACHE_FLASH_ATTR spill_seek(SPILL_RECORD *record)
+{
+	while (spill_write_sector >= 0)
+	{
+		record->length = SPILL_FREE;
+		if (spill_read_offset + sizeof(*record) <= SPI_FLASH_SEC_SIZE)
+		{
+			spi_flash_read(SPILL_ADDR(spill_read_sector, spill_read_offset),
+			    (uint32 *)record, sizeof(*record));
+		}
+
+		if (record->length == SPILL_FREE)
+		{
+			/**
+			 * The end of this sector; on to the next unless we have caught
+			 * up with the writer.
+			 */
+			if (spill_read_sector == spill_write_sector)
+			{
+				return(FALSE);
+			}
+			spill_read_sector = (spill_read_sector + 1) % CFG_SPILL_FLASH_COUNT;
+			spill_read_offset = sizeof(SPILL_SECTOR);
+			if (!spill_sector_valid(spill_read_sector, NULL))
+			{
+				spill_read_offset = SPI_FLASH_SEC_SIZE;
+			}
+			continue;
+		}
+
+		if (record->state == SPILL_FREE)
+		{
+			return(TRUE);
+		}
+		spill_read_offset += sizeof(*record) + SPILL_PADDED(record->length);
+	}
+	return(FALSE);
+}
+
+/**
+ * Copy the oldest unsent record into 'data', which must have room for the
+ * length rounded up to a word, and return its length; 0 if there are none.
+ * The same record is returned again until spill_consume() is called.
+ * Records longer than 'max' are skipped.
+ */
+uint16 ICACHE_FLASH_ATTR spill_read(uint32 *data, uint16 max)
+{
+	SPILL_RECORD record;
+
+	while (spill_seek(&record))
+	{
+		if (record.length <= max)
+		{
+			spi_flash_read(SPILL_ADDR(spill_read_sector,
+			    spill_read_offset + sizeof(record)),
+			    data, SPILL_PADDED(record.length));
+			spill_last_sector = spill_read_sector;
+			spill_last_offset = spill_read_offset;
+			spill_last_length = record.length;
+			return(record.length);
+		}
+		spill_read_offset += sizeof(record) + SPILL_PADDED(record.length);
+	}
+	return(0);
+}
+
+/**
+ * The number of sectors that hold unsent records, 0 if there are none.
+ */
+int ICACHE_FLASH_ATTR spill_backlog(void)
+{
+	SPILL_RECORD record;
+
+	if (!spill_seek(&record))
+	{
+		return(0);
+	}
+	return(((spill_write_sector - spill_read_sector + CFG_SPILL_FLASH_COUNT) %
+	    CFG_SPILL_FLASH_COUNT) + 1);
+}
+
+/**
+ * Mark the record last returned by spill_read() as sent.  Writing can only
+ * clear bits so the header is rewritten with the state cleared.
+ */
+void ICACHE_FLASH_ATTR spill_consume(void)
+{
+	SPILL_RECORD record;
+
+	// Not if the sector has been reused since.
+	if ((spill_last_sector != spill_read_sector) ||
+	    (spill_last_offset != spill_read_offset))
+	{
+		return;
+	}
+
+	record.length = spill_last_length;
+	record.state = SPILL_SENT;
+	spi_flash_write(SPILL_ADDR(spill_read_sector, spill_last_offset),
+	    (uint32 *)&record, sizeof(record));
+	spill_read_offset += sizeof(record) + SPILL_PADDED(spill_last_length);
+	spill_last_sector = -1;
+}
+
+/**
+ * Sectors reused before all of their records had been read.
+ */
+uint32 ICACHE_FLASH_ATTR spill_lost(void)
+{
+	return(spill_lost_count);
+}
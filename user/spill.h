@@ -0,0 +1,32 @@
+/**
+ * A ring of flash sectors that holds log records which will not fit in
+ * memory, for example during a long WiFi outage, until they can be sent.
+ *
+ * Records are appended in order and each is marked as sent, by clearing
+ * bits in its header, once it has been taken back out so the backlog
+ * survives a reboot.  The sectors are used in turn, each numbered so the
+ * ring carries on where it left off after a reboot, which spreads the wear
+ * evenly.  When the ring is full the oldest sector is reused.
+ *
+ * 1. Call spill_setup() once to find the ring's state.
+ * 2. spill_write() adds a record.
+ * 3. spill_read() returns the oldest unsent record; call spill_consume()
+ *    once it has been dealt with.  spill_backlog() says how much is
+ *    waiting.
+ */
+#ifndef SPILL_H
+#define SPILL_H
+
+/**
+ * The largest record that can be spilled.
+ */
+#define SPILL_MAX_RECORD	256
+
+void spill_setup(void);
+bool spill_write(const uint8 *data, uint16 length);
+uint16 spill_read(uint32 *data, uint16 max);
+void spill_consume(void);
+int spill_backlog(void);
+uint32 spill_lost(void);
+
+#endif
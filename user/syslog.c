@@ -1,14 +1,23 @@
+/**
+ * What is sent is CONSOLE_DEBUG; the queue's progress is traced.
+ */
+#define CONSOLE_LEVEL CONSOLE_LEVEL_INFO
+
 #include "ets_sys.h"
 #include "osapi.h"
 #include "os_type.h"
 #include "user_interface.h"
-#include "mem.h"
 #include "espconn.h"
 #include "stdarg.h"
 #include "config.h"
 #include "logging.h"
-#define DEFINE_VARS
+#include "trace.h"
 #include "syslog.h"
+#include "sntp.h"
+#include "msg.h"
+#include "rodata.h"
+#include "spill.h"
+#include "pool.h"
 
 /**
  * Some online syslog servers cannot handle structured data and the
@@ -18,33 +27,187 @@
 
 #define SYSLOG_IP_LEN   16
 #define SYSLOG_BUF_SIZE   256
-#define SYSLOG_STACK_DEPTH 8
 #define SYSLOG_DUMMY_IP   "0.0.0.0"
 #define SYSLOG_VERSION      1
 #define SYSLOG_MAX_HOSTNAME 256
 
+/**
+ * Messages waiting to be sent are held in a ring of bytes where each one
+ * takes just its own length plus a two byte header; most messages are much
+ * shorter than SYSLOG_BUF_SIZE so this holds many more of them than fixed
+ * slots would.
+ *
+ * A message is never split across the end of the arena so that it can be
+ * sent straight from there.  If it will not fit at the end, SYSLOG_WRAP is
+ * written in place of a length and the message goes at the start instead.
+ * Records are padded to an even length to keep the headers aligned.
+ */
+#define SYSLOG_ARENA_SIZE   2048
+#define SYSLOG_HDR_LEN      2
+#define SYSLOG_WRAP         0xFFFF
+#define SYSLOG_RECORD_LEN(len) (((len) + SYSLOG_HDR_LEN + 1) & ~1)
+
+/**
+ * Define to queue messages as their ID, time and packed arguments (a
+ * SYSLOG_PACKED_HDR header then the arguments) and only format them when
+ * they are sent.  This makes syslog() cheap and a queued message around a
+ * tenth of the size.  Strings are truncated to SYSLOG_STR_MAX.
+ */
+#define SYSLOG_DEFERRED
+#define SYSLOG_PACKED_HDR   7
+#define SYSLOG_PACKED_MAX   96
+#define SYSLOG_STR_MAX      32
+
+/**
+ * The longest structured data format in the message catalog.
+ */
+#define SYSLOG_PARMS_MAX    96
+
+/**
+ * When the arena is full we normally drop new messages so that the ones
+ * that show what went wrong first are kept.  Define this to discard the
+ * oldest messages instead.
+ */
+// #define SYSLOG_OVERWRITE_OLDEST
+
+/**
+ * With CFG_SYSLOG_TCP messages go over a TCP connection that is kept open,
+ * framed by octet counting (RFC6587) so that as many queued messages as fit
+ * in SYSLOG_TCP_BATCH are sent together in one segment.  Messages are only
+ * removed from the queue once the segment has been sent so a dropped
+ * connection loses nothing; the batch is sent again on reconnection.
+ *
+ * Reconnection attempts back off from SYSLOG_TCP_RETRY_MIN to
+ * SYSLOG_TCP_RETRY_MAX ms.
+ */
+#define SYSLOG_TCP_BATCH      1024
+#define SYSLOG_TCP_RETRY_MIN  1000
+#define SYSLOG_TCP_RETRY_MAX  64000
+
+#ifdef CFG_SYSLOG_TCP
+#define SYSLOG_PROTO(conn)  ((conn)->proto.tcp)
+#else
+#define SYSLOG_PROTO(conn)  ((conn)->proto.udp)
+#endif
+
+/**
+ * The syslog server's address is cached, in RTC memory too so that it
+ * survives a reboot, and used straight away when we get an IP address.  It
+ * is looked up again in the background every SYSLOG_DNS_TTL_MS; the SDK
+ * resolver does not tell us the real TTL.  Failed lookups are retried from
+ * SYSLOG_DNS_RETRY_MIN ms, doubling up to SYSLOG_DNS_RETRY_MAX ms.
+ */
+#define SYSLOG_DNS_TTL_MS     (60 * 60 * 1000)
+#define SYSLOG_DNS_RETRY_MIN  2000
+#define SYSLOG_DNS_RETRY_MAX  (5 * 60 * 1000)
+#define SYSLOG_DNS_MAGIC      0x534c4f47
+
+/**
+ * Messages that do not fit in the arena, whether because the network is
+ * down or because they are arriving faster than they can be sent, go to
+ * the flash spill ring (see spill.h) rather than being lost.  Once we are
+ * connected they are fed back in SYSLOG_REPLAY_BATCH at a time every
+ * SYSLOG_REPLAY_MS, and only while the arena is less than SYSLOG_REPLAY_ROOM
+ * full, so that the backlog does not crowd out new messages.
+ */
+#define SYSLOG_REPLAY_MS      250
+#define SYSLOG_REPLAY_BATCH   2
+#define SYSLOG_REPLAY_ROOM    (SYSLOG_ARENA_SIZE / 2)
+
+/**
+ * Events logged by syslog_isr(), waiting for syslog_isr_task().  Must be a
+ * power of two no bigger than 128.
+ */
+#define SYSLOG_ISR_EVENTS     16
+
+typedef struct syslog_isr_event
+{
+	uint8 msg_id;
+	uint32 time_us;
+	uint32 a0;
+	uint32 a1;
+} SYSLOG_ISR_EVENT;
+
+typedef struct syslog_dns_cache
+{
+	uint32 magic;
+	uint32 hash;
+	ip_addr_t addr;
+} SYSLOG_DNS_CACHE;
+
+RODATA_ASSERT(syslog_rtc_size,
+    sizeof(SYSLOG_DNS_CACHE) <= 4 * CFG_RTC_SYSLOG_DNS_BLOCKS);
+
+/**
+ * The arena and the fixed size buffers come from pools so that the memory
+ * is set aside at link time; the hostname, the formatted message and the
+ * record being replayed from flash each take a SYSLOG_BUF_SIZE block.
+ */
+POOL(syslog_arena_pool, SYSLOG_ARENA_SIZE, 1);
+POOL(syslog_buf_pool, SYSLOG_BUF_SIZE, 3);
+#ifdef CFG_SYSLOG_TCP
+POOL(syslog_batch_pool, SYSLOG_TCP_BATCH, 1);
+#endif
+RODATA_ASSERT(syslog_buf_hostname, SYSLOG_MAX_HOSTNAME <= SYSLOG_BUF_SIZE);
+RODATA_ASSERT(syslog_buf_spill, SPILL_MAX_RECORD <= SYSLOG_BUF_SIZE);
+
 // Parameters provided by the application.
 char *syslog_hostname = NULL;
 const char *syslog_app_name;
 const char **syslog_procs;
 const SYSLOG_MSG *syslog_msgs;
 
-char *syslog_ip_address = NULL;
-char *syslog_stack[SYSLOG_STACK_DEPTH];
-uint16 syslog_length[SYSLOG_STACK_DEPTH] = { 0 };
+char syslog_ip_address[SYSLOG_IP_LEN];
 
 /**
- * The syslog code reads from the 'head' of the stack.
- * Callers write to the 'tail' of the stack.
- * The stack contains 'depth' number of entries.
+ * The catalog is in flash so the parts of a message that are needed are
+ * copied here first.
  */
-int syslog_stack_head = 0;
-int syslog_stack_tail = 0;
-int syslog_stack_depth = 0;
-int syslog_buf_len = 0;
+char syslog_parms[SYSLOG_PARMS_MAX];
+
+/**
+ * The syslog code reads from the 'head' of the arena.
+ * Callers write to the 'tail' of the arena.
+ * 'used' counts the bytes between them, including any skipped at the end.
+ */
+uint8 *syslog_arena = NULL;
+char *syslog_buf = NULL;
+int syslog_head = 0;
+int syslog_tail = 0;
+int syslog_used = 0;
+
+/**
+ * Messages lost because the arena and the spill ring were full, and the
+ * totals last reported.
+ */
+uint32 syslog_dropped = 0;
+uint32 syslog_overwritten = 0;
+uint32 syslog_lost_reported = 0;
+
+/**
+ * Messages written to and taken back from flash.
+ */
+uint32 syslog_spilled = 0;
+uint32 syslog_replayed = 0;
+uint32 syslog_replay_reported = 0;
+bool syslog_replaying = FALSE;
+os_timer_t syslog_replay_timer;
+uint32 *syslog_replay_buf = NULL;
+
 bool syslog_sending = FALSE;
-struct espconn *syslog_conn = NULL;
-esp_udp *syslog_udp = NULL;
+struct espconn syslog_connection;
+struct espconn *syslog_conn = &syslog_connection;
+#ifdef CFG_SYSLOG_TCP
+esp_tcp syslog_tcp;
+uint8 *syslog_batch = NULL;
+int syslog_batch_count = 0;
+bool syslog_connected = FALSE;
+bool syslog_connecting = FALSE;
+uint32 syslog_retry_ms = SYSLOG_TCP_RETRY_MIN;
+os_timer_t syslog_retry_timer;
+#else
+esp_udp syslog_udp;
+#endif
 
 /**
  * The syslog is 'inactive' when we believe that there is no IP connectivity.
@@ -53,84 +216,530 @@ bool syslog_inactive = TRUE;
 ip_addr_t syslog_addr;
 struct espconn syslog_espconn;
 
+/**
+ * The interrupt side only writes 'head' and the task only writes 'tail';
+ * both count up and wrap so the ring is full when they differ by
+ * SYSLOG_ISR_EVENTS.
+ */
+SYSLOG_ISR_EVENT syslog_isr_ring[SYSLOG_ISR_EVENTS];
+volatile uint8 syslog_isr_head = 0;
+volatile uint8 syslog_isr_tail = 0;
+volatile uint32 syslog_isr_lost = 0;
+uint32 syslog_isr_lost_reported = 0;
+os_event_t syslog_isr_queue[2];
+
+/**
+ * The cached address; 'fresh' is FALSE when it came from RTC memory and so
+ * may be old.
+ */
+SYSLOG_DNS_CACHE syslog_dns;
+bool syslog_dns_valid = FALSE;
+bool syslog_dns_fresh = FALSE;
+bool syslog_resolving = FALSE;
+bool syslog_dns_due = FALSE;
+uint32 syslog_dns_retry_ms = SYSLOG_DNS_RETRY_MIN;
+os_timer_t syslog_dns_timer;
+
 static void syslog_sendto();
 static void syslog_sendto_callback(void *arg);
+static bool ICACHE_FLASH_ATTR syslog_ip_inactive(void);
+#ifdef CFG_SYSLOG_TCP
+static void ICACHE_FLASH_ATTR syslog_tcp_connect(void);
+static void ICACHE_FLASH_ATTR syslog_tcp_connected(void *arg);
+static void ICACHE_FLASH_ATTR syslog_tcp_disconnected(void *arg);
+static void ICACHE_FLASH_ATTR syslog_tcp_error(void *arg, sint8 err);
+static void ICACHE_FLASH_ATTR syslog_send_batch(void);
+#endif
+static void ICACHE_FLASH_ATTR syslog_replay_start(void);
+static void ICACHE_FLASH_ATTR syslog_isr_task(os_event_t *e);
+#ifdef SYSLOG_DEFERRED
+static int ICACHE_FLASH_ATTR syslog_unpack(const uint8 *record, uint16 length);
+#endif
 
-int syslog_write_index()
+/**
+ * Step through the queued messages.  'pos' and 'left' start as the head and
+ * the bytes used and are moved on past the message returned.
+ */
+static uint8 * ICACHE_FLASH_ATTR syslog_record(int *pos, int *left,
+    uint16 *length)
+{
+	uint8 *record;
+	uint16 len;
+
+	if (*left <= 0)
+	{
+		return(NULL);
+	}
+
+	if (*pos + SYSLOG_HDR_LEN <= SYSLOG_ARENA_SIZE)
+	{
+		os_memcpy(&len, &syslog_arena[*pos], SYSLOG_HDR_LEN);
+	}
+	else
+	{
+		len = SYSLOG_WRAP;
+	}
+
+	if (len == SYSLOG_WRAP)
+	{
+		*left -= SYSLOG_ARENA_SIZE - *pos;
+		*pos = 0;
+		os_memcpy(&len, &syslog_arena[0], SYSLOG_HDR_LEN);
+	}
+
+	record = &syslog_arena[*pos + SYSLOG_HDR_LEN];
+	*pos += SYSLOG_RECORD_LEN(len);
+	*left -= SYSLOG_RECORD_LEN(len);
+	*length = len;
+	return(record);
+}
+
+/**
+ * Return the oldest message in the arena, and its length, or NULL if there
+ * are none.
+ */
+static uint8 * ICACHE_FLASH_ATTR syslog_peek(uint16 *length)
 {
-	int write_index = syslog_stack_tail;
+	uint8 *record;
+	int pos = syslog_head;
+	int left = syslog_used;
 
-	/**
-	 * If the stack is full, we continue overwriting the last entry so that
-	 * the first (depth-1) entries reflect what went wrong when the stack
-	 * blocked.
-	 */
-	if (syslog_stack_depth < SYSLOG_STACK_DEPTH)
+	record = syslog_record(&pos, &left, length);
+	if (record != NULL)
 	{
-		syslog_stack_depth++;
-		if (syslog_stack_depth < SYSLOG_STACK_DEPTH)
+		// Step over any wrap marker for good.
+		syslog_head = pos - SYSLOG_RECORD_LEN(*length);
+		syslog_used = left + SYSLOG_RECORD_LEN(*length);
+	}
+	return(record);
+}
+
+/**
+ * Remove the oldest message, as returned by syslog_peek().
+ */
+static void ICACHE_FLASH_ATTR syslog_consume(uint16 length)
+{
+	syslog_head += SYSLOG_RECORD_LEN(length);
+	syslog_used -= SYSLOG_RECORD_LEN(length);
+	if (syslog_used == 0)
+	{
+		syslog_head = 0;
+		syslog_tail = 0;
+	}
+}
+
+/**
+ * Make room for a message of the given length and return where it goes, or
+ * NULL if it has been dropped.
+ */
+static uint8 * ICACHE_FLASH_ATTR syslog_reserve(uint16 length)
+{
+	int need = SYSLOG_RECORD_LEN(length);
+	uint16 old;
+	uint8 *record;
+
+	if (need > SYSLOG_ARENA_SIZE)
+	{
+		return(NULL);
+	}
+
+	while (TRUE)
+	{
+		if ((syslog_used == 0) || (syslog_tail > syslog_head))
 		{
-			syslog_stack_tail++;
-			if (syslog_stack_tail >= SYSLOG_STACK_DEPTH)
+			if (syslog_tail + need <= SYSLOG_ARENA_SIZE)
+			{
+				break;
+			}
+			if ((syslog_used == 0) || (need <= syslog_head))
 			{
 				/**
-				 * Writing is wrapping to the start of the array.
+				 * Skip the rest of the arena and start again at the front.
 				 */
-				syslog_stack_tail = 0;
+				if (syslog_tail + SYSLOG_HDR_LEN <= SYSLOG_ARENA_SIZE)
+				{
+					old = SYSLOG_WRAP;
+					os_memcpy(&syslog_arena[syslog_tail], &old, SYSLOG_HDR_LEN);
+				}
+				syslog_used += SYSLOG_ARENA_SIZE - syslog_tail;
+				syslog_tail = 0;
+				break;
 			}
 		}
+		else if (syslog_tail + need <= syslog_head)
+		{
+			break;
+		}
+
+#ifdef SYSLOG_OVERWRITE_OLDEST
+		record = syslog_peek(&old);
+		if (spill_write(record, old))
+		{
+			syslog_spilled++;
+			syslog_replay_start();
+		}
+		else
+		{
+			syslog_overwritten++;
+		}
+		syslog_consume(old);
+#else
+		return(NULL);
+#endif
 	}
 
-	CONSOLE("wi: %d, %d, %d, %d", write_index, syslog_stack_depth, syslog_stack_tail, SYSLOG_STACK_DEPTH);
-	return(write_index);
+	record = &syslog_arena[syslog_tail];
+	os_memcpy(record, &length, SYSLOG_HDR_LEN);
+	syslog_tail += need;
+	syslog_used += need;
+	return(record + SYSLOG_HDR_LEN);
 }
 
+/**
+ * Queue a message, in flash if there is no room for it in the arena.
+ */
+static void ICACHE_FLASH_ATTR syslog_queue(const uint8 *data, uint16 length)
+{
+	uint8 *record = syslog_reserve(length);
 
-static void ICACHE_FLASH_ATTR syslog_dns_callback(const char * hostname, ip_addr_t * addr, void * arg)
+	if (record != NULL)
+	{
+		os_memcpy(record, data, length);
+	}
+	else if (spill_write(data, length))
+	{
+		syslog_spilled++;
+		syslog_replay_start();
+	}
+	else
+	{
+		syslog_dropped++;
+	}
+}
+
+/**
+ * Feed a few spilled messages back into the arena, oldest first.
+ */
+static void ICACHE_FLASH_ATTR syslog_replay(void *arg)
+{
+	uint16 length;
+	uint8 *record;
+	int ii;
+
+	if (syslog_inactive)
+	{
+		os_timer_disarm(&syslog_replay_timer);
+		syslog_replaying = FALSE;
+		return;
+	}
+
+	for (ii = 0; ii < SYSLOG_REPLAY_BATCH; ii++)
+	{
+		if (syslog_used > SYSLOG_REPLAY_ROOM)
+		{
+			break;
+		}
+
+		length = spill_read(syslog_replay_buf, SPILL_MAX_RECORD);
+		if (length == 0)
+		{
+			os_timer_disarm(&syslog_replay_timer);
+			syslog_replaying = FALSE;
+			if (syslog_replayed != syslog_replay_reported)
+			{
+				syslog_replay_reported = syslog_replayed;
+				syslog(SMSG_SLOG_REPLAYED, syslog_spilled, syslog_replayed,
+				    spill_lost());
+			}
+			break;
+		}
+
+		record = syslog_reserve(length);
+		if (record == NULL)
+		{
+			break;
+		}
+		os_memcpy(record, syslog_replay_buf, length);
+		spill_consume();
+		syslog_replayed++;
+	}
+	syslog_sendto();
+}
+
+/**
+ * Start replaying the spill ring if we are connected.
+ */
+static void ICACHE_FLASH_ATTR syslog_replay_start(void)
+{
+	if ((!syslog_inactive) && (!syslog_replaying))
+	{
+		syslog_replaying = TRUE;
+		os_timer_arm(&syslog_replay_timer, SYSLOG_REPLAY_MS, TRUE);
+	}
+}
+
+/**
+ * A hash of the server name so that a cached address for a different
+ * server is not used.
+ */
+static uint32 ICACHE_FLASH_ATTR syslog_dns_hash(const char *hostname)
+{
+	uint32 hash = 2166136261UL;
+
+	while (*hostname != '\0')
+	{
+		hash = (hash ^ (uint8)*hostname++) * 16777619UL;
+	}
+	return(hash);
+}
+
+/**
+ * Start sending to the given server address.
+ */
+static void ICACHE_FLASH_ATTR syslog_use_address(ip_addr_t *addr)
 {
 	sint8 rc;
 
-	/**
-	 * Store the target IP address.
-	 */
+	os_memcpy(SYSLOG_PROTO(syslog_conn)->remote_ip, addr, 4);
+	CONSOLE_INFO("syslog: local IP address:port = " IPSTR ":%d", IP2STR(SYSLOG_PROTO(syslog_conn)->local_ip), SYSLOG_PROTO(syslog_conn)->local_port);
+	CONSOLE_INFO("syslog: remote IP address:port = " IPSTR ":%d", IP2STR(SYSLOG_PROTO(syslog_conn)->remote_ip), SYSLOG_PROTO(syslog_conn)->remote_port);
+	syslog_inactive = FALSE;
+	syslog_replay_start();
+#ifdef CFG_SYSLOG_TCP
+	if (syslog_connected || syslog_connecting)
+	{
+		// Moved; the reconnection goes to the new address.
+		espconn_disconnect(syslog_conn);
+		return;
+	}
+	syslog_retry_ms = SYSLOG_TCP_RETRY_MIN;
+	syslog_tcp_connect();
+#else
+	rc = espconn_create(syslog_conn);
+	if (rc == 0)
+	{
+		rc = espconn_regist_sentcb(syslog_conn, syslog_sendto_callback);
+	}
+	if (rc != 0)
+	{
+		// Already created on an earlier connection.
+		CONSOLE_DEBUG("syslog: create UDP connection: %d", (int)rc);
+	}
+	syslog_sendto();
+#endif
+}
+
+static void ICACHE_FLASH_ATTR syslog_dns_callback(const char * hostname, ip_addr_t * addr, void * arg)
+{
+	bool changed;
+
+	syslog_resolving = FALSE;
+	os_timer_disarm(&syslog_dns_timer);
+
 	if (addr != NULL)
 	{
-	    // // CONSOLE("syslog: Hostname: %s, IP address: " IPSTR, hostname, IP2STR(addr));
-        os_memcpy(syslog_conn->proto.udp->remote_ip, addr, 4);
-	    // // CONSOLE("syslog: Hostname: %s, IP address: " IPSTR, hostname, IP2STR(addr));
-	    CONSOLE("syslog: local IP address:port = " IPSTR ":%d", IP2STR(syslog_conn->proto.udp->local_ip), syslog_conn->proto.udp->local_port);
-	    CONSOLE("syslog: remote IP address:port = " IPSTR ":%d", IP2STR(syslog_conn->proto.udp->remote_ip), syslog_conn->proto.udp->remote_port);
-        syslog_inactive = FALSE;
-        rc = espconn_create(syslog_conn);
-        if (rc == 0)
-        {
-      	    rc = espconn_regist_sentcb(syslog_conn, syslog_sendto_callback);
-        }
-        if (rc != 0)
-        {
-        	// CONSOLE("syslog: create UDP connection failed: %d", (int)rc);
-        }
-        syslog_sendto();
+		changed = (!syslog_dns_valid) ||
+		    (os_memcmp(&syslog_dns.addr, addr, sizeof(ip_addr_t)) != 0);
+
+		/**
+		 * Keep the address, in RTC memory too, and look it up again later.
+		 */
+		syslog_dns.magic = SYSLOG_DNS_MAGIC;
+		syslog_dns.hash = syslog_dns_hash(syslog_hostname);
+		os_memcpy(&syslog_dns.addr, addr, sizeof(ip_addr_t));
+		syslog_dns_valid = TRUE;
+		syslog_dns_fresh = TRUE;
+		syslog_dns_retry_ms = SYSLOG_DNS_RETRY_MIN;
+		if (changed)
+		{
+			system_rtc_mem_write(CFG_RTC_SYSLOG_DNS, &syslog_dns, sizeof(syslog_dns));
+		}
+		os_timer_arm(&syslog_dns_timer, SYSLOG_DNS_TTL_MS, FALSE);
+
+		if ((changed || syslog_inactive) && (!syslog_ip_inactive()))
+		{
+			syslog_use_address(&syslog_dns.addr);
+		}
 	}
 	else
 	{
-		// CONSOLE("syslog: gethostbyname() for '%s' failed!", hostname);
+		/**
+		 * Try again later; until then any cached address is still used.
+		 */
+		syslog(SMSG_SLOG_DNS_FAILED, syslog_hostname, syslog_dns_retry_ms / 1000);
+		os_timer_arm(&syslog_dns_timer, syslog_dns_retry_ms, FALSE);
+		syslog_dns_retry_ms *= 2;
+		if (syslog_dns_retry_ms > SYSLOG_DNS_RETRY_MAX)
+		{
+			syslog_dns_retry_ms = SYSLOG_DNS_RETRY_MAX;
+		}
 	}
 }
 
+/**
+ * Look up the server's address.  Also the refresh and retry timer function.
+ */
 static void ICACHE_FLASH_ATTR syslog_gethostbyname()
 {
-	// // CONSOLE("syslog: IN gethostbyname()");
-	err_t error = espconn_gethostbyname(&syslog_espconn,
+	err_t error;
+
+	if (syslog_ip_inactive())
+	{
+		// Offline; do it when we get an IP address again.
+		syslog_dns_due = TRUE;
+		return;
+	}
+	if (syslog_resolving)
+	{
+		return;
+	}
+	syslog_dns_due = FALSE;
+
+	syslog_resolving = TRUE;
+	error = espconn_gethostbyname(&syslog_espconn,
                                      syslog_hostname, &syslog_addr, syslog_dns_callback);
 	if (error == ESPCONN_OK) {
                  // Already in the local names table (or hostname was an IP address), execute the callback ourselves.
                  syslog_dns_callback(syslog_hostname, &syslog_addr, NULL);
 	}
 	else if (error != ESPCONN_INPROGRESS) {
-		// CONSOLE("Failed with error: %d", error);
+		CONSOLE_WARN("syslog: gethostbyname failed with error: %d", error);
+		syslog_dns_callback(syslog_hostname, NULL, NULL);
 	}
-	// // CONSOLE("syslog: OUT gethostbyname()");
+}
+
+#ifdef CFG_SYSLOG_TCP
+/**
+ * Open the connection to the syslog server.  Also the retry timer function.
+ */
+static void ICACHE_FLASH_ATTR syslog_tcp_connect(void)
+{
+	sint8 rc;
+
+	if (syslog_inactive || syslog_connected || syslog_connecting)
+	{
+		return;
+	}
+
+	syslog_connecting = TRUE;
+	syslog_conn->proto.tcp->local_port = espconn_port();
+	rc = espconn_connect(syslog_conn);
+	if (rc != 0)
+	{
+		CONSOLE_WARN("syslog: connect failed: %d", rc);
+		syslog_tcp_error(syslog_conn, rc);
+	}
+}
+
+/**
+ * Try to connect again later, waiting twice as long each time.
+ */
+static void ICACHE_FLASH_ATTR syslog_tcp_retry(void)
+{
+	syslog_connected = FALSE;
+	syslog_connecting = FALSE;
+	syslog_sending = FALSE;
+	syslog_batch_count = 0;
+
+	if (!syslog_inactive)
+	{
+		CONSOLE_INFO("syslog: reconnect in %dms", syslog_retry_ms);
+		os_timer_disarm(&syslog_retry_timer);
+		os_timer_arm(&syslog_retry_timer, syslog_retry_ms, FALSE);
+		syslog_retry_ms *= 2;
+		if (syslog_retry_ms > SYSLOG_TCP_RETRY_MAX)
+		{
+			syslog_retry_ms = SYSLOG_TCP_RETRY_MAX;
+		}
+	}
+}
+
+static void ICACHE_FLASH_ATTR syslog_tcp_connected(void *arg)
+{
+	CONSOLE_INFO("syslog: connected");
+	syslog_connected = TRUE;
+	syslog_connecting = FALSE;
+	syslog_retry_ms = SYSLOG_TCP_RETRY_MIN;
+	syslog_sendto();
+}
+
+static void ICACHE_FLASH_ATTR syslog_tcp_disconnected(void *arg)
+{
+	CONSOLE_INFO("syslog: disconnected");
+	syslog_tcp_retry();
+}
+
+static void ICACHE_FLASH_ATTR syslog_tcp_error(void *arg, sint8 err)
+{
+	CONSOLE_WARN("syslog: connection error: %d", err);
+	syslog_tcp_retry();
+}
+
+/**
+ * Send as many queued messages as fit in one segment, each framed as
+ * "<length> <message>".  They stay queued until the sent callback.
+ */
+static void ICACHE_FLASH_ATTR syslog_send_batch(void)
+{
+	uint8 *record;
+	uint8 *message;
+	uint16 length;
+	char prefix[8];
+	int prefix_len;
+	int message_len;
+	int pos = syslog_head;
+	int left = syslog_used;
+	int total = 0;
+	int count = 0;
+	sint8 rc;
+
+	while ((record = syslog_record(&pos, &left, &length)) != NULL)
+	{
+#ifdef SYSLOG_DEFERRED
+		message_len = syslog_unpack(record, length);
+		message = (uint8 *)syslog_buf;
+#else
+		message_len = length;
+		message = record;
+#endif
+		prefix_len = os_sprintf(prefix, "%d ", message_len);
+		if (total + prefix_len + message_len > SYSLOG_TCP_BATCH)
+		{
+			break;
+		}
+		os_memcpy(&syslog_batch[total], prefix, prefix_len);
+		total += prefix_len;
+		os_memcpy(&syslog_batch[total], message, message_len);
+		total += message_len;
+		count++;
+	}
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	rc = espconn_sent(syslog_conn, syslog_batch, total);
+	if (rc == 0)
+	{
+		syslog_batch_count = count;
+		syslog_sending = TRUE;
+	}
+	else
+	{
+		// Left queued; tried again with the next message.
+		CONSOLE_ERROR("Error: syslog, sent failed: %d", rc);
+	}
+	TRACE2(TRACE_SYSLOG_BATCH, count, total);
+}
+#endif
+
+/**
+ * Have we an IP address of our own?
+ */
+static bool ICACHE_FLASH_ATTR syslog_ip_inactive(void)
+{
+	return(os_strcmp(syslog_ip_address, SYSLOG_DUMMY_IP) == 0);
 }
 
 /**
@@ -140,19 +749,33 @@ void ICACHE_FLASH_ATTR syslog_start(void)
 {
 	struct ip_info info;
 
-	// // CONSOLE("syslog: IN: start()");
-
+	if (syslog_arena == NULL)
+	{
+		return;
+	}
 	if (wifi_get_ip_info(0x00, &info))
 	{
 		os_sprintf(syslog_ip_address, IPSTR, IP2STR(&info.ip));
-		os_memcpy(syslog_conn->proto.udp->local_ip, &info.ip, 4);
+		os_memcpy(SYSLOG_PROTO(syslog_conn)->local_ip, &info.ip, 4);
 
 		/**
-		 * We can now resolve the hostname (perhaps again!).
+		 * Carry on with the address we already know, if any, rather than
+		 * waiting for DNS.  One from before a reboot may be out of date so
+		 * check it now, in the background.
 		 */
-		syslog_gethostbyname();
+		if (syslog_dns_valid)
+		{
+			syslog_use_address(&syslog_dns.addr);
+			if ((!syslog_dns_fresh) || syslog_dns_due)
+			{
+				syslog_gethostbyname();
+			}
+		}
+		else
+		{
+			syslog_gethostbyname();
+		}
 	}
-	// // CONSOLE("syslog: OUT: start()");
 }
 
 /**
@@ -162,6 +785,49 @@ void ICACHE_FLASH_ATTR syslog_stop(void)
 {
   syslog_inactive = TRUE;
   os_sprintf(syslog_ip_address, SYSLOG_DUMMY_IP);
+#ifdef CFG_SYSLOG_TCP
+  os_timer_disarm(&syslog_retry_timer);
+  if (syslog_connected || syslog_connecting)
+  {
+    espconn_disconnect(syslog_conn);
+  }
+  syslog_connected = FALSE;
+  syslog_connecting = FALSE;
+  syslog_sending = FALSE;
+  syslog_batch_count = 0;
+#endif
+}
+
+/**
+ * Has everything queued been sent?  Messages waiting in flash count too.
+ */
+bool ICACHE_FLASH_ATTR syslog_drained(void)
+{
+	return((syslog_used == 0) && (!syslog_sending) && (!syslog_replaying) &&
+	    (spill_backlog() == 0));
+}
+
+/**
+ * Move everything queued in memory to the spill ring, for example before
+ * a deep sleep which loses the arena, to be sent after the next connect.
+ */
+void ICACHE_FLASH_ATTR syslog_flush(void)
+{
+	uint16 length;
+	uint8 *record;
+
+	while ((record = syslog_peek(&length)) != NULL)
+	{
+		if (spill_write(record, length))
+		{
+			syslog_spilled++;
+		}
+		else
+		{
+			syslog_dropped++;
+		}
+		syslog_consume(length);
+	}
 }
 
 /**
@@ -173,30 +839,37 @@ static void syslog_sendto()
 	uint8 *buffer;
 	uint16 length;
 
+#ifdef CFG_SYSLOG_TCP
+	if (syslog_sending || syslog_inactive || (!syslog_connected))
+#else
 	if (syslog_sending || syslog_inactive)
+#endif
 	{
 		/**
 		 * Already sending or no IP so buffer this.
 		 */
-		CONSOLE("inactive %d, sending %d", syslog_sending, syslog_inactive);
+		CONSOLE_DEBUG("inactive %d, sending %d", syslog_sending, syslog_inactive);
 	}
 	else
 	{
-		CONSOLE("syslog: %d, %d, %d", rc, syslog_stack_head, syslog_stack_tail);
+		TRACE3(TRACE_SYSLOG_QUEUE, rc, syslog_head, syslog_tail);
+#ifdef CFG_SYSLOG_TCP
+		syslog_send_batch();
+#else
 		while ((rc == 0) &&
-		       (syslog_stack_head != syslog_stack_tail))
+		       ((buffer = syslog_peek(&length)) != NULL))
 		{
-			// Recursion!!
-			buffer = syslog_stack[syslog_stack_head];
-			length = syslog_length[syslog_stack_head];
-			syslog_stack_head++;
-			syslog_stack_depth--;
-			if (syslog_stack_head >= SYSLOG_STACK_DEPTH)
-			{
-				syslog_stack_head = 0;
-			}
+			/**
+			 * UDP sends copy the data so the message can be removed now.
+			 */
+#ifdef SYSLOG_DEFERRED
+			rc = espconn_sendto(
+					syslog_conn, (uint8 *)syslog_buf, syslog_unpack(buffer, length));
+#else
 			rc = espconn_sendto(
 					syslog_conn, buffer, length);
+#endif
+			syslog_consume(length);
 			if (rc == ESPCONN_INPROGRESS)
 			{
 				/**
@@ -206,19 +879,47 @@ static void syslog_sendto()
 			}
 			else if (rc != 0)
 			{
-				CONSOLE("Error: syslog, sendto failed: %d", rc);
+				CONSOLE_ERROR("Error: syslog, sendto failed: %d", rc);
 			}
-			CONSOLE("syslog2: %d, %d, %d", rc, syslog_stack_head, syslog_stack_tail);
+			TRACE3(TRACE_SYSLOG_QUEUE, rc, syslog_head, syslog_tail);
+		}
+#endif
+
+		/**
+		 * Once everything queued has gone, say how much did not fit.
+		 */
+		if ((syslog_used == 0) &&
+		    (syslog_dropped + syslog_overwritten != syslog_lost_reported))
+		{
+			syslog_lost_reported = syslog_dropped + syslog_overwritten;
+			syslog(SMSG_SLOG_LOST, syslog_dropped, syslog_overwritten);
 		}
-		CONSOLE("Done sending");
+		CONSOLE_DEBUG("Done sending");
 	}
 }
 
 static void syslog_sendto_callback(void *arg)
 {
 	struct espconn *connection = (struct espconn *)arg;
+	uint16 length;
 	// // // CONSOLE("Debug 15");
 
+#ifdef CFG_SYSLOG_TCP
+	if (connection == syslog_conn)
+	{
+		/**
+		 * The batch has gone so the messages in it can be removed.
+		 */
+		while ((syslog_batch_count > 0) && (syslog_peek(&length) != NULL))
+		{
+			syslog_consume(length);
+			syslog_batch_count--;
+		}
+		syslog_batch_count = 0;
+		syslog_sending = FALSE;
+		syslog_sendto();
+	}
+#else
 	if ((connection->type == ESPCONN_UDP) &&
 		(connection->proto.udp->remote_port == syslog_conn->proto.udp->remote_port) &&
 		((uint32)connection->proto.udp->remote_ip == (uint32)syslog_conn->proto.udp->remote_ip))
@@ -226,25 +927,98 @@ static void syslog_sendto_callback(void *arg)
 		syslog_sending = FALSE;
 		syslog_sendto();
 	}
+#endif
+}
+
+/**
+ * Give back whatever syslog_setup() managed to allocate.
+ */
+static void ICACHE_FLASH_ATTR syslog_release(void)
+{
+  CONSOLE_ERROR("Syslog buffers not allocated, not logging");
+  if (syslog_arena != NULL)
+  {
+    pool_free(&syslog_arena_pool, syslog_arena);
+    syslog_arena = NULL;
+  }
+  if (syslog_buf != NULL)
+  {
+    pool_free(&syslog_buf_pool, syslog_buf);
+    syslog_buf = NULL;
+  }
+  if (syslog_replay_buf != NULL)
+  {
+    pool_free(&syslog_buf_pool, syslog_replay_buf);
+    syslog_replay_buf = NULL;
+  }
+  if (syslog_hostname != NULL)
+  {
+    pool_free(&syslog_buf_pool, syslog_hostname);
+    syslog_hostname = NULL;
+  }
+#ifdef CFG_SYSLOG_TCP
+  if (syslog_batch != NULL)
+  {
+    pool_free(&syslog_batch_pool, syslog_batch);
+    syslog_batch = NULL;
+  }
+#endif
 }
 
 void ICACHE_FLASH_ATTR syslog_setup(
     char *hostname, int port, const char *app_name, const char **procs, const SYSLOG_MSG *msgs)
 {
-	char *buffer = NULL;
-	int ii;
   sint16 rc;
-  syslog_ip_address = (char *)os_zalloc(SYSLOG_IP_LEN);
-  buffer = (char *)os_zalloc(SYSLOG_BUF_SIZE * SYSLOG_STACK_DEPTH);
-  for (ii = 0; ii < SYSLOG_STACK_DEPTH; ii++)
+  bool allocated;
+
+  /**
+   * Only once; the queue may already hold messages.  Without the buffers
+   * nothing is logged: syslog_va() and syslog_start() check syslog_arena.
+   */
+  if (syslog_arena != NULL)
   {
-	  syslog_stack[ii] = buffer;
-	  buffer += SYSLOG_BUF_SIZE;
+    return;
   }
+  syslog_arena = (uint8 *)pool_alloc(&syslog_arena_pool);
+  syslog_buf = (char *)pool_alloc(&syslog_buf_pool);
+  syslog_replay_buf = (uint32 *)pool_alloc(&syslog_buf_pool);
+  syslog_hostname = (char *)pool_alloc(&syslog_buf_pool);
+  allocated = (syslog_arena != NULL) && (syslog_buf != NULL) &&
+      (syslog_replay_buf != NULL) && (syslog_hostname != NULL);
+#ifdef CFG_SYSLOG_TCP
+  syslog_batch = (uint8 *)pool_alloc(&syslog_batch_pool);
+  allocated = allocated && (syslog_batch != NULL);
+#endif
+  if (!allocated)
+  {
+    syslog_release();
+    return;
+  }
+
+  /**
+   * Anything left in flash from before a reboot is sent once we connect.
+   */
+  spill_setup();
+  os_timer_disarm(&syslog_replay_timer);
+  os_timer_setfn(&syslog_replay_timer, syslog_replay, NULL);
 
-  syslog_conn = (struct espconn *)os_zalloc(sizeof(struct espconn));
-  syslog_udp = (esp_udp *)os_zalloc(sizeof(esp_udp));
-  syslog_hostname = (char *)os_zalloc(SYSLOG_MAX_HOSTNAME);
+  system_os_task(syslog_isr_task, CFG_TASK_PRIO_SYSLOG, syslog_isr_queue,
+      sizeof(syslog_isr_queue) / sizeof(syslog_isr_queue[0]));
+
+  /**
+   * Pick up the server address from before a reboot.
+   */
+  os_timer_disarm(&syslog_dns_timer);
+  os_timer_setfn(&syslog_dns_timer, (os_timer_func_t *)syslog_gethostbyname, NULL);
+  system_rtc_mem_read(CFG_RTC_SYSLOG_DNS, &syslog_dns, sizeof(syslog_dns));
+  syslog_dns_valid = (syslog_dns.magic == SYSLOG_DNS_MAGIC) &&
+      (syslog_dns.hash == syslog_dns_hash(hostname));
+  syslog_dns_fresh = FALSE;
+
+#ifdef CFG_SYSLOG_TCP
+  os_timer_disarm(&syslog_retry_timer);
+  os_timer_setfn(&syslog_retry_timer, (os_timer_func_t *)syslog_tcp_connect, NULL);
+#endif
 
   syslog_app_name = app_name;
   syslog_procs = procs;
@@ -252,52 +1026,235 @@ void ICACHE_FLASH_ATTR syslog_setup(
   os_strncpy(syslog_hostname, hostname, SYSLOG_MAX_HOSTNAME);
   os_strcpy(syslog_ip_address, SYSLOG_DUMMY_IP);
 
+#ifdef CFG_SYSLOG_TCP
+  syslog_conn->type = ESPCONN_TCP;
+  syslog_conn->state = ESPCONN_NONE;
+  syslog_conn->proto.tcp = &syslog_tcp;
+  espconn_regist_connectcb(syslog_conn, syslog_tcp_connected);
+  espconn_regist_disconcb(syslog_conn, syslog_tcp_disconnected);
+  espconn_regist_reconcb(syslog_conn, syslog_tcp_error);
+  espconn_regist_sentcb(syslog_conn, syslog_sendto_callback);
+#else
   syslog_conn->type = ESPCONN_UDP;
-  syslog_conn->proto.udp = syslog_udp;
-  syslog_conn->proto.udp->local_port = espconn_port();
-  syslog_conn->proto.udp->remote_port = port;
+  syslog_conn->proto.udp = &syslog_udp;
+#endif
+  SYSLOG_PROTO(syslog_conn)->local_port = espconn_port();
+  SYSLOG_PROTO(syslog_conn)->remote_port = port;
   // // CONSOLE("SYSLOG - setup: %s:%d, rc: %d", hostname, port, rc);
 }
 
 /**
- * Create a SYSLOG message.  Refer to RFC5424.
+ * Copy a message's catalog entry, and its structured data format into
+ * syslog_parms, out of flash.  'parms' is NULL if the message has none.
+ */
+static void ICACHE_FLASH_ATTR syslog_get_msg(int msg_id, SYSLOG_MSG *msg)
+{
+  if ((msg_id < 0) || (msg_id > SMSG_INVALID))
+  {
+    msg_id = SMSG_INVALID;
+  }
+  rodata_memcpy(msg, &syslog_msgs[msg_id], sizeof(*msg));
+  rodata_strncpy(syslog_parms, msg->parms, sizeof(syslog_parms));
+  msg->parms = (syslog_parms[0] != '\0') ? syslog_parms : NULL;
+}
+
+/**
+ * Formats the structured data of a message; either directly from the
+ * caller's va_list or from the arguments packed by a deferred syslog().
+ */
+typedef int (*SYSLOG_PARMS_FN)(char *buffer, int space, const char *parms,
+    void *arg);
+
+#ifndef SYSLOG_DEFERRED
+static int ICACHE_FLASH_ATTR syslog_parms_va(
+    char *buffer, int space, const char *parms, void *arg)
+{
+  return(ets_vsnprintf(buffer, space, parms, *(va_list *)arg));
+}
+#endif
+
+/**
+ * Find the end of the conversion that starts at the '%'.  Returns NULL if
+ * the format is broken.
+ */
+static const char * ICACHE_FLASH_ATTR syslog_conversion(const char *format)
+{
+  format++;
+  while ((*format != '\0') && (os_strchr("-+ #0123456789.lh", *format) != NULL))
+  {
+    format++;
+  }
+  return((*format == '\0') ? NULL : format);
+}
+
+#ifdef SYSLOG_DEFERRED
+/**
+ * Pack the arguments described by the conversions in 'parms'.  Integers of
+ * all kinds are four bytes and strings are a length byte and the string,
+ * truncated to SYSLOG_STR_MAX.  Returns the number of bytes used.
+ */
+static int ICACHE_FLASH_ATTR syslog_pack(
+    uint8 *packed, int space, const char *parms, va_list argp)
+{
+  const char *conv;
+  const char *str;
+  sint32 value;
+  int used = 0;
+  int len;
+
+  while ((parms != NULL) && ((parms = os_strchr(parms, '%')) != NULL))
+  {
+    conv = syslog_conversion(parms);
+    if (conv == NULL)
+    {
+      break;
+    }
+    parms = conv + 1;
+
+    if (*conv == '%')
+    {
+      continue;
+    }
+    else if (*conv == 's')
+    {
+      str = va_arg(argp, const char *);
+      len = (str == NULL) ? 0 : os_strlen(str);
+      if (len > SYSLOG_STR_MAX)
+      {
+        len = SYSLOG_STR_MAX;
+      }
+      if (used + 1 + len > space)
+      {
+        break;
+      }
+      packed[used++] = len;
+      os_memcpy(&packed[used], str, len);
+      used += len;
+    }
+    else
+    {
+      value = va_arg(argp, sint32);
+      if (used + sizeof(value) > space)
+      {
+        break;
+      }
+      os_memcpy(&packed[used], &value, sizeof(value));
+      used += sizeof(value);
+    }
+  }
+  return(used);
+}
+
+/**
+ * The arguments packed by syslog_pack().
+ */
+typedef struct syslog_packed
+{
+  const uint8 *args;
+  const uint8 *end;
+} SYSLOG_PACKED;
+
+/**
+ * Format 'parms' using packed arguments.  Each conversion is handed to
+ * ets_snprintf() in turn with the one argument that it needs.
+ */
+static int ICACHE_FLASH_ATTR syslog_parms_packed(
+    char *buffer, int space, const char *parms, void *arg)
+{
+  SYSLOG_PACKED *packed = (SYSLOG_PACKED *)arg;
+  const uint8 *args = packed->args;
+  const char *conv;
+  char spec[12];
+  char str[SYSLOG_STR_MAX + 1];
+  sint32 value;
+  int total = 0;
+  int written;
+  int len;
+
+  while ((*parms != '\0') && (total < space - 1))
+  {
+    if (*parms != '%')
+    {
+      buffer[total++] = *parms++;
+      continue;
+    }
+
+    conv = syslog_conversion(parms);
+    if ((conv == NULL) || (conv - parms + 2 > sizeof(spec)))
+    {
+      break;
+    }
+    os_memcpy(spec, parms, conv - parms + 1);
+    spec[conv - parms + 1] = '\0';
+    parms = conv + 1;
+
+    if (*conv == '%')
+    {
+      buffer[total++] = '%';
+      continue;
+    }
+    else if (*conv == 's')
+    {
+      if ((args >= packed->end) || (args + 1 + *args > packed->end))
+      {
+        break;
+      }
+      len = *args++;
+      os_memcpy(str, args, len);
+      str[len] = '\0';
+      args += len;
+      written = ets_snprintf(&buffer[total], space - total, spec, str);
+    }
+    else
+    {
+      if (args + sizeof(value) > packed->end)
+      {
+        break;
+      }
+      os_memcpy(&value, args, sizeof(value));
+      args += sizeof(value);
+      written = ets_snprintf(&buffer[total], space - total, spec, value);
+    }
+
+    if ((written < 0) || (written >= space - total))
+    {
+      total = space - 1;
+      break;
+    }
+    total += written;
+  }
+  buffer[total] = '\0';
+  return(total);
+}
+#endif
+
+/**
+ * Format a SYSLOG message.  Refer to RFC5424.
  *
- * This function has been adapted for use by this application and is not
- * intended to be a general purpose function.
+ * Format is:
+ *
+ * - "<" Priority ">"
+ * - Version <space>
+ * - Timestamp <space>
+ * - Hostname <space>
+ * - Application name <space>
+ * - Process ID <space>
+ * - Msg ID <space>
+ * - Structured-data <optional>
+ * - Message.
+ *
+ * At this time, most info is being ignored.
  */
-void ICACHE_FLASH_ATTR syslog(int msg_id, ...)
+static int ICACHE_FLASH_ATTR syslog_format(char *buffer, int msg_id,
+    const char *timestamp, SYSLOG_PARMS_FN parms_fn, void *arg)
 {
-  char *buffer;
-  size_t new_buf_len;
   int written;
   int total_written;
   int space_left;
-  int write_index = -1;
-  sint16 rc;
-  const SYSLOG_MSG *msg = &syslog_msgs[msg_id];
+  SYSLOG_MSG entry;
+  const SYSLOG_MSG *msg = &entry;
 
-  /**
-   * Format is:
-   *
-   * - "<" Priority ">"
-   * - Version <space>
-   * - Timestamp <space>
-   * - Hostname <space>
-   * - Application name <space>
-   * - Process ID <space>
-   * - Msg ID <space>
-   * - Structured-data <optional>
-   * - Message.
-   *
-   * At this time, most info is being ignored.
-   */
-
-  va_list argp;
-  va_start(argp, msg_id);
-
-  // CONSOLE("Debug: IN: Syslog: %d\n", msg_id);
-  write_index = syslog_write_index();
-  buffer = syslog_stack[write_index];
+  syslog_get_msg(msg_id, &entry);
 
   space_left = SYSLOG_BUF_SIZE;
   total_written = 0;
@@ -306,7 +1263,7 @@ void ICACHE_FLASH_ATTR syslog(int msg_id, ...)
         "<%d>%d %s %s %s %d %d",
     (msg->prival | LOG_LOCAL0),
 	SYSLOG_VERSION,
-	sntp_get_syslog_time(),
+	timestamp,
     syslog_ip_address,
     syslog_app_name,
     msg->proc_id,
@@ -322,8 +1279,8 @@ void ICACHE_FLASH_ATTR syslog(int msg_id, ...)
     space_left -=written;
     total_written += written;
 
-    written = ets_vsnprintf(
-        &buffer[total_written], space_left, msg->parms, argp);
+    written = parms_fn(
+        &buffer[total_written], space_left, msg->parms, arg);
     space_left -=written;
     total_written += written;
 
@@ -347,8 +1304,8 @@ void ICACHE_FLASH_ATTR syslog(int msg_id, ...)
     space_left -=written;
     total_written += written;
 
-    written = ets_snprintf(
-        &buffer[total_written], space_left, msg->msg);
+    written = rodata_strncpy(
+        &buffer[total_written], msg->msg, space_left);
     space_left -=written;
     total_written += written;
   }
@@ -364,8 +1321,8 @@ void ICACHE_FLASH_ATTR syslog(int msg_id, ...)
     space_left -=written;
     total_written += written;
 
-    written = ets_vsnprintf(
-        &buffer[total_written], space_left, msg->parms, argp);
+    written = parms_fn(
+        &buffer[total_written], space_left, msg->parms, arg);
     space_left -=written;
     total_written += written;
 
@@ -375,10 +1332,181 @@ void ICACHE_FLASH_ATTR syslog(int msg_id, ...)
   }
 #endif
 
-  syslog_length[write_index] = total_written;
-  CONSOLE(buffer);
-  // CONSOLE("Debug: MID: Syslog: %d\n", msg_id);
+  if (total_written >= SYSLOG_BUF_SIZE)
+  {
+    total_written = SYSLOG_BUF_SIZE - 1;
+  }
+  CONSOLE_DEBUG("%s", buffer);
+  return(total_written);
+}
+
+#ifdef SYSLOG_DEFERRED
+/**
+ * Turn a queued record back into the message text, in syslog_buf.
+ */
+static int ICACHE_FLASH_ATTR syslog_unpack(const uint8 *record, uint16 length)
+{
+  SYSLOG_PACKED packed;
+  uint32 timestamp;
+  uint16 ms;
+
+  os_memcpy(&timestamp, &record[1], sizeof(timestamp));
+  os_memcpy(&ms, &record[5], sizeof(ms));
+  packed.args = &record[SYSLOG_PACKED_HDR];
+  packed.end = &record[length];
+
+  return(syslog_format(syslog_buf, record[0],
+      sntp_format_syslog_time(timestamp, ms), syslog_parms_packed, &packed));
+}
+#endif
+
+/**
+ * Queue a message with the given time.  The arguments are as for syslog().
+ */
+static void ICACHE_FLASH_ATTR syslog_va(int msg_id, uint32 timestamp,
+    uint16 ms, va_list *argp)
+{
+  int length;
+#ifdef SYSLOG_DEFERRED
+  uint8 packed[SYSLOG_PACKED_MAX];
+  SYSLOG_MSG msg;
+#endif
+
+  if (syslog_arena == NULL)
+  {
+    return;
+  }
+#ifdef SYSLOG_DEFERRED
+  syslog_get_msg(msg_id, &msg);
+  packed[0] = msg_id;
+  os_memcpy(&packed[1], &timestamp, sizeof(timestamp));
+  os_memcpy(&packed[5], &ms, sizeof(ms));
+  length = SYSLOG_PACKED_HDR + syslog_pack(&packed[SYSLOG_PACKED_HDR],
+      SYSLOG_PACKED_MAX - SYSLOG_PACKED_HDR,
+      msg.parms, *argp);
+
+  syslog_queue(packed, length);
+#else
+  length = syslog_format(syslog_buf, msg_id,
+      sntp_format_syslog_time(timestamp, ms), syslog_parms_va, argp);
+
+  /**
+   * Queue just the bytes that the message needs.
+   */
+  syslog_queue((uint8 *)syslog_buf, length);
+#endif
+
   syslog_sendto();
-  // CONSOLE("Debug: OUT: Syslog: %d\n", msg_id);
+}
+
+/**
+ * Create a SYSLOG message.
+ *
+ * This function has been adapted for use by this application and is not
+ * intended to be a general purpose function.
+ *
+ * With SYSLOG_DEFERRED only the message ID, the time and the arguments are
+ * queued; the text is produced by syslog_sendto() when the message is
+ * actually sent.
+ *
+ * This must not be called from an interrupt; use syslog_isr() there.
+ */
+void ICACHE_FLASH_ATTR syslog(int msg_id, ...)
+{
+  uint32 timestamp;
+  uint16 ms;
+  va_list argp;
+
+  timestamp = sntp_get_syslog_timestamp(&ms);
+  va_start(argp, msg_id);
+  syslog_va(msg_id, timestamp, ms, &argp);
+  va_end(argp);
+}
+
+/**
+ * Queue a message for an event that happened 'age_us' ago.
+ */
+static void ICACHE_FLASH_ATTR syslog_aged(int msg_id, uint32 age_us, ...)
+{
+  uint32 timestamp;
+  uint16 ms;
+  uint64 when;
+  va_list argp;
+
+  timestamp = sntp_get_syslog_timestamp(&ms);
+  va_start(argp, age_us);
+  if (ms == SNTP_MS_UNKNOWN)
+  {
+    // To the nearest second is the best we can do.
+    timestamp -= (timestamp > age_us / 1000000) ? age_us / 1000000 : timestamp;
+    syslog_va(msg_id, timestamp, ms, &argp);
+  }
+  else
+  {
+    when = ((uint64)timestamp * 1000) + ms;
+    when = (when > age_us / 1000) ? when - (age_us / 1000) : 0;
+    syslog_va(msg_id, (uint32)(when / 1000), (uint16)(when % 1000), &argp);
+  }
   va_end(argp);
 }
+
+/**
+ * Log an event from an interrupt handler.
+ *
+ * Only the message ID, two arguments and the time are stored, in a ring
+ * that the interrupt handler only ever adds to and syslog_isr_task() only
+ * ever takes from, so neither needs to lock out the other.  The message is
+ * queued as if by syslog(msg_id, a0, a1) once the task runs, timestamped
+ * with when this was called.  If the ring is full the event is counted and
+ * the count reported once the ring has been emptied.
+ *
+ * Only one interrupt handler may call this at a time, which is the case for
+ * all of the level 1 interrupts but not the NMI.
+ */
+void syslog_isr(uint8 msg_id, uint32 a0, uint32 a1)
+{
+  SYSLOG_ISR_EVENT *event;
+  uint8 head = syslog_isr_head;
+
+  if ((uint8)(head - syslog_isr_tail) >= SYSLOG_ISR_EVENTS)
+  {
+    syslog_isr_lost++;
+  }
+  else
+  {
+    event = &syslog_isr_ring[head & (SYSLOG_ISR_EVENTS - 1)];
+    event->msg_id = msg_id;
+    event->time_us = system_get_time();
+    event->a0 = a0;
+    event->a1 = a1;
+
+    // The entry must be complete before the task can see it.
+    asm volatile ("memw" : : : "memory");
+    syslog_isr_head = head + 1;
+  }
+
+  // If this fails the task is already due to run.
+  system_os_post(CFG_TASK_PRIO_SYSLOG, 0, 0);
+}
+
+static void ICACHE_FLASH_ATTR syslog_isr_task(os_event_t *e)
+{
+  SYSLOG_ISR_EVENT *event;
+  uint8 tail = syslog_isr_tail;
+  uint32 lost;
+
+  while (tail != syslog_isr_head)
+  {
+    event = &syslog_isr_ring[tail & (SYSLOG_ISR_EVENTS - 1)];
+    syslog_aged(event->msg_id, system_get_time() - event->time_us,
+        event->a0, event->a1);
+    syslog_isr_tail = ++tail;
+  }
+
+  lost = syslog_isr_lost;
+  if (lost != syslog_isr_lost_reported)
+  {
+    syslog(SMSG_SLOG_ISR_LOST, lost - syslog_isr_lost_reported);
+    syslog_isr_lost_reported = lost;
+  }
+}
@@ -80,3 +80,8 @@ CODE prioritynames[] = {
 
 void syslog_setup(char *hostname, int port, const char* app_name, const char **procs, const SYSLOG_MSG *msgs);
 void syslog(int, ...);
+void syslog_isr(uint8 msg_id, uint32 a0, uint32 a1);
+void syslog_start(void);
+void syslog_stop(void);
+bool syslog_drained(void);
+void syslog_flush(void);
@@ -0,0 +1,87 @@
+/*
+ *  Binary trace frames, or the formats for text traces.  See trace.h.
+ */
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "stdarg.h"
+#include "driver/uart.h"
+#include "config.h"
+#include "rodata.h"
+#include "logging.h"
+#include "trace.h"
+
+#ifdef CFG_TRACE_BINARY
+static uint8 trace_seq = 0;
+static uint32 trace_lost = 0;
+
+/**
+ * Send a frame.  A frame that will not fit in the UART's TX ring is dropped
+ * whole, rather than sent in part, but still uses up a sequence number so
+ * that the decoder sees the gap.
+ */
+void ICACHE_FLASH_ATTR trace(uint8 id, int nargs, ...)
+{
+	uint8 frame[TRACE_FRAME_MAX];
+	uint32 value;
+	uint8 check = 0;
+	int length;
+	int ii;
+	va_list argp;
+
+	if (nargs > TRACE_MAX_ARGS)
+	{
+		nargs = TRACE_MAX_ARGS;
+	}
+
+	frame[0] = TRACE_SYNC;
+	frame[1] = 7 + (4 * nargs);
+	frame[2] = trace_seq++;
+	frame[3] = id;
+	value = system_get_time();
+	os_memcpy(&frame[4], &value, 4);
+
+	va_start(argp, nargs);
+	for (ii = 0; ii < nargs; ii++)
+	{
+		value = va_arg(argp, uint32);
+		os_memcpy(&frame[8 + (4 * ii)], &value, 4);
+	}
+	va_end(argp);
+
+	length = 8 + (4 * nargs);
+	for (ii = 1; ii < length; ii++)
+	{
+		check += frame[ii];
+	}
+	frame[length++] = ~check;
+
+	if (!UARTWrite(frame, length))
+	{
+		trace_lost++;
+	}
+}
+
+uint32 ICACHE_FLASH_ATTR trace_dropped(void)
+{
+	return(trace_lost);
+}
+#else
+/**
+ * The formats, in flash, for console().
+ */
+#define TRACE_DEF(id, nargs, format) \
+	static const char id##_format[] RODATA = format;
+#include "trace.def"
+#undef TRACE_DEF
+
+#define TRACE_DEF(id, nargs, format) id##_format,
+const char * const trace_formats[] RODATA =
+{
+#include "trace.def"
+	NULL
+};
+#undef TRACE_DEF
+#endif
@@ -0,0 +1,59 @@
+/**
+ * Trace points for timing-sensitive code.
+ *
+ * Each trace point has an ID and a format in the catalog, trace.def.  With
+ * CFG_TRACE_BINARY defined a trace is sent to the UART as a small binary
+ * frame holding the ID, a sequence number, the time and the raw arguments,
+ * which takes a fraction of the time and bytes of formatting it; read the
+ * output with tools/trace433, which also reports lost frames.  Without it
+ * a trace is console debug output, formatted as usual and compiled out
+ * unless the module's CONSOLE_LEVEL is CONSOLE_LEVEL_DEBUG.
+ *
+ * A frame is
+ *
+ *   TRACE_SYNC, length, sequence, ID, time (4), arguments (4 each), check
+ *
+ * where length counts the bytes after it, multi-byte values are little
+ * endian, the time is system_get_time() and check is the sum of the bytes
+ * from length to the last argument, inverted.
+ *
+ * Not for use from interrupts; use syslog_isr() there.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_SYNC		0xA5
+#define TRACE_MAX_ARGS		4
+#define TRACE_FRAME_MAX		(9 + (4 * TRACE_MAX_ARGS))	// With the check.
+
+#define TRACE_DEF(id, nargs, format) id,
+enum trace_id
+{
+#include "trace.def"
+	TRACE_INVALID
+};
+#undef TRACE_DEF
+
+#ifdef CFG_TRACE_BINARY
+void trace(uint8 id, int nargs, ...);
+uint32 trace_dropped(void);
+
+#define TRACE0(id)             trace((id), 0)
+#define TRACE1(id, a)          trace((id), 1, (uint32)(a))
+#define TRACE2(id, a, b)       trace((id), 2, (uint32)(a), (uint32)(b))
+#define TRACE3(id, a, b, c)    trace((id), 3, (uint32)(a), (uint32)(b), (uint32)(c))
+#elif CONSOLE_LEVEL >= CONSOLE_LEVEL_DEBUG
+extern const char * const trace_formats[];
+
+#define TRACE0(id)             console(CONSOLE_LEVEL_DEBUG, trace_formats[id])
+#define TRACE1(id, a)          console(CONSOLE_LEVEL_DEBUG, trace_formats[id], (a))
+#define TRACE2(id, a, b)       console(CONSOLE_LEVEL_DEBUG, trace_formats[id], (a), (b))
+#define TRACE3(id, a, b, c)    console(CONSOLE_LEVEL_DEBUG, trace_formats[id], (a), (b), (c))
+#else
+#define TRACE0(id)             do {} while (0)
+#define TRACE1(id, a)          do {} while (0)
+#define TRACE2(id, a, b)       do {} while (0)
+#define TRACE3(id, a, b, c)    do {} while (0)
+#endif
+
+#endif
@@ -9,69 +9,59 @@
 #include "mem.h"
 #include "driver/gpio16.h"
 #include "driver/uart.h"
+#include "driver/i2s_433.h"
 #include "config.h"
 #include "wifi.h"
 #include "sntp.h"
+#include "clock.h"
 #include "logging.h"
 #include "syslog.h"
+#include "heap.h"
+#include "sleep.h"
+#include "http.h"
+#include "ctl.h"
+#include "rodata.h"
+#include "sensor433.h"
+#include "rx433.h"
 #define DEFINE_VARS
 #include "msg.h"
 
-//#define CONSOLE(FMT, args...) ets_uart_printf(FMT,  ##args); ets_uart_printf("\n")
-//#define CONSOLE(FMT, args...)
+os_timer_t send_timer = { 0 };
+static os_timer_t report_timer;
 
 /**
- * *** YOU WILL WANT TO CHANGE THIS ***
- *
- * This defines the format of the 32-bit data that is sent to the
- * weather sensor. The format you choose will be specific to your
- * sensor.
+ * What the sender is to send next, kept over resets and deep sleep (see
+ * sleep.h).  The payload is encoded ahead so that a wake can send it
+ * straight away.
  */
-#define CFG_433_1_VALUE		400
-#define CFG_433_4_VALUE		(4 * CFG_433_1_VALUE)
-#define CFG_433_17_VALUE	(17 * CFG_433_1_VALUE)
-
-#define CFG_433_SENDER		0x94000000
-#define CFG_433_BATTERY_OK  0x00800000
-#define CFG_433_BEEP        0x00400000
-#define CFG_433_00200000    0x00200000
-#define CFG_433_00100000    0x00100000
+typedef struct sender_state
+{
+	sint32 temp;
+	sint32 temp_inc;
+	uint32 data_433;
+} SENDER_STATE;
 
-#define CFG_TEMP_SHIFT      8
-#define CFG_TEMP_MASK       0x000FFF00
-
-os_timer_t send_timer = { 0 };
+static SENDER_STATE sender = { -128, 1, 0 };
+RODATA_ASSERT(sender_state_size, sizeof(SENDER_STATE) <= SLEEP_APP_MAX);
 
 /**
- * Forward prototypes.
+ * How often, as whom and how many times over to send; may be changed over
+ * the control protocol (see ctl.h).
  */
-static void ICACHE_FLASH_ATTR send_433_temp(sint32 temperature);
+static CTL_SCHEDULE schedule =
+{
+	CFG_SEND_INTERVAL_MS, CFG_433_SENDER, I2S_FRAME_REPEATS
+};
 
+#ifdef CFG_DEEP_SLEEP
 /**
- * *** YOUR WEATHER STATION WILL HAVE ITS OWN CHECKSUM ALGORITHM ***
- *
- * Generate the 8-bit checksum that forms the end of the 32-bit
- * data to send to the weather station receiver.
+ * On a wake with WiFi, how long we have been waiting to go back to sleep.
  */
-void add_433_checksum(uint32 *data_433)
-{
-	uint32 check_sum = 0;
-	uint32 data = (*data_433);
-	int ii;
-
-	for (ii = 0; ii < 40; ii++)
-	{
-		if (check_sum & 0x80)
-		{
-			check_sum ^= 0x18;
-		}
-		check_sum = ((check_sum & 0x80) >> 7) | (check_sum << 1);
-		check_sum ^= ((data & 0x80000000) >> 31);
-		data <<= 1;
-	}
-	(*data_433) |= (check_sum & 0x000000FF);
-	return;
-}
+#define SLEEP_POLL_MS	250
+static os_timer_t sleep_timer;
+static uint32 sleep_waited;
+static bool sleep_polling = FALSE;
+#endif
 
 /**
  * Build the 32-bit value that is used to transmit the temperature to
@@ -79,34 +69,34 @@ void add_433_checksum(uint32 *data_433)
  */
 static void send_433_data(uint32 data_433)
 {
+	I2S_FRAME *frame;
+
 	/**
 	 * Now build the frame and send this using the new DMA/I2S infrastructure.
+	 * The send queue holds its own reference to the frame.
 	 */
-	ets_uart_printf("@");
-	CONSOLE("InitSignal...");
-	i2sInitSignal();
-	CONSOLE("BuildSignal...");
-	i2sDataValue(data_433);
-	CONSOLE("TermSignal...");
-	i2sTermSignal();
-	CONSOLE("SendSignal...");
-	i2sSendSignal();
-	CONSOLE("DMA is sending...");
+	CONSOLE_DEBUG("Encode frame...");
+	frame = i2sFrameData(data_433);
+	if (frame == NULL)
+	{
+		CONSOLE_ERROR("No frame to send %08x", data_433);
+		return;
+	}
+	CONSOLE_DEBUG("Send frame...");
+	i2sSendFrame(frame, schedule.repeats);
+	i2sFrameRelease(frame);
+	CONSOLE_DEBUG("DMA is sending...");
 }
 /**
  * Build the 32-bit value that is used to transmit the temperature to
- * the base station and then request that it be sent three times.
+ * the base station.
  */
-static void send_433_temp(sint32 temperature)
+static uint32 encode_433_temp(sint32 temperature)
 {
 	uint32 data_433;
 
-	/**
-	 * First build the 32-bit value.
-	 */
-	CONSOLE("Temp: %d", temperature);
 	data_433 = 0;
-	data_433 |= CFG_433_SENDER;
+	data_433 |= schedule.sender;
 	data_433 |= CFG_433_BATTERY_OK;
 	// data_433 |= CFG_433_BEEP;
 	// data_433 |= CFG_433_00200000;
@@ -114,69 +104,118 @@ static void send_433_temp(sint32 temperature)
 	data_433 |= ((temperature << CFG_TEMP_SHIFT) & CFG_TEMP_MASK);
 
 	add_433_checksum(&data_433);
-	send_433_data(data_433);
+	return(data_433);
 }
 
 /**
- * Timer driven loop that drives the whole process.  The timer keeps
- * incrementing the temperature by +/- 0.1degC between -12.7 and +12.8.
+ * Move on to the next temperature, incrementing by +/- 0.1degC between
+ * -12.7 and +12.8, and encode it ready to send.
  *
  * Note that the encoding multiples up temperatures by 10 so 12.3 is
  * represented by 123.
  */
-static void send_loop(void *arg)
+static void sender_next(void)
 {
-	static sint32 temp = -128;
-	static sint32 temp_inc = 1;
-
-	CONSOLE("Send temp: %d", temp);
-	send_433_temp(temp);
-	temp = temp + temp_inc;
-	if ((temp < -127 || temp > 128))
+	sender.temp = sender.temp + sender.temp_inc;
+	if ((sender.temp < -127 || sender.temp > 128))
 	{
 		/**
 		 * Reverse direction.
 		 */
-		temp_inc = -temp_inc;
-		temp = temp + 2 * temp_inc;
+		sender.temp_inc = -sender.temp_inc;
+		sender.temp = sender.temp + 2 * sender.temp_inc;
 	}
+	sender.data_433 = encode_433_temp(sender.temp);
 }
 
 /**
- * The first timer driven send now starts the repeating faster timer.
+ * Timer driven loop that drives the whole process.  The state is saved
+ * after each send so that a reset carries on with the next value, and the
+ * timer is armed for the next deadline rather than repeating so that
+ * neither the time spent here nor a reset moves the sends.
  */
-static void send_loop_second(void *arg)
+static void send_loop(void *arg)
 {
+	CONSOLE_INFO("Send temp: %d", sender.temp);
+	if ((sender.data_433 & CFG_433_SENDER_MASK) != schedule.sender)
+	{
+		sender.data_433 = encode_433_temp(sender.temp);
+	}
+	send_433_data(sender.data_433);
+	sender_next();
+	sleep_schedule(schedule.interval_ms);
+#ifndef CFG_DEEP_SLEEP
+	sleep_save();
 	os_timer_disarm(&send_timer);
-	os_timer_setfn(&send_timer, (os_timer_func_t *)send_loop, NULL);
-	// os_timer_arm(&send_timer, (29000 + 850 + 500), TRUE);
-	os_timer_arm(&send_timer, 30000, TRUE);
-	send_loop(arg);
+	os_timer_arm(&send_timer, sleep_due_ms() + 1, FALSE);
+#endif
 }
 
-static void send_loop_first(void *arg)
+/**
+ * Everything set up at boot has its memory by now.
+ */
+static void report_once(void *arg)
 {
-	os_timer_disarm(&send_timer);
-	os_timer_setfn(&send_timer, (os_timer_func_t *)send_loop, NULL);
-	// os_timer_arm(&send_timer, 122850, FALSE);
-	// os_timer_arm(&send_timer, 123350, FALSE);
-	// os_timer_arm(&send_timer, 123850, FALSE);
-	// Just, late os_timer_arm(&send_timer, 124350, FALSE);
-	// os_timer_arm(&send_timer, 124850, FALSE);
-	// os_timer_arm(&send_timer, 125350, FALSE);
-	// os_timer_arm(&send_timer, 30500, TRUE);
-	os_timer_arm(&send_timer, 30000, TRUE);
-	send_loop(arg);
+	heap_report();
+}
+
+#ifdef CFG_DEEP_SLEEP
+/**
+ * Nothing is being sent and nothing waits to be.
+ */
+static bool sleep_idle(void)
+{
+	return(i2sSendIdle() && (ctl_queued() == 0));
+}
+
+/**
+ * Stay awake until sending is over and, with WiFi up, until the log has
+ * gone and the clock is synced or for CFG_SLEEP_NET_MS at most.
+ */
+static void sleep_poll(void *arg)
+{
+	sleep_waited += SLEEP_POLL_MS;
+	if (!sleep_idle())
+	{
+		return;
+	}
+	if ((!sleep_network()) || (sleep_waited >= CFG_SLEEP_NET_MS) ||
+	    (syslog_drained() && clock_valid()))
+	{
+		os_timer_disarm(&sleep_timer);
+		sleep_now();
+	}
 }
+#endif
 
-static void send_callback(void *arg)
+static void send_callback(void)
 {
 	/**
 	 * Sending has finished; log the time it took.
 	 */
 #if 0
 	uint32 send_time = slc_dbg_get_send_time();
-    CONSOLE("Frame send in %dus", send_time);
+    CONSOLE_INFO("Frame send in %dus", send_time);
+#endif
+
+	/**
+	 * Anything queued over the control protocol can go now.
+	 */
+	ctl_sent();
+
+#ifdef CFG_DEEP_SLEEP
+	if ((!sleep_network()) && sleep_idle())
+	{
+		sleep_now();
+	}
+	else if (!sleep_polling)
+	{
+		sleep_polling = TRUE;
+		sleep_waited = 0;
+		os_timer_disarm(&sleep_timer);
+		os_timer_setfn(&sleep_timer, (os_timer_func_t *)sleep_poll, NULL);
+		os_timer_arm(&sleep_timer, SLEEP_POLL_MS, TRUE);
+	}
 #endif
 }
 
@@ -190,48 +229,88 @@ void user_init(void)
 
 
 	UARTInit(BIT_RATE_76800);
-	CONSOLE("SDK version:%s", system_get_sdk_version());
-	CONSOLE("433MHz receiver active");
+	CONSOLE_INFO("SDK version:%s", system_get_sdk_version());
+	CONSOLE_INFO("433MHz receiver active");
+
+	/**
+	 * Carry on from where we were before a reset or deep sleep.
+	 */
+	if (!sleep_setup(&sender, sizeof(sender)))
+	{
+		sender.data_433 = encode_433_temp(sender.temp);
+	}
+
+	/**
+	 * We send data as follows:
+	 *
+	 * Data is sent every 30s to sync with the receiver which saves power
+	 * by only enabling it's receive circuitry around then.  Only the
+	 * transmitter is needed to send so it is set up first, and if a send
+	 * is due (after a reset, a power cycle or a first boot) it goes now,
+	 * within a few milliseconds of reset, while everything else is still
+	 * starting.
+	 */
+	CONSOLE_DEBUG("Initialize I2S...");
+	os_timer_disarm(&send_timer);
+	os_timer_setfn(&send_timer, (os_timer_func_t *)send_loop, NULL);
+	if (!i2sInit(send_callback))
+	{
+		CONSOLE_ERROR("I2S not initialized, nothing will be sent");
+	}
+	else if (sleep_due_ms() == 0)
+	{
+		send_loop(NULL);
+	}
+	else
+	{
+		os_timer_arm(&send_timer, sleep_due_ms() + 1, FALSE);
+	}
 
 	/**
 	 * Enable the syslogging.  Note that this will not do anything until there
 	 * is a successful WiFi connection.
 	 */
 	syslog_setup(syslog_server, CFG_SYSLOG_PORT, smsg_app_name, &smsg_procs[0], &smsg_msgs[0]);
+	http_setup();
+	ctl_setup(&schedule);
 
 	/**
-	 * Now set up the connection to the WiFi network.
+	 * Now set up the connection to the WiFi network, unless this is a deep
+	 * sleep wake with the radio off.
 	 */
-	wifi_setup(CFG_WIFI_SSID, CFG_WIFI_PWD);
+	if (sleep_network())
+	{
+		wifi_setup(CFG_WIFI_SSID, CFG_WIFI_PWD);
 
-	/**
-	 * Set up the SNTP client which we use to get timestamps for logging etc.
-	 */
-	sntp_setup(CFG_NTP_SERVER_0,
-			   CFG_NTP_SERVER_1,
-			   CFG_NTP_SERVER_2,
-			   CFG_NTP_TIMEZONE);
+		/**
+		 * Set up the SNTP client which we use to get timestamps for logging
+		 * etc.
+		 */
+		sntp_setup(CFG_NTP_SERVER_0,
+				   CFG_NTP_SERVER_1,
+				   CFG_NTP_SERVER_2,
+				   CFG_NTP_TIMEZONE);
+		clock_setup();
+	}
+	else
+	{
+		wifi_set_opmode_current(NULL_MODE);
+	}
 
 	/**
 	 * Start the watchdog timer.
 	 */
 	//wdog_setup(CFG_WDOG_INTERVAL);
 
-	CONSOLE("Initialize I2S...");
-	i2sInit(send_callback);
-
-    /**
-     * We send data as follows:
-     *
-     * Data is sent every 31s to sync with the receiver which saves power
-     * by only enabling it's receive circuitry every 30-31s.
-     *
-     * We populate with data on each transmission and we will lose the
-     * 2/3/4 transmissions because the receiver will be waiting for the
-     * time-signal during this period.
-     */
-    os_timer_disarm(&send_timer);
-	CONSOLE("Start send timer");
-    os_timer_setfn(&send_timer, (os_timer_func_t *)send_loop_first, NULL);
-    os_timer_arm(&send_timer, 5000, FALSE);
+#ifdef CFG_433_RX
+	rx433_setup();
+#endif
+
+	/**
+	 * Keep an eye on how much heap the SDK has left.
+	 */
+	heap_setup();
+	os_timer_disarm(&report_timer);
+	os_timer_setfn(&report_timer, (os_timer_func_t *)report_once, NULL);
+	os_timer_arm(&report_timer, 5000, FALSE);
 }
@@ -1,28 +1,138 @@
+/*
+ *  WiFi station set up and events.
+ *
+ *  A full connect scans every channel for the SSID, then associates and
+ *  asks DHCP for an address, which takes seconds.  The access point, its
+ *  channel and the address we were given are cached in RTC memory so that
+ *  after a reset or deep sleep we can go straight to that access point on
+ *  that channel and, with CFG_WIFI_REUSE_LEASE, skip DHCP too.  If that
+ *  fails, or takes longer than WIFI_FAST_TIMEOUT_MS, we fall back to a full
+ *  connect and the cache is not tried again until it has been refreshed.
+ */
+
 #include "ets_sys.h"
 #include "osapi.h"
 #include "os_type.h"
 #include "user_interface.h"
-#include "mem.h"
 #include "wifi.h"
 #include "config.h"
+#include "logging.h"
 #include "msg.h"
 #include "syslog.h"
+#include "http.h"
+#include "rodata.h"
+
+#define WIFI_CACHE_MAGIC	0x49464957
+#define WIFI_FAST_TIMEOUT_MS	3000
+
+typedef struct wifi_cache
+{
+	uint32 magic;
+	uint32 hash;
+	uint8 bssid[6];
+	uint8 channel;
+	uint8 failed;
+	struct ip_info ip;
+} WIFI_CACHE;
+
+RODATA_ASSERT(wifi_rtc_size, sizeof(WIFI_CACHE) <= 4 * CFG_RTC_WIFI_BLOCKS);
+RODATA_ASSERT(wifi_rtc_end, CFG_RTC_WIFI + CFG_RTC_WIFI_BLOCKS <= CFG_RTC_END);
+
+static WIFI_CACHE wifi_cache;
+static struct station_config wifi_config;
+static bool wifi_fast = FALSE;
+static uint32 wifi_start_us;
+static os_timer_t wifi_fast_timer;
+
+/**
+ * A hash of the network name and password so that a cache for a different
+ * network is not used.
+ */
+static uint32 ICACHE_FLASH_ATTR wifi_hash(const char *ssid, const char *password)
+{
+	uint32 hash = 2166136261UL;
+
+	while (*ssid != '\0')
+	{
+		hash = (hash ^ (uint8)*ssid++) * 16777619UL;
+	}
+	hash = (hash ^ 0xFF) * 16777619UL;
+	while (*password != '\0')
+	{
+		hash = (hash ^ (uint8)*password++) * 16777619UL;
+	}
+	return(hash);
+}
+
+/**
+ * The cached access point did not work; connect the slow way.
+ */
+static void ICACHE_FLASH_ATTR wifi_fallback(void *arg)
+{
+	os_timer_disarm(&wifi_fast_timer);
+	if (!wifi_fast)
+	{
+		return;
+	}
+	wifi_fast = FALSE;
+	CONSOLE_WARN("WiFi: cached access point failed, scanning");
+
+	wifi_cache.failed = TRUE;
+	system_rtc_mem_write(CFG_RTC_WIFI, &wifi_cache, sizeof(wifi_cache));
+
+	wifi_station_disconnect();
+#ifdef CFG_WIFI_REUSE_LEASE
+	wifi_station_dhcpc_start();
+#endif
+	wifi_config.bssid_set = 0;
+	wifi_station_set_config_current(&wifi_config);
+	wifi_station_connect();
+}
 
 void ICACHE_FLASH_ATTR wifi_setup(char *ssid, char *password)
 {
-	struct station_config *config = (struct station_config *)os_zalloc(sizeof(struct station_config));
+	wifi_start_us = system_get_time();
+	os_memset(&wifi_config, 0, sizeof(wifi_config));
 
 	/* need to set opmode before you set config */
 	wifi_set_event_handler_cb(wifi_handle_event_cb);
 	wifi_set_opmode(STATION_MODE);
 
-	os_sprintf(config->ssid, ssid);
-	os_sprintf(config->password, password);
+	os_sprintf(wifi_config.ssid, ssid);
+	os_sprintf(wifi_config.password, password);
+
+	system_rtc_mem_read(CFG_RTC_WIFI, &wifi_cache, sizeof(wifi_cache));
+	if ((wifi_cache.magic != WIFI_CACHE_MAGIC) ||
+	    (wifi_cache.hash != wifi_hash(ssid, password)))
+	{
+		os_memset(&wifi_cache, 0, sizeof(wifi_cache));
+		wifi_cache.magic = WIFI_CACHE_MAGIC;
+		wifi_cache.hash = wifi_hash(ssid, password);
+		wifi_cache.failed = TRUE;
+	}
+
+	/**
+	 * Go straight to the access point that we last used, on its channel,
+	 * with the address it last gave us.
+	 */
+	wifi_fast = !wifi_cache.failed;
+	if (wifi_fast)
+	{
+		wifi_config.bssid_set = 1;
+		os_memcpy(wifi_config.bssid, wifi_cache.bssid, sizeof(wifi_config.bssid));
+		wifi_set_channel(wifi_cache.channel);
+#ifdef CFG_WIFI_REUSE_LEASE
+		wifi_station_dhcpc_stop();
+		wifi_set_ip_info(STATION_IF, &wifi_cache.ip);
+#endif
+		os_timer_disarm(&wifi_fast_timer);
+		os_timer_setfn(&wifi_fast_timer, (os_timer_func_t *)wifi_fallback, NULL);
+		os_timer_arm(&wifi_fast_timer, WIFI_FAST_TIMEOUT_MS, FALSE);
+	}
 
 	/* need to sure that you are in station mode first,
 	 * otherwise it will be failed. */
-	wifi_station_set_config(config);
-	os_free(config);
+	wifi_station_set_config(&wifi_config);
 	syslog(SMSG_WIFI_INIT);
 }
 
@@ -32,6 +142,9 @@ void ICACHE_FLASH_ATTR wifi_handle_event_cb(System_Event_t *evt)
 	switch (evt->event) {
 
 	case EVENT_STAMODE_CONNECTED:
+		os_memcpy(wifi_cache.bssid, evt->event_info.connected.bssid,
+		    sizeof(wifi_cache.bssid));
+		wifi_cache.channel = evt->event_info.connected.channel;
 		syslog(
             SMSG_WIFI_CONNECT,
 		    evt->event_info.connected.ssid,
@@ -44,6 +157,8 @@ void ICACHE_FLASH_ATTR wifi_handle_event_cb(System_Event_t *evt)
 		    evt->event_info.disconnected.ssid,
 		    evt->event_info.disconnected.reason);
 		syslog_stop();
+		http_stop();
+		wifi_fallback(NULL);
 		break;
 
 	case EVENT_STAMODE_AUTHMODE_CHANGE:
@@ -57,11 +172,31 @@ void ICACHE_FLASH_ATTR wifi_handle_event_cb(System_Event_t *evt)
 
 	case EVENT_STAMODE_GOT_IP:
 		syslog_start();
+		http_start();
 		syslog(
 			SMSG_WIFI_IP,
 			IP2STR(&evt->event_info.got_ip.ip),
 		    IP2STR(&evt->event_info.got_ip.mask),
 		    IP2STR(&evt->event_info.got_ip.gw));
+
+		/**
+		 * Only the first connection after boot is timed; later ones
+		 * start from when the link went down, which we do not know.
+		 */
+		if (wifi_start_us != 0)
+		{
+			syslog(SMSG_WIFI_TIME, wifi_fast,
+			    (system_get_time() - wifi_start_us) / 1000);
+			wifi_start_us = 0;
+		}
+		os_timer_disarm(&wifi_fast_timer);
+		wifi_fast = FALSE;
+
+		wifi_cache.ip.ip = evt->event_info.got_ip.ip;
+		wifi_cache.ip.netmask = evt->event_info.got_ip.mask;
+		wifi_cache.ip.gw = evt->event_info.got_ip.gw;
+		wifi_cache.failed = FALSE;
+		system_rtc_mem_write(CFG_RTC_WIFI, &wifi_cache, sizeof(wifi_cache));
 		break;
 
 	case EVENT_SOFTAPMODE_STACONNECTED: